@@ -0,0 +1,191 @@
+/*
+ * ---------------------------------------------------------------------------
+ *
+ * Minitalk: a basic talk-like server/client
+ * Copyright (C) 2004 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: bench/accept.c
+ *
+ * Description: Connection Rate Benchmark
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+/*****************************************************************************
+ *
+ * Headers
+ *
+ */
+
+/* System headers */
+#include <stdlib.h> /* malloc(), free()   */
+#include <stdio.h>  /* printf(), perror() */
+#include <assert.h> /* assert()           */
+
+/* Project headers */
+#include <common.h>
+#include "bench.h"
+
+
+/*****************************************************************************
+ *
+ * Constants
+ *
+ */
+
+/* Number of connections per burst size (divided in quick mode) */
+#define ACCEPT_CONNECTIONS 4096
+
+/* Largest number of clients connecting at once */
+#define ACCEPT_MAX_BURST 128
+
+/* Time given to the server to answer a client, in seconds */
+#define ACCEPT_TIMEOUT 5.0
+
+
+/*****************************************************************************
+ *
+ * Local functions
+ *
+ */
+
+/*
+ * Connect clients by bursts; each one sends a line and waits for the server
+ * to answer it before all are closed.  Returns the number of answered
+ * connections and the time each one took.
+ */
+static int run_bursts(const bench_server_t *const server,
+		      bench_client_t *const clients, const int burst,
+		      const int count, double *const times)
+{
+    int i;      /* Client index        */
+    int done;   /* Answered clients    */
+    int size;   /* Size of this burst  */
+    int opened; /* Connected clients   */
+
+    for (done = 0; done < count; done += size) {
+	size = count - done < burst ? count - done : burst;
+
+	/* Connect the whole burst (unauthenticated clients are answered
+	 * right away) */
+	for (opened = 0; opened < size; opened++) {
+	    times[done + opened] = bench_time();
+	    if (bench_client_open(&clients[opened], server, 0) != 0)
+		break;
+	    if (bench_client_send(&clients[opened], "hello\n") != 0) {
+		opened++;
+		break;
+	    }
+	}
+
+	/* Then wait for the answers */
+	for (i = 0; i < opened && bench_client_expect(&clients[i],
+						      "not authenticated",
+						      ACCEPT_TIMEOUT) == 0;
+	     i++)
+	    times[done + i] = bench_time() - times[done + i];
+
+	while (opened > 0)
+	    bench_client_close(&clients[--opened]);
+	if (i != size)
+	    return done + i;
+    }
+
+    return done;
+}
+
+
+/*****************************************************************************
+ *
+ * Public functions
+ *
+ */
+
+/*
+ * Measure how many connections per second the server accepts and answers.
+ */
+int bench_accept(const bench_options_t *const options)
+{
+    int             i;       /* Burst size index     */
+    int             count;   /* Connections per run  */
+    int             done;    /* Answered connections */
+    int             res;     /* Result               */
+    double          start;   /* Run start            */
+    double          elapsed; /* Run duration         */
+    double         *times;   /* Connection durations */
+    bench_client_t *clients; /* Connecting clients   */
+    bench_stats_t   stats;   /* Duration statistics  */
+    bench_server_t  server;  /* Launched server      */
+
+    /* Number of clients connecting at once */
+    static const int bursts[] = {1, 16, ACCEPT_MAX_BURST};
+
+    assert(options != NULL);
+
+    count = options->quick ? ACCEPT_CONNECTIONS / 16 : ACCEPT_CONNECTIONS;
+    times = malloc(count * sizeof(double));
+    clients = malloc(ACCEPT_MAX_BURST * sizeof(bench_client_t));
+    if (times == NULL || clients == NULL) {
+	perror("Error while allocating memory");
+	free(times);
+	free(clients);
+	return -1;
+    }
+    if (bench_server_start(&server, options, NULL) != 0) {
+	free(times);
+	free(clients);
+	return -1;
+    }
+
+    printf("  %-5s %12s %10s %10s %10s\n", "burst", "connections/s",
+	   "p50 (us)", "p99 (us)", "max (us)");
+
+    res = 0;
+    for (i = 0; i < (int) (sizeof(bursts) / sizeof(bursts[0])); i++) {
+	start = bench_time();
+	done = run_bursts(&server, clients, bursts[i], count, times);
+	elapsed = bench_time() - start;
+
+	/* Every client must have been answered */
+	if (done != count) {
+	    printf("  %-5d only %d connections of %d were answered\n",
+		   bursts[i], done, count);
+	    res = -1;
+	    break;
+	}
+
+	bench_get_stats(times, count, &stats);
+	printf("  %-5d %12.0f %10.0f %10.0f %10.0f\n", bursts[i],
+	       count / elapsed, stats.p50 * 1e6, stats.p99 * 1e6,
+	       stats.max * 1e6);
+    }
+
+    if (bench_server_stop(&server) != 0) {
+	printf("  the server did not exit properly\n");
+	res = -1;
+    }
+    free(times);
+    free(clients);
+    return res;
+}
+
+/* End of file */
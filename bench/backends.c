@@ -0,0 +1,266 @@
+/*
+ * ---------------------------------------------------------------------------
+ *
+ * Minitalk: a basic talk-like server/client
+ * Copyright (C) 2004 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: bench/backends.c
+ *
+ * Description: Event Backend Benchmark
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+/*****************************************************************************
+ *
+ * Headers
+ *
+ */
+
+/* Feature test macros (MAP_ANONYMOUS) */
+#define _DEFAULT_SOURCE
+
+/* System headers */
+#include <stdlib.h>   /* malloc(), free()                 */
+#include <stdio.h>    /* printf(), sprintf(), perror()    */
+#include <assert.h>   /* assert()                         */
+#include <sys/mman.h> /* mmap(), munmap(), MAP_ANONYMOUS  */
+
+/* Project headers */
+#include <common.h>
+#include "bench.h"
+
+
+/*****************************************************************************
+ *
+ * Constants
+ *
+ */
+
+/* Number of clients receiving the messages */
+#define BACKENDS_READERS 16
+
+/* Number of broadcast messages (divided in quick mode) */
+#define BACKENDS_MESSAGES 2000
+
+/* Number of messages while system calls are counted (tracing is slow) */
+#define BACKENDS_TRACED 200
+
+/* Time given to the server to deliver a message, in seconds */
+#define BACKENDS_TIMEOUT 5.0
+
+
+/*****************************************************************************
+ *
+ * Data types
+ *
+ */
+
+/* Clients of a run */
+typedef struct room {
+    bench_client_t talker;                    /* Client sending messages */
+    bench_client_t readers[BACKENDS_READERS]; /* Clients reading them    */
+} room_t;
+
+
+/*****************************************************************************
+ *
+ * Local functions
+ *
+ */
+
+/*
+ * Connect all clients of a room (returns -1 on error).
+ */
+static int room_open(room_t *const room, const bench_server_t *const server)
+{
+    int  i;        /* Client index */
+    int  res;      /* Result       */
+    char nick[16]; /* Nickname     */
+
+    room->talker.sock = -1;
+    for (i = 0; i < BACKENDS_READERS; i++)
+	room->readers[i].sock = -1;
+
+    res = 0;
+    for (i = 0; i < BACKENDS_READERS && res == 0; i++) {
+	sprintf(nick, "reader%d", i);
+	res = bench_client_join(&room->readers[i], server, nick, 0,
+				BACKENDS_TIMEOUT);
+    }
+    return res == 0 ? bench_client_join(&room->talker, server, "talker", 0,
+					BACKENDS_TIMEOUT) : -1;
+}
+
+/*
+ * Disconnect all clients of a room.
+ */
+static void room_close(room_t *const room)
+{
+    int i; /* Client index */
+
+    bench_client_close(&room->talker);
+    for (i = 0; i < BACKENDS_READERS; i++)
+	bench_client_close(&room->readers[i]);
+}
+
+/*
+ * Broadcast messages one at a time and wait for every reader to receive
+ * each one.  Returns the number of delivered messages and, if times is not
+ * NULL, the time each one took.
+ */
+static int broadcast(room_t *const room, const int count,
+		     double *const times)
+{
+    int    i;        /* Message index  */
+    int    j;        /* Reader index   */
+    double start;    /* Sending time   */
+    char   line[32]; /* Sent message   */
+    char   text[48]; /* Expected text  */
+
+    for (i = 0; i < count; i++) {
+	sprintf(line, "message %d\n", i);
+	sprintf(text, "talker: message %d\n", i);
+
+	start = bench_time();
+	if (bench_client_send(&room->talker, line) != 0)
+	    return i;
+	for (j = 0; j < BACKENDS_READERS; j++)
+	    if (bench_client_expect(&room->readers[j], text,
+				    BACKENDS_TIMEOUT) != 0)
+		return i;
+	if (times != NULL)
+	    times[i] = bench_time() - start;
+    }
+
+    return count;
+}
+
+/*
+ * Run a session: launch the server (traced if syscalls is not NULL),
+ * connect the clients and broadcast messages.  Returns the number of
+ * delivered messages, or -1 if the server could not be launched.
+ */
+static int run_session(const bench_options_t *const options,
+		       const char *const *args, const int count,
+		       double *const times,
+		       volatile unsigned long *const syscalls)
+{
+    int            done;   /* Delivered messages       */
+    unsigned long  start;  /* System calls before them */
+    room_t         room;   /* Connected clients        */
+    bench_server_t server; /* Launched server          */
+
+    if ((syscalls == NULL ? bench_server_start(&server, options, args) :
+	 bench_server_start_traced(&server, options, args, syscalls)) != 0)
+	return -1;
+
+    /* Only system calls made while messages are broadcast are counted */
+    done = 0;
+    if (room_open(&room, &server) == 0) {
+	start = syscalls != NULL ? *syscalls : 0;
+	done = broadcast(&room, count, times);
+	if (syscalls != NULL)
+	    *syscalls -= start;
+    }
+    room_close(&room);
+
+    if (bench_server_stop(&server) != 0)
+	done = 0;
+    return done;
+}
+
+
+/*****************************************************************************
+ *
+ * Public functions
+ *
+ */
+
+/*
+ * Compare the system calls and the latency of broadcasts with each event
+ * backend of the server.
+ */
+int bench_backends(const bench_options_t *const options)
+{
+    int                     i;        /* Backend index           */
+    int                     count;    /* Number of messages      */
+    int                     res;      /* Result                  */
+    int                     traced;   /* Messages while traced   */
+    double                 *times;    /* Delivery times          */
+    char                    calls[16]; /* System calls per message */
+    volatile unsigned long *syscalls; /* Stops of the traced server */
+    bench_stats_t           stats;    /* Delivery statistics     */
+
+    /* Backends */
+    static const char *const backends[] = {"select", "epoll", "uring"};
+    const char *args[3] = {"-e", NULL, NULL};
+
+    assert(options != NULL);
+
+    count = options->quick ? BACKENDS_MESSAGES / 10 : BACKENDS_MESSAGES;
+    times = malloc(count * sizeof(double));
+    syscalls = mmap(NULL, sizeof(*syscalls), PROT_READ | PROT_WRITE,
+		    MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (times == NULL || syscalls == MAP_FAILED) {
+	perror("Error while allocating memory");
+	free(times);
+	if (syscalls != MAP_FAILED)
+	    munmap((void *) syscalls, sizeof(*syscalls));
+	return -1;
+    }
+
+    printf("  %d readers, %d messages (%d while system calls are "
+	   "counted)\n", BACKENDS_READERS, count, BACKENDS_TRACED);
+    printf("  %-7s %13s %10s %10s %10s\n", "backend", "syscalls/msg",
+	   "p50 (us)", "p99 (us)", "max (us)");
+
+    res = 0;
+    for (i = 0; i < (int) (sizeof(backends) / sizeof(backends[0])); i++) {
+	args[1] = backends[i];
+
+	/* System calls, if the server can be traced (stops come in pairs) */
+	*syscalls = 0;
+	traced = run_session(options, args, BACKENDS_TRACED, NULL, syscalls);
+	if (traced == BACKENDS_TRACED)
+	    sprintf(calls, "%.1f",
+		    *syscalls / 2.0 / BACKENDS_TRACED);
+	else
+	    sprintf(calls, "n/a");
+
+	/* Latency, without tracing */
+	if (run_session(options, args, count, times, NULL) != count) {
+	    printf("  %-7s messages were not delivered\n", backends[i]);
+	    res = -1;
+	    continue;
+	}
+	bench_get_stats(times, count, &stats);
+	printf("  %-7s %13s %10.0f %10.0f %10.0f\n", backends[i], calls,
+	       stats.p50 * 1e6, stats.p99 * 1e6, stats.max * 1e6);
+    }
+
+    munmap((void *) syscalls, sizeof(*syscalls));
+    free(times);
+    return res;
+}
+
+/* End of file */
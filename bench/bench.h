@@ -0,0 +1,139 @@
+/*
+ * ---------------------------------------------------------------------------
+ *
+ * Minitalk: a basic talk-like server/client
+ * Copyright (C) 2004 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: bench/bench.h
+ *
+ * Description: Benchmark Declarations
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+#ifndef BENCH_H
+#define BENCH_H
+
+/*
+ * Headers
+ */
+
+/* System headers */
+#include <sys/types.h> /* pid_t */
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+
+/*
+ * Constants
+ */
+
+/* Size of the data received by a client and not expected yet */
+#define BENCH_CLIENT_BUFFER 4096
+
+
+/*
+ * Data types
+ */
+
+/* Options shared by all benchmarks */
+typedef struct bench_options {
+    int         quick;  /* Run smaller workloads (to check results quickly) */
+    const char *server; /* Path to the server executable                    */
+} bench_options_t;
+
+/* Benchmark function (returns 0 on success, -1 if a check failed) */
+typedef int (*bench_func_t)(const bench_options_t *const options);
+
+/* Summary of a set of samples */
+typedef struct bench_stats {
+    double mean; /* Average value   */
+    double p50;  /* Median          */
+    double p99;  /* 99th percentile */
+    double max;  /* Maximum value   */
+} bench_stats_t;
+
+/* Server launched by a benchmark */
+typedef struct bench_server {
+    pid_t          pid;   /* Server process                 */
+    int            input; /* Pipe to its standard input     */
+    unsigned short port;  /* Port it listens to             */
+} bench_server_t;
+
+/* Client connected to the server */
+typedef struct bench_client {
+    int  sock;                      /* Socket descriptor         */
+    int  size;                      /* Size of data not expected */
+    char data[BENCH_CLIENT_BUFFER]; /* Received data             */
+} bench_client_t;
+
+
+/*
+ * Prototypes
+ */
+
+/* Measures */
+double bench_time(void);
+void   bench_get_stats(double *const samples, const int count,
+		       bench_stats_t *const stats);
+
+/* Server and clients */
+int  bench_server_start(bench_server_t *const server,
+			const bench_options_t *const options,
+			const char *const *args);
+int  bench_server_start_traced(bench_server_t *const server,
+			       const bench_options_t *const options,
+			       const char *const *args,
+			       volatile unsigned long *const syscalls);
+int  bench_server_stop(bench_server_t *const server);
+int  bench_client_open(bench_client_t *const client,
+		       const bench_server_t *const server, const int rcvbuf);
+int  bench_client_join(bench_client_t *const client,
+		       const bench_server_t *const server,
+		       const char *const nick, const int rcvbuf,
+		       const double timeout);
+void bench_client_close(bench_client_t *const client);
+int  bench_client_send(bench_client_t *const client, const char *const str);
+int  bench_client_expect(bench_client_t *const client,
+			 const char *const text, const double timeout);
+
+/* Benchmarks */
+int bench_buffers(const bench_options_t *const options);
+int bench_hashing(const bench_options_t *const options);
+int bench_rehash(const bench_options_t *const options);
+int bench_dispatch(const bench_options_t *const options);
+int bench_accept(const bench_options_t *const options);
+int bench_stall(const bench_options_t *const options);
+int bench_queues(const bench_options_t *const options);
+int bench_backends(const bench_options_t *const options);
+
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !BENCH_H */
+
+/* End of file */
@@ -0,0 +1,340 @@
+/*
+ * ---------------------------------------------------------------------------
+ *
+ * Minitalk: a basic talk-like server/client
+ * Copyright (C) 2004 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: bench/buffers.c
+ *
+ * Description: Dynamic Buffer Benchmark
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+/*****************************************************************************
+ *
+ * Headers
+ *
+ */
+
+/* Feature test macros (socketpair()) */
+#define _POSIX_C_SOURCE 200112L
+
+/* System headers */
+#include <stdlib.h> /* malloc(), free()     */
+#include <stdio.h>  /* printf(), perror()   */
+#include <unistd.h> /* close()              */
+#include <assert.h> /* assert()             */
+
+/* Network-related headers */
+#include <sys/socket.h> /* socketpair(), AF_UNIX, SOCK_STREAM */
+
+/* Project headers */
+#include <common.h>
+#include <dbuffer.h>
+#include "bench.h"
+
+
+/*****************************************************************************
+ *
+ * Constants
+ *
+ */
+
+/* Number of lines in the workload */
+#define BUFFERS_LINES 4096
+
+/* Maximum line length (separator included) */
+#define BUFFERS_LINE_MAX 200
+
+/* Number of lines written to the socket at once */
+#define BUFFERS_BATCH 64
+
+/* Size of the blocks taken in the put/get test */
+#define BUFFERS_BLOCK 4096
+
+/* Number of passes over the workload (divided in quick mode) */
+#define BUFFERS_ROUNDS 200
+
+
+/*****************************************************************************
+ *
+ * Data types
+ *
+ */
+
+/* Lines put in the buffers */
+typedef struct workload {
+    char *data;                   /* Lines, one after the other */
+    int   lengths[BUFFERS_LINES]; /* Line lengths               */
+    int   size;                   /* Total size of the lines    */
+} workload_t;
+
+/* Test run on each backend (returns the number of processed bytes) */
+typedef long (*test_func_t)(const dbuffer_backend_t backend,
+			    const workload_t *const workload,
+			    const int rounds);
+
+
+/*****************************************************************************
+ *
+ * Local functions
+ *
+ */
+
+/*
+ * Fill the workload with lines of pseudo-random lengths and letters.
+ */
+static int make_workload(workload_t *const workload)
+{
+    int      i;    /* Line index             */
+    int      j;    /* Character index        */
+    int      pos;  /* Position in data       */
+    unsigned rand; /* Pseudo-random sequence */
+
+    assert(workload != NULL);
+
+    if ((workload->data = malloc(BUFFERS_LINES * BUFFERS_LINE_MAX)) == NULL)
+	return -1;
+
+    rand = 12345;
+    pos = 0;
+    for (i = 0; i < BUFFERS_LINES; i++) {
+	rand = rand * 1103515245U + 12345U;
+	workload->lengths[i] = 8 + (rand >> 16) % (BUFFERS_LINE_MAX - 8);
+	for (j = 0; j < workload->lengths[i] - 1; j++)
+	    workload->data[pos++] = 'a' + (rand >> (j % 16)) % 26;
+	workload->data[pos++] = '\n';
+    }
+    workload->size = pos;
+    return 0;
+}
+
+/*
+ * Put the lines in a buffer (returns -1 on error).
+ */
+static int put_lines(dbuffer_t *const buffer,
+		     const workload_t *const workload, const int first,
+		     const int count)
+{
+    int i;   /* Line index       */
+    int pos; /* Position in data */
+
+    for (pos = 0, i = 0; i < first; i++)
+	pos += workload->lengths[i];
+    for (i = first; i < first + count; i++) {
+	if (dbuffer_put_data(buffer, workload->data + pos,
+			     workload->lengths[i]) != workload->lengths[i])
+	    return -1;
+	pos += workload->lengths[i];
+    }
+    return 0;
+}
+
+/*
+ * Put all lines and get them back in blocks.
+ */
+static long test_put_get(const dbuffer_backend_t backend,
+			 const workload_t *const workload, const int rounds)
+{
+    int       i;                    /* Round index           */
+    int       len;                  /* Size of got data      */
+    long      total;                /* Number of bytes moved */
+    char      block[BUFFERS_BLOCK]; /* Data got back         */
+    dbuffer_t buffer;               /* Tested buffer         */
+
+    dbuffer_init(&buffer, -1, NULL, '\n');
+    dbuffer_set_backend(&buffer, backend);
+
+    total = 0;
+    for (i = 0; i < rounds; i++) {
+	if (put_lines(&buffer, workload, 0, BUFFERS_LINES) != 0)
+	    break;
+	while ((len = dbuffer_get_data(&buffer, block, sizeof(block))) > 0)
+	    total += len;
+    }
+
+    dbuffer_free(&buffer);
+    return i == rounds ? total : -1;
+}
+
+/*
+ * Put all lines and take them back one at a time.
+ */
+static long test_lines(const dbuffer_backend_t backend,
+		       const workload_t *const workload, const int rounds)
+{
+    int       i;      /* Round index           */
+    long      total;  /* Number of bytes moved */
+    line_t   *line;   /* Viewed line           */
+    dbuffer_t buffer; /* Tested buffer         */
+
+    dbuffer_init(&buffer, -1, NULL, '\n');
+    dbuffer_set_backend(&buffer, backend);
+
+    total = 0;
+    for (i = 0; i < rounds; i++) {
+	if (put_lines(&buffer, workload, 0, BUFFERS_LINES) != 0)
+	    break;
+	while ((line = dbuffer_view_line(&buffer, 0)) != NULL)
+	    total += line->length;
+    }
+
+    dbuffer_free(&buffer);
+    return i == rounds ? total : -1;
+}
+
+/*
+ * Write lines in batches to a buffer and read them back with another one
+ * (returns the number of bytes read back or -1 on error).
+ */
+static long transfer_lines(dbuffer_t *const output, dbuffer_t *const input,
+			   const workload_t *const workload, const int rounds)
+{
+    int     i;     /* Round index             */
+    int     first; /* First line of the batch */
+    int     count; /* Lines left in the batch */
+    long    total; /* Number of bytes moved   */
+    line_t *line;  /* Viewed line             */
+
+    total = 0;
+    for (i = 0; i < rounds; i++)
+	for (first = 0; first < BUFFERS_LINES; first += BUFFERS_BATCH) {
+	    /* A batch fits in the socket: writing it does not block */
+	    if (put_lines(output, workload, first, BUFFERS_BATCH) != 0)
+		return -1;
+	    while (dbuffer_get_size(output) != 0)
+		if (dbuffer_write(output) < 0)
+		    return -1;
+
+	    for (count = BUFFERS_BATCH; count != 0; )
+		if ((line = dbuffer_view_line(input, 0)) != NULL) {
+		    total += line->length;
+		    count--;
+		} else if (dbuffer_read(input) <= 0)
+		    return -1;
+	}
+
+    dbuffer_release_line(input);
+    return total;
+}
+
+/*
+ * Write lines in batches to a socket and read them back from the other end.
+ */
+static long test_socket(const dbuffer_backend_t backend,
+			const workload_t *const workload, const int rounds)
+{
+    int       fds[2]; /* Socket pair              */
+    long      total;  /* Number of bytes moved    */
+    dbuffer_t output; /* Buffer writing the lines */
+    dbuffer_t input;  /* Buffer reading them back */
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+	perror("Error while creating sockets");
+	return -1;
+    }
+    dbuffer_init(&output, fds[0], NULL, '\n');
+    dbuffer_set_backend(&output, backend);
+    dbuffer_init(&input, fds[1], NULL, '\n');
+    dbuffer_set_backend(&input, backend);
+
+    total = transfer_lines(&output, &input, workload, rounds);
+
+    dbuffer_free(&output);
+    dbuffer_free(&input);
+    close(fds[0]);
+    close(fds[1]);
+    return total;
+}
+
+
+/*****************************************************************************
+ *
+ * Public functions
+ *
+ */
+
+/*
+ * Compare the list and ring backends of dynamic buffers.
+ */
+int bench_buffers(const bench_options_t *const options)
+{
+    int        i;        /* Test index              */
+    int        j;        /* Backend index           */
+    int        rounds;   /* Passes over the data    */
+    int        res;      /* Result                  */
+    long       total;    /* Number of moved bytes   */
+    double     start;    /* Start time              */
+    double     elapsed;  /* Test duration           */
+    workload_t workload; /* Lines put in buffers    */
+
+    /* Tests and backends */
+    static const struct {
+	const char *name;     /* Test name     */
+	test_func_t function; /* Test function */
+    } tests[] = {
+	{"put/get", test_put_get},
+	{"lines",   test_lines},
+	{"socket",  test_socket}
+    };
+    static const struct {
+	const char       *name;    /* Backend name */
+	dbuffer_backend_t backend; /* Backend      */
+    } backends[] = {
+	{"list", DBUFFER_BACKEND_LIST},
+	{"ring", DBUFFER_BACKEND_RING}
+    };
+
+    assert(options != NULL);
+
+    if (make_workload(&workload) != 0) {
+	perror("Error while allocating memory");
+	return -1;
+    }
+    rounds = options->quick ? BUFFERS_ROUNDS / 20 : BUFFERS_ROUNDS;
+
+    res = 0;
+    for (i = 0; i < (int) (sizeof(tests) / sizeof(tests[0])); i++)
+	for (j = 0; j < (int) (sizeof(backends) / sizeof(backends[0])); j++) {
+	    start = bench_time();
+	    total = tests[i].function(backends[j].backend, &workload, rounds);
+	    elapsed = bench_time() - start;
+
+	    /* Every byte put in must have come out */
+	    if (total != (long) workload.size * rounds) {
+		printf("  %-8s %-5s lost data (%ld bytes of %ld)\n",
+		       tests[i].name, backends[j].name, total,
+		       (long) workload.size * rounds);
+		res = -1;
+		continue;
+	    }
+	    printf("  %-8s %-5s %9.1f MB/s %11.0f lines/s\n", tests[i].name,
+		   backends[j].name, total / elapsed / 1e6,
+		   BUFFERS_LINES * (double) rounds / elapsed);
+	}
+
+    free(workload.data);
+    return res;
+}
+
+/* End of file */
@@ -0,0 +1,342 @@
+/*
+ * ---------------------------------------------------------------------------
+ *
+ * Minitalk: a basic talk-like server/client
+ * Copyright (C) 2004 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: bench/dispatch.c
+ *
+ * Description: Command Dispatch Benchmark
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+/*****************************************************************************
+ *
+ * Headers
+ *
+ */
+
+/* System headers */
+#include <stdio.h>  /* printf(), sscanf()                     */
+#include <string.h> /* strcmp(), strcpy(), strlen(), memcmp() */
+#include <assert.h> /* assert()                               */
+
+/* Project headers */
+#include <common.h>
+#include <iobuffer.h>
+#include <command.h>
+#include "bench.h"
+
+
+/*****************************************************************************
+ *
+ * Constants
+ *
+ */
+
+/* Number of dispatched lines (divided in quick mode) */
+#define DISPATCH_LINES 2000000
+
+/* Maximum length of a command line */
+#define DISPATCH_LINE_SIZE 64
+
+
+/*****************************************************************************
+ *
+ * Data types
+ *
+ */
+
+/* Counters of executed commands */
+typedef struct counters {
+    unsigned long executed; /* Commands executed   */
+    unsigned long args;     /* Arguments received  */
+} counters_t;
+
+
+/*****************************************************************************
+ *
+ * Command functions
+ *
+ */
+
+/*
+ * Count the command and its arguments.
+ */
+static int cmd_count(int arg_count, char **args UNUSED,
+		     iobuffer_t *const console UNUSED,
+		     iobuffer_t *const buffer UNUSED, counters_t *const data)
+{
+    data->executed++;
+    data->args += arg_count;
+    return 0;
+}
+
+
+/*****************************************************************************
+ *
+ * Command tables
+ *
+ */
+
+/* Commands sent by clients to the server (see server/srvcmd.c) */
+static const command_t client_commands[] = {
+    {"accept",   4, 0, "<nickname> <id1> <id2> <port>",
+                                          (command_func_t) cmd_count},
+    {"complete", 1, 0, "<prefix>",        (command_func_t) cmd_count},
+    {"connect",  1, 0, "<nickname>",      (command_func_t) cmd_count},
+    {"help",     0, 0, NULL,              (command_func_t) cmd_count},
+    {"quit",     0, 0, NULL,              (command_func_t) cmd_count},
+    {"receive",  4, 0, "<nickname> <id> <mode> <filename>",
+                                          (command_func_t) cmd_count},
+    {"refuse",   3, 0, "<nickname> <id> <reason>",
+                                          (command_func_t) cmd_count},
+    {"send",     4, 0, "<nickname> <id> <mode> <filename>",
+                                          (command_func_t) cmd_count},
+    {"who",      0, 2, "[prefix] [page]", (command_func_t) cmd_count}
+};
+
+/* Number of commands */
+#define COMMAND_COUNT ((int) (sizeof(client_commands) / sizeof(command_t)))
+
+/* Perfect hash of the table above */
+#include "dispatch.tab"
+
+/* Traffic of a file-sharing session: mostly transfer negotiations, with
+ * unknown commands and wrong argument counts (neither is executed) */
+static const struct {
+    const char *line;     /* Command line (without the leading `/') */
+    int         executed; /* If the command is executed             */
+} traffic[] = {
+    {"accept Dew Ne-Y2U3n4Lh+jxkF aMmqldYjb2WsQzpV 45678\n",  1},
+    {"receive Core Ne-Y2U3n4Lh+jxkF secure prj.tgz\n",        1},
+    {"accept Core Ne-Y2U3n4Lh+jxkF aMmqldYjb2WsQzpV 45679\n", 1},
+    {"receive Dew aMmqldYjb2WsQzpV fast notes.txt\n",         1},
+    {"send Dew Ne-Y2U3n4Lh+jxkF secure prj.tgz\n",            1},
+    {"refuse Core Ne-Y2U3n4Lh+jxkF busy\n",                   1},
+    {"who d 2\n",                                             1},
+    {"acept Dew Ne-Y2U3n4Lh+jxkF aMmqldYjb2WsQzpV 45678\n",   0},
+    {"receive Core Ne-Y2U3n4Lh+jxkF\n",                       0},
+    {"complete De\n",                                         1}
+};
+
+/* Number of traffic lines */
+#define TRAFFIC_COUNT ((int) (sizeof(traffic) / sizeof(traffic[0])))
+
+
+/*****************************************************************************
+ *
+ * Local variables
+ *
+ */
+
+/* Number of names found by the last lookups */
+static volatile long found_names;
+
+
+/*****************************************************************************
+ *
+ * Local functions
+ *
+ */
+
+/*
+ * Search a command with a binary search (as before the perfect hashes).
+ */
+static const command_t *find_bsearch(const char *const command)
+{
+    int start; /* First candidate */
+    int end;   /* Last candidate  */
+    int pos;   /* Compared entry  */
+    int cmp;   /* Comparison      */
+
+    start = 0;
+    end = COMMAND_COUNT - 1;
+    pos = end / 2;
+
+    while ((cmp = strcmp(command, client_commands[pos].name)) != 0 &&
+	   start < end) {
+	if (cmp < 0)
+	    end = pos - 1;
+	else
+	    start = pos + 1;
+	pos = (start + end) / 2;
+    }
+
+    return cmp == 0 ? client_commands + pos : NULL;
+}
+
+/*
+ * Search a command with the perfect hash (as command_find() in
+ * strlib/command.c, which is not exported).
+ */
+static const command_t *find_phash(const char *const command)
+{
+    int                   len;  /* Command length */
+    unsigned              key;  /* Hash key       */
+    const command_slot_t *slot; /* Hash slot      */
+
+    if ((len = strlen(command)) == 0)
+	return NULL;
+
+    key = (unsigned char) command[0] +
+	131 * (unsigned) (unsigned char) command[len / 2] +
+	17161 * (unsigned) (unsigned char) command[len - 1] + 7 * len;
+    slot = client_commands_table.slots +
+	(((key * client_commands_table.seed) >> 8) &
+	 client_commands_table.mask);
+
+    if (slot->index != -1 && slot->length == len &&
+	memcmp(command, client_commands[slot->index].name, len) == 0)
+	return client_commands + slot->index;
+    return NULL;
+}
+
+/*
+ * Execute a command line found with a binary search.
+ */
+static void exec_bsearch(char *const line, counters_t *const counters)
+{
+    int              arg_count;              /* Number of tokens */
+    const command_t *cmd;                    /* Found command    */
+    char            *args[COMMAND_MAX_ARGS]; /* Tokens           */
+
+    arg_count = command_get_tokens(line, args, COMMAND_MAX_ARGS);
+    if (arg_count > 0 && (cmd = find_bsearch(args[0])) != NULL &&
+	arg_count > cmd->arg_count &&
+	arg_count <= cmd->arg_count + cmd->opt_count + 1)
+	cmd->function(arg_count, args, NULL, NULL, counters);
+}
+
+/*
+ * Look the command names of the traffic up with one of the methods (returns
+ * the elapsed time, or -1 if the methods do not agree).
+ */
+static double run_lookups(const int method, const long count)
+{
+    int              i;                                  /* Traffic index */
+    long             j;                                  /* Lookup index  */
+    long             found;                              /* Found names   */
+    double           start;                              /* Start time    */
+    const command_t *cmd;                                /* Found command */
+    char             names[TRAFFIC_COUNT][DISPATCH_LINE_SIZE]; /* Names   */
+
+    for (i = 0; i < TRAFFIC_COUNT; i++) {
+	sscanf(traffic[i].line, "%63s", names[i]);
+	if (find_phash(names[i]) != find_bsearch(names[i]))
+	    return -1;
+    }
+
+    found = 0;
+    start = bench_time();
+    for (j = 0; j < count; j++) {
+	cmd = method == 0 ? find_bsearch(names[j % TRAFFIC_COUNT]) :
+	    find_phash(names[j % TRAFFIC_COUNT]);
+	found += cmd != NULL;
+    }
+    start = bench_time() - start;
+
+    /* Keep the lookups from being optimized out */
+    found_names = found;
+    return start;
+}
+
+/*
+ * Dispatch the traffic with one of the methods (returns the elapsed time).
+ */
+static double run_traffic(const int method, const long count,
+			  counters_t *const counters)
+{
+    long   i;                        /* Line index    */
+    double start;                    /* Start time    */
+    char   line[DISPATCH_LINE_SIZE]; /* Tokenized copy */
+
+    counters->executed = 0;
+    counters->args = 0;
+
+    start = bench_time();
+    for (i = 0; i < count; i++) {
+	strcpy(line, traffic[i % TRAFFIC_COUNT].line);
+	if (method == 0)
+	    exec_bsearch(line, counters);
+	else
+	    command_exec(line, &client_commands_table, NULL, NULL, counters);
+    }
+    return bench_time() - start;
+}
+
+
+/*****************************************************************************
+ *
+ * Public functions
+ *
+ */
+
+/*
+ * Compare the dispatch rate of the perfect hash and of a binary search.
+ */
+int bench_dispatch(const bench_options_t *const options)
+{
+    int           i;        /* Method index              */
+    int           res;      /* Result                    */
+    long          count;    /* Number of dispatched lines */
+    unsigned long expected; /* Number of executed ones    */
+    double        elapsed;  /* Dispatch duration          */
+    counters_t    counters; /* Executed commands          */
+
+    /* Dispatch methods */
+    static const char *const methods[] = {"binary search", "perfect hash"};
+
+    assert(options != NULL);
+
+    count = options->quick ? DISPATCH_LINES / 20 : DISPATCH_LINES;
+    for (expected = 0, i = 0; i < count; i++)
+	expected += traffic[i % TRAFFIC_COUNT].executed;
+
+    res = 0;
+    for (i = 0; i < 2; i++) {
+	/* Command lookup alone */
+	if ((elapsed = run_lookups(i, count)) < 0) {
+	    printf("  the perfect hash and the binary search disagree\n");
+	    return -1;
+	}
+	printf("  %-13s lookup   %11.0f names/s    %7.1f ns/name\n",
+	       methods[i], count / elapsed, elapsed * 1e9 / count);
+
+	/* Whole dispatch (tokens, lookup, argument count, call) */
+	elapsed = run_traffic(i, count, &counters);
+	printf("  %-13s dispatch %11.0f commands/s %7.1f ns/command\n",
+	       methods[i], count / elapsed, elapsed * 1e9 / count);
+
+	/* Both methods must execute the same commands */
+	if (counters.executed != expected) {
+	    printf("  %s executed %lu commands instead of %lu\n", methods[i],
+		   counters.executed, expected);
+	    res = -1;
+	}
+    }
+
+    return res;
+}
+
+/* End of file */
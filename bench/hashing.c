@@ -0,0 +1,422 @@
+/*
+ * ---------------------------------------------------------------------------
+ *
+ * Minitalk: a basic talk-like server/client
+ * Copyright (C) 2004 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: bench/hashing.c
+ *
+ * Description: Hash Function Distribution Benchmark
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+/*****************************************************************************
+ *
+ * Headers
+ *
+ */
+
+/* System headers */
+#include <stdlib.h> /* malloc(), calloc(), free(), qsort() */
+#include <stdio.h>  /* printf(), sprintf(), perror()       */
+#include <string.h> /* strcpy(), memmove()                 */
+#include <assert.h> /* assert()                            */
+
+/* Project headers */
+#include <common.h>
+#include <hash.h>
+#include "bench.h"
+
+
+/*****************************************************************************
+ *
+ * Constants
+ *
+ */
+
+/* Maximum nickname length (terminating NUL included) */
+#define HASHING_NICK_SIZE 32
+
+/* Number of nicknames of the sequential corpus (divided in quick mode) */
+#define HASHING_SEQUENTIAL 65536
+
+/* Highest probes per lookup accepted from the current function */
+#define HASHING_MAX_PROBES 2.0
+
+/* Left-rotate a number of given length by a specified offset (as in the
+ * original hash function) */
+#define ROT_LEFT(x, offset, bits) \
+    (((offset) % (bits)) == 0 ? ((x) & ((1 << (bits)) - 1)) : (((x) << \
+    ((offset) % (bits))) & ((1 << (bits)) - 1)) | (((x) & ((1 << (bits)) - \
+    1)) >> ((bits) - ((offset) % (bits)))))
+
+
+/*****************************************************************************
+ *
+ * Data types
+ *
+ */
+
+/* Set of nicknames */
+typedef struct corpus {
+    char (*nicks)[HASHING_NICK_SIZE]; /* Nicknames            */
+    int    count;                     /* Number of nicknames  */
+} corpus_t;
+
+/* Distribution of keys in a table */
+typedef struct distribution {
+    int    distinct; /* Number of distinct full keys           */
+    int    max;      /* Most elements sharing a slot           */
+    double probes;   /* Average slots examined by a lookup     */
+} distribution_t;
+
+
+/*****************************************************************************
+ *
+ * Local functions
+ *
+ */
+
+/*
+ * Original hash function: length modulo 4 and sum of rotated characters.
+ */
+static unsigned hash_legacy(const char *const str)
+{
+    int      i;   /* Character index        */
+    unsigned chr; /* Current character      */
+    unsigned sum; /* Sum of rotated letters */
+
+    sum = 0;
+    for (i = 0; (chr = (unsigned char) str[i]) != '\0'; i++)
+	sum += ROT_LEFT(chr, i, 8);
+
+    return ((i & 3) << 8) | (sum & 0xFF);
+}
+
+/*
+ * FNV-1a hash function, one byte at a time.
+ */
+static unsigned hash_fnv1a(const char *const str)
+{
+    int      i;   /* Character index */
+    unsigned key; /* Hash key        */
+
+    key = 2166136261U;
+    for (i = 0; str[i] != '\0'; i++)
+	key = (key ^ (unsigned char) str[i]) * 16777619U;
+    return key;
+}
+
+/*
+ * Allocate a corpus of count nicknames.
+ */
+static int corpus_init(corpus_t *const corpus, const int count)
+{
+    corpus->count = 0;
+    return (corpus->nicks = malloc(count * HASHING_NICK_SIZE)) == NULL ?
+	-1 : 0;
+}
+
+/*
+ * Nicknames made of a common prefix and a sequence number.
+ */
+static int make_sequential(corpus_t *const corpus, const int count)
+{
+    int i; /* Nickname index */
+
+    if (corpus_init(corpus, count) != 0)
+	return -1;
+    for (i = 0; i < count; i++)
+	sprintf(corpus->nicks[corpus->count++], "user%d", i);
+    return 0;
+}
+
+/*
+ * Nicknames made of first names, with various cases, separators and
+ * numbers.
+ */
+static int make_names(corpus_t *const corpus)
+{
+    int  i;                       /* Name index       */
+    int  j;                       /* Variant index    */
+    int  num;                     /* Appended number  */
+    char name[HASHING_NICK_SIZE]; /* Capitalized name */
+
+    /* First names */
+    static const char *const names[] = {
+	"alice", "bob", "carol", "dave", "eve", "frank", "grace", "heidi",
+	"ivan", "judy", "mallory", "oscar", "peggy", "trent", "victor",
+	"walter", "anna", "boris", "chloe", "dimitri", "elena", "fatima",
+	"gustavo", "hana", "igor", "jun", "karim", "lena", "marco", "nina",
+	"olga", "pierre"
+    };
+    static const char *const formats[] = {
+	"%s%d", "%s_%d", "%s%03d", "%s.%d"
+    };
+
+    if (corpus_init(corpus, 32 * (1 + 2 * 4 * 100)) != 0)
+	return -1;
+
+    for (i = 0; i < 32; i++) {
+	strcpy(name, names[i]);
+	name[0] += 'A' - 'a';
+	strcpy(corpus->nicks[corpus->count++], names[i]);
+	for (j = 0; j < 4; j++)
+	    for (num = 0; num < 100; num++) {
+		sprintf(corpus->nicks[corpus->count++], formats[j], names[i],
+			num);
+		sprintf(corpus->nicks[corpus->count++], formats[j], name,
+			num);
+	    }
+    }
+    return 0;
+}
+
+/*
+ * All permutations of the letters of a nickname.
+ */
+static int make_anagrams(corpus_t *const corpus)
+{
+    int  i;                       /* Permutation index      */
+    int  j;                       /* Letter index           */
+    int  rest;                    /* Remaining choice       */
+    int  left;                    /* Letters left to place  */
+    char letters[8];              /* Letters not placed yet */
+    char *nick;                   /* Built nickname         */
+
+    if (corpus_init(corpus, 5040) != 0)
+	return -1;
+
+    /* Decode each permutation index (factorial number system) */
+    for (i = 0; i < 5040; i++) {
+	strcpy(letters, "minatlk");
+	nick = corpus->nicks[corpus->count++];
+	for (rest = i, left = 7, j = 0; left > 0; j++, left--) {
+	    nick[j] = letters[rest % left];
+	    memmove(letters + rest % left, letters + rest % left + 1,
+		    left - rest % left);
+	    rest /= left;
+	}
+	nick[j] = '\0';
+    }
+    return 0;
+}
+
+/*
+ * Nicknames crafted to collide with the original function: characters eight
+ * positions apart are rotated alike, so exchanging them keeps the sum.
+ */
+static int make_crafted(corpus_t *const corpus)
+{
+    int   i;    /* Nickname index      */
+    int   j;    /* Position in a group */
+    int   k;    /* Character of group  */
+    int   perm; /* Permutation index   */
+    char *nick; /* Built nickname      */
+
+    /* Permutations of the three characters of a group */
+    static const int perms[4][3] = {
+	{0, 1, 2}, {1, 0, 2}, {2, 1, 0}, {0, 2, 1}
+    };
+    static const char base[] = "abcdefghijklmnopqrstuvwx";
+
+    if (corpus_init(corpus, 65536) != 0)
+	return -1;
+
+    /* Characters j, j + 8 and j + 16 of the base are permuted */
+    for (i = 0; i < 65536; i++) {
+	nick = corpus->nicks[corpus->count++];
+	for (j = 0; j < 8; j++) {
+	    perm = (i >> (2 * j)) & 3;
+	    for (k = 0; k < 3; k++)
+		nick[j + 8 * k] = base[j + 8 * perms[perm][k]];
+	}
+	nick[24] = '\0';
+    }
+    return 0;
+}
+
+/*
+ * Compare two keys (for qsort()).
+ */
+static int compare_keys(const void *const a, const void *const b)
+{
+    const unsigned x = *(const unsigned *) a; /* First key  */
+    const unsigned y = *(const unsigned *) b; /* Second key */
+
+    return x < y ? -1 : x > y;
+}
+
+/*
+ * Compute the distribution of keys among the slots of a table twice as
+ * large as their number (keys are sorted in place).
+ */
+static int get_distribution(unsigned *const keys, const int count,
+			    distribution_t *const distribution)
+{
+    int      i;     /* Key index                     */
+    unsigned mask;  /* Number of slots - 1           */
+    int     *loads; /* Number of elements per slot   */
+    double   sum;   /* Total slots examined          */
+
+    for (mask = 1; mask < (unsigned) count * 2; mask <<= 1);
+    mask--;
+    if ((loads = calloc(mask + 1, sizeof(int))) == NULL)
+	return -1;
+
+    /* Elements sharing a slot are examined one after the other */
+    distribution->max = 0;
+    sum = 0;
+    for (i = 0; i < count; i++) {
+	sum += ++loads[keys[i] & mask];
+	if (loads[keys[i] & mask] > distribution->max)
+	    distribution->max = loads[keys[i] & mask];
+    }
+    distribution->probes = sum / count;
+
+    qsort(keys, count, sizeof(unsigned), compare_keys);
+    distribution->distinct = count != 0;
+    for (i = 1; i < count; i++)
+	distribution->distinct += keys[i] != keys[i - 1];
+
+    free(loads);
+    return 0;
+}
+
+/*
+ * Get the keys given by the current hash function (returns -1 on error).
+ */
+static int get_current_keys(const corpus_t *const corpus,
+			    unsigned *const keys)
+{
+    int             i;       /* Nickname index */
+    hash_t          hash;    /* Hash table     */
+    hash_element_t *element; /* Added element  */
+
+    hash_init(&hash);
+    for (i = 0; i < corpus->count; i++) {
+	if ((element = hash_add(&hash, corpus->nicks[i], NULL, NULL)) == NULL)
+	    break;
+	keys[i] = element->key;
+    }
+    hash_free(&hash);
+
+    return i == corpus->count ? 0 : -1;
+}
+
+
+/*****************************************************************************
+ *
+ * Public functions
+ *
+ */
+
+/*
+ * Compare how hash functions spread realistic and hostile nicknames.
+ */
+int bench_hashing(const bench_options_t *const options)
+{
+    int            i;            /* Corpus index            */
+    int            j;            /* Function index          */
+    int            k;            /* Nickname index          */
+    int            res;          /* Result                  */
+    unsigned      *keys;         /* Keys of the nicknames   */
+    corpus_t       corpus;       /* Current corpus          */
+    distribution_t distribution; /* Distribution of keys    */
+
+    /* Corpora and functions */
+    static const char *const corpora[] = {
+	"sequential", "names", "anagrams", "crafted"
+    };
+    static const char *const functions[] = {
+	"original", "fnv-1a", "current"
+    };
+
+    assert(options != NULL);
+
+    hash_randomize();
+    printf("  %-10s %-8s %7s %8s %7s %9s\n", "corpus", "function", "nicks",
+	   "distinct", "max", "probes");
+
+    res = 0;
+    for (i = 0; i < 4 && res == 0; i++) {
+	/* Build the corpus */
+	switch (i) {
+	case 0:
+	    res = make_sequential(&corpus, options->quick ?
+				  HASHING_SEQUENTIAL / 16 :
+				  HASHING_SEQUENTIAL);
+	    break;
+	case 1:
+	    res = make_names(&corpus);
+	    break;
+	case 2:
+	    res = make_anagrams(&corpus);
+	    break;
+	default:
+	    res = make_crafted(&corpus);
+	    break;
+	}
+	if (res != 0 ||
+	    (keys = malloc(corpus.count * sizeof(unsigned))) == NULL) {
+	    perror("Error while allocating memory");
+	    free(corpus.nicks);
+	    return -1;
+	}
+
+	for (j = 0; j < 3 && res == 0; j++) {
+	    /* Hash the corpus */
+	    if (j == 2)
+		res = get_current_keys(&corpus, keys);
+	    else
+		for (k = 0; k < corpus.count; k++)
+		    keys[k] = j == 0 ? hash_legacy(corpus.nicks[k]) :
+			hash_fnv1a(corpus.nicks[k]);
+	    if (res != 0 ||
+		get_distribution(keys, corpus.count, &distribution) != 0) {
+		perror("Error while allocating memory");
+		res = -1;
+		break;
+	    }
+
+	    printf("  %-10s %-8s %7d %8d %7d %9.2f\n", corpora[i],
+		   functions[j], corpus.count, distribution.distinct,
+		   distribution.max, distribution.probes);
+
+	    /* The current function must spread every corpus */
+	    if (j == 2 && distribution.probes > HASHING_MAX_PROBES) {
+		printf("  %s: %.2f probes per lookup (at most %.2f "
+		       "expected)\n", corpora[i], distribution.probes,
+		       HASHING_MAX_PROBES);
+		res = -1;
+	    }
+	}
+
+	free(keys);
+	free(corpus.nicks);
+    }
+
+    return res;
+}
+
+/* End of file */
@@ -0,0 +1,252 @@
+/*
+ * ---------------------------------------------------------------------------
+ *
+ * Minitalk: a basic talk-like server/client
+ * Copyright (C) 2004 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: bench/main.c
+ *
+ * Description: Benchmarks Main File
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+/*****************************************************************************
+ *
+ * Headers
+ *
+ */
+
+/* Feature test macros (getopt()) */
+#define _POSIX_C_SOURCE 200112L
+
+/* System headers */
+#include <stdlib.h> /* malloc(), free()                */
+#include <stdio.h>  /* printf(), fprintf(), stderr     */
+#include <string.h> /* strcmp(), strrchr(), memcpy()   */
+#include <signal.h> /* signal(), SIGPIPE, SIG_IGN      */
+#include <unistd.h> /* getopt()                        */
+
+/* Project headers */
+#include <common.h>
+#include "bench.h"
+
+
+/*****************************************************************************
+ *
+ * Constants
+ *
+ */
+
+/* Server executable, relative to the directory of mtbench */
+#define SERVER_PATH "../server/mtserver"
+
+
+/*****************************************************************************
+ *
+ * Data types
+ *
+ */
+
+/* Benchmark description */
+typedef struct benchmark {
+    const char  *name;        /* Name given on the command line */
+    bench_func_t function;    /* Benchmark function             */
+    const char  *description; /* What is measured               */
+} benchmark_t;
+
+
+/*****************************************************************************
+ *
+ * Constants
+ *
+ */
+
+/* Available benchmarks, run in this order */
+static const benchmark_t benchmarks[] = {
+    {"buffers", bench_buffers,
+     "put/get, line and socket throughput of list and ring buffers"},
+    {"hashing", bench_hashing,
+     "spread of nicknames by the original, FNV-1a and current hashes"},
+    {"rehash", bench_rehash,
+     "latency of hash operations during a ramp of connections"},
+    {"dispatch", bench_dispatch,
+     "rate of client commands dispatched by perfect hash or bsearch"},
+    {"accept", bench_accept,
+     "connections accepted and answered per second by the server"},
+    {"stall", bench_stall,
+     "delivery to active clients while others never read"},
+    {"queues", bench_queues,
+     "throughput and latency of the queues between workers"},
+    {"backends", bench_backends,
+     "system calls and latency of broadcasts with each event backend"}
+};
+
+/* Number of benchmarks */
+#define BENCHMARK_COUNT ((int) (sizeof(benchmarks) / sizeof(benchmark_t)))
+
+
+/*****************************************************************************
+ *
+ * Private functions
+ *
+ */
+
+/*
+ * Print the command line syntax and the available benchmarks.
+ */
+static void write_usage(const char *const name)
+{
+    int i; /* Benchmark index */
+
+    fprintf(stderr, "Usage: %s [-q] [-s server] [benchmark...] (default "
+	    "all)\n"
+	    "  -q: run smaller workloads\n"
+	    "  -s server: server executable (default %s next to %s)\n"
+	    "Benchmarks:\n", name, SERVER_PATH, name);
+    for (i = 0; i < BENCHMARK_COUNT; i++)
+	fprintf(stderr, "  %-10s %s\n", benchmarks[i].name,
+		benchmarks[i].description);
+}
+
+/*
+ * Get the path of the server executable next to the benchmark directory
+ * (the result must be freed).
+ */
+static char *get_server_path(const char *const name)
+{
+    int         len;   /* Length of the directory */
+    char       *path;  /* Server path             */
+    const char *slash; /* End of the directory    */
+
+    len = (slash = strrchr(name, '/')) != NULL ? slash - name + 1 : 0;
+    if ((path = malloc(len + sizeof(SERVER_PATH))) == NULL)
+	return NULL;
+
+    memcpy(path, name, len);
+    memcpy(path + len, SERVER_PATH, sizeof(SERVER_PATH));
+    return path;
+}
+
+/*
+ * Find a benchmark by name (returns NULL if there is none).
+ */
+static const benchmark_t *find_benchmark(const char *const name)
+{
+    int i; /* Benchmark index */
+
+    for (i = 0; i < BENCHMARK_COUNT; i++)
+	if (strcmp(benchmarks[i].name, name) == 0)
+	    return &benchmarks[i];
+    return NULL;
+}
+
+/*
+ * Run a benchmark (returns 0 on success).
+ */
+static int run_benchmark(const benchmark_t *const benchmark,
+			 const bench_options_t *const options)
+{
+    int res; /* Benchmark result */
+
+    printf("== %s: %s\n", benchmark->name, benchmark->description);
+    fflush(stdout);
+    if ((res = benchmark->function(options)) != 0)
+	printf("** %s: FAILED\n", benchmark->name);
+    printf("\n");
+    fflush(stdout);
+    return res;
+}
+
+
+/*****************************************************************************
+ *
+ * Public functions
+ *
+ */
+
+/*
+ * Main function.
+ */
+int main(int argc, char *argv[])
+{
+    int                opt;       /* Command line option    */
+    int                i;         /* Argument index         */
+    int                failed;    /* Number of failed runs  */
+    char              *path;      /* Default server path    */
+    bench_options_t    options;   /* Benchmark options      */
+    const benchmark_t *benchmark; /* Benchmark to run       */
+
+    /* Parse options */
+    options.quick = 0;
+    options.server = NULL;
+    while ((opt = getopt(argc, argv, "qs:")) != -1)
+	switch (opt) {
+	case 'q':
+	    options.quick = 1;
+	    break;
+
+	case 's':
+	    options.server = optarg;
+	    break;
+
+	default:
+	    write_usage(argv[0]);
+	    return 1;
+	}
+
+    /* Check benchmark names before running anything */
+    for (i = optind; i < argc; i++)
+	if (find_benchmark(argv[i]) == NULL) {
+	    write_usage(argv[0]);
+	    return 1;
+	}
+
+    /* The server is next to the benchmarks by default */
+    path = NULL;
+    if (options.server == NULL) {
+	if ((path = get_server_path(argv[0])) == NULL) {
+	    perror("Error while allocating memory");
+	    return 1;
+	}
+	options.server = path;
+    }
+
+    /* Closed connections must not kill the benchmarks */
+    signal(SIGPIPE, SIG_IGN);
+
+    /* Run the given benchmarks, or all of them */
+    failed = 0;
+    if (optind == argc)
+	for (i = 0; i < BENCHMARK_COUNT; i++)
+	    failed += run_benchmark(&benchmarks[i], &options) != 0;
+    else
+	for (i = optind; i < argc; i++) {
+	    benchmark = find_benchmark(argv[i]);
+	    failed += run_benchmark(benchmark, &options) != 0;
+	}
+
+    free(path);
+    return failed != 0;
+}
+
+/* End of file */
@@ -0,0 +1,357 @@
+/*
+ * ---------------------------------------------------------------------------
+ *
+ * Minitalk: a basic talk-like server/client
+ * Copyright (C) 2004 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: bench/queues.c
+ *
+ * Description: Worker Queue Benchmark
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+/*****************************************************************************
+ *
+ * Headers
+ *
+ */
+
+/* Feature test macros (sched_yield()) */
+#define _POSIX_C_SOURCE 200112L
+
+/* System headers */
+#include <stdlib.h>  /* malloc(), free()                  */
+#include <stdio.h>   /* printf(), perror()                */
+#include <stdint.h>  /* uintptr_t                         */
+#include <sched.h>   /* sched_yield()                     */
+#include <assert.h>  /* assert()                          */
+#include <pthread.h> /* pthread_create(), pthread_mutex_t */
+
+/* Project headers */
+#include <common.h>
+#include <queue.h>
+#include "bench.h"
+
+
+/*****************************************************************************
+ *
+ * Constants
+ *
+ */
+
+/* Capacity of the queues (as between workers) */
+#define QUEUES_CAPACITY 4096
+
+/* Number of items published or popped at once (as by workers) */
+#define QUEUES_BATCH 64
+
+/* Number of items sent from a thread to the other (divided in quick mode) */
+#define QUEUES_ITEMS 4000000
+
+/* Number of round trips (divided in quick mode) */
+#define QUEUES_PINGS 20000
+
+
+/*****************************************************************************
+ *
+ * Data types
+ *
+ */
+
+/* How items are passed */
+typedef enum method {
+    METHOD_MUTEX,  /* Ring protected by a mutex            */
+    METHOD_SINGLE, /* Queue, each item published by itself */
+    METHOD_BATCH   /* Queue, items published by batches    */
+} method_t;
+
+/* Ring protected by a mutex (the usual alternative) */
+typedef struct locked {
+    pthread_mutex_t mutex; /* Mutex protecting the ring      */
+    void          **items; /* Ring of items                  */
+    unsigned        mask;  /* Capacity minus one             */
+    unsigned        head;  /* Index of the next item to pop  */
+    unsigned        tail;  /* Index of the next item to push */
+} locked_t;
+
+/* Items passed from a thread to the other */
+typedef struct transfer {
+    method_t method;  /* How items are passed            */
+    long     count;   /* Number of items                 */
+    int      ordered; /* If items were received in order */
+    queue_t  queue;   /* Lock-free queue                 */
+    locked_t locked;  /* Ring protected by a mutex       */
+} transfer_t;
+
+/* Round trips between two threads */
+typedef struct pingpong {
+    long    count; /* Number of round trips    */
+    queue_t ping;  /* Items sent to the thread */
+    queue_t pong;  /* Items sent back          */
+} pingpong_t;
+
+
+/*****************************************************************************
+ *
+ * Local functions
+ *
+ */
+
+/*
+ * Append an item to a ring protected by a mutex (returns -1 if it is full).
+ */
+static int locked_push(locked_t *const locked, void *const item)
+{
+    int res; /* Result */
+
+    pthread_mutex_lock(&locked->mutex);
+    if ((res = locked->tail - locked->head > locked->mask ? -1 : 0) == 0)
+	locked->items[locked->tail++ & locked->mask] = item;
+    pthread_mutex_unlock(&locked->mutex);
+    return res;
+}
+
+/*
+ * Remove up to count items from a ring protected by a mutex.
+ */
+static int locked_pop_batch(locked_t *const locked, void **const items,
+			    const int count)
+{
+    int i; /* Item counter */
+
+    pthread_mutex_lock(&locked->mutex);
+    for (i = 0; i < count && locked->head != locked->tail; i++)
+	items[i] = locked->items[locked->head++ & locked->mask];
+    pthread_mutex_unlock(&locked->mutex);
+    return i;
+}
+
+/*
+ * Receive the items and check their order (consumer thread).
+ */
+static void *consume(void *const arg)
+{
+    int         i;                   /* Item index     */
+    int         count;               /* Popped items   */
+    uintptr_t   expected;            /* Next item      */
+    transfer_t *transfer;            /* Transfer       */
+    void       *items[QUEUES_BATCH]; /* Popped items   */
+
+    transfer = arg;
+    for (expected = 1; expected <= (uintptr_t) transfer->count; ) {
+	count = transfer->method == METHOD_MUTEX ?
+	    locked_pop_batch(&transfer->locked, items, QUEUES_BATCH) :
+	    queue_pop_batch(&transfer->queue, items, QUEUES_BATCH);
+	if (count == 0)
+	    sched_yield();
+	for (i = 0; i < count; i++)
+	    if ((uintptr_t) items[i] != expected++)
+		transfer->ordered = 0;
+    }
+
+    return NULL;
+}
+
+/*
+ * Send the items (producer thread).
+ */
+static void produce(transfer_t *const transfer)
+{
+    long  i;    /* Item index */
+    void *item; /* Sent item  */
+
+    for (i = 1; i <= transfer->count; i++) {
+	item = (void *) (uintptr_t) i;
+	if (transfer->method == METHOD_MUTEX)
+	    while (locked_push(&transfer->locked, item) != 0)
+		sched_yield();
+	else {
+	    /* Publish what is pending so that the consumer makes room */
+	    while (queue_push(&transfer->queue, item) != 0) {
+		queue_publish(&transfer->queue);
+		sched_yield();
+	    }
+	    if (transfer->method == METHOD_SINGLE || i % QUEUES_BATCH == 0)
+		queue_publish(&transfer->queue);
+	}
+    }
+    queue_publish(&transfer->queue);
+}
+
+/*
+ * Pass items from a thread to another (returns the elapsed time, or -1 on
+ * error or if items were not received in order).
+ */
+static double run_transfer(const method_t method, const long count)
+{
+    double     start;    /* Start time        */
+    pthread_t  thread;   /* Consumer thread   */
+    transfer_t transfer; /* Transfer          */
+
+    transfer.method = method;
+    transfer.count = count;
+    transfer.ordered = 1;
+    transfer.locked.mask = QUEUES_CAPACITY - 1;
+    transfer.locked.head = 0;
+    transfer.locked.tail = 0;
+    if ((transfer.locked.items = malloc(QUEUES_CAPACITY * sizeof(void *)))
+	== NULL)
+	return -1;
+    if (queue_init(&transfer.queue, QUEUES_CAPACITY) != 0) {
+	free(transfer.locked.items);
+	return -1;
+    }
+    pthread_mutex_init(&transfer.locked.mutex, NULL);
+
+    start = bench_time();
+    if (pthread_create(&thread, NULL, consume, &transfer) != 0)
+	transfer.ordered = 0;
+    else {
+	produce(&transfer);
+	pthread_join(thread, NULL);
+    }
+    start = bench_time() - start;
+
+    pthread_mutex_destroy(&transfer.locked.mutex);
+    queue_free(&transfer.queue);
+    free(transfer.locked.items);
+    return transfer.ordered ? start : -1;
+}
+
+/*
+ * Send each item back (echo thread).
+ */
+static void *echo(void *const arg)
+{
+    long        i;        /* Round trip index */
+    void       *item;     /* Received item    */
+    pingpong_t *pingpong; /* Round trips      */
+
+    pingpong = arg;
+    for (i = 0; i < pingpong->count; i++) {
+	while ((item = queue_pop(&pingpong->ping)) == NULL)
+	    sched_yield();
+	queue_push(&pingpong->pong, item);
+	queue_publish(&pingpong->pong);
+    }
+
+    return NULL;
+}
+
+/*
+ * Measure round trips of single items between two threads (returns -1 on
+ * error).
+ */
+static int run_pingpong(const long count, double *const times)
+{
+    long       i;        /* Round trip index */
+    int        res;      /* Result           */
+    double     start;    /* Sending time     */
+    void      *item;     /* Item sent back   */
+    pthread_t  thread;   /* Echo thread      */
+    pingpong_t pingpong; /* Round trips      */
+
+    pingpong.count = count;
+    if (queue_init(&pingpong.ping, QUEUES_CAPACITY) != 0)
+	return -1;
+    if (queue_init(&pingpong.pong, QUEUES_CAPACITY) != 0) {
+	queue_free(&pingpong.ping);
+	return -1;
+    }
+
+    res = -1;
+    if (pthread_create(&thread, NULL, echo, &pingpong) == 0) {
+	res = 0;
+	for (i = 0; i < count; i++) {
+	    start = bench_time();
+	    queue_push(&pingpong.ping, (void *) (uintptr_t) (i + 1));
+	    queue_publish(&pingpong.ping);
+	    while ((item = queue_pop(&pingpong.pong)) == NULL)
+		sched_yield();
+	    times[i] = bench_time() - start;
+	    if (item != (void *) (uintptr_t) (i + 1))
+		res = -1;
+	}
+	pthread_join(thread, NULL);
+    }
+
+    queue_free(&pingpong.ping);
+    queue_free(&pingpong.pong);
+    return res;
+}
+
+
+/*****************************************************************************
+ *
+ * Public functions
+ *
+ */
+
+/*
+ * Measure the throughput and latency of the queues between workers.
+ */
+int bench_queues(const bench_options_t *const options)
+{
+    int           i;       /* Method index       */
+    long          count;   /* Number of items    */
+    double        elapsed; /* Transfer duration  */
+    double       *times;   /* Round trip times   */
+    bench_stats_t stats;   /* Round trip summary */
+
+    /* Methods */
+    static const char *const methods[] = {
+	"mutex", "queue (publish each)", "queue (publish by 64)"
+    };
+
+    assert(options != NULL);
+
+    /* Throughput */
+    count = options->quick ? QUEUES_ITEMS / 20 : QUEUES_ITEMS;
+    for (i = METHOD_MUTEX; i <= METHOD_BATCH; i++) {
+	if ((elapsed = run_transfer((method_t) i, count)) < 0) {
+	    printf("  %-21s items lost or out of order\n", methods[i]);
+	    return -1;
+	}
+	printf("  %-21s %11.0f items/s\n", methods[i], count / elapsed);
+    }
+
+    /* Latency */
+    count = options->quick ? QUEUES_PINGS / 10 : QUEUES_PINGS;
+    if ((times = malloc(count * sizeof(double))) == NULL) {
+	perror("Error while allocating memory");
+	return -1;
+    }
+    if (run_pingpong(count, times) != 0) {
+	printf("  round trips failed\n");
+	free(times);
+	return -1;
+    }
+    bench_get_stats(times, count, &stats);
+    printf("  round trip (us): p50 %.1f, p99 %.1f, max %.1f\n",
+	   stats.p50 * 1e6, stats.p99 * 1e6, stats.max * 1e6);
+
+    free(times);
+    return 0;
+}
+
+/* End of file */
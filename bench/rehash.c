@@ -0,0 +1,243 @@
+/*
+ * ---------------------------------------------------------------------------
+ *
+ * Minitalk: a basic talk-like server/client
+ * Copyright (C) 2004 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: bench/rehash.c
+ *
+ * Description: Hash Operation Latency Benchmark
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+/*****************************************************************************
+ *
+ * Headers
+ *
+ */
+
+/* System headers */
+#include <stdlib.h> /* malloc(), free()    */
+#include <stdio.h>  /* printf(), sprintf() */
+#include <assert.h> /* assert()            */
+
+/* Project headers */
+#include <common.h>
+#include <hash.h>
+#include "bench.h"
+
+
+/*****************************************************************************
+ *
+ * Constants
+ *
+ */
+
+/* Maximum nickname length (terminating NUL included) */
+#define REHASH_NICK_SIZE 16
+
+/* Number of connections of the ramp (divided in quick mode) */
+#define REHASH_CONNECTIONS 100000
+
+/* The 99th percentile of connections must be this many times shorter than
+ * rebuilding the whole table (the cost of a stop-the-world rehash) */
+#define REHASH_MIN_RATIO 10
+
+
+/*****************************************************************************
+ *
+ * Data types
+ *
+ */
+
+/* Samples of the ramp */
+typedef struct ramp {
+    char          (*nicks)[REHASH_NICK_SIZE]; /* Nicknames               */
+    hash_element_t **elements;                /* Added elements          */
+    double          *connect;                 /* Failed lookup, then add */
+    double          *find;                    /* Successful lookup       */
+    double          *remove;                  /* Removal                 */
+    int              count;                   /* Number of connections   */
+} ramp_t;
+
+
+/*****************************************************************************
+ *
+ * Local functions
+ *
+ */
+
+/*
+ * Allocate the samples of a ramp of count connections.
+ */
+static int ramp_init(ramp_t *const ramp, const int count)
+{
+    int i; /* Nickname index */
+
+    ramp->count = count;
+    ramp->nicks = malloc(count * REHASH_NICK_SIZE);
+    ramp->elements = malloc(count * sizeof(hash_element_t *));
+    ramp->connect = malloc(count * sizeof(double));
+    ramp->find = malloc(count * sizeof(double));
+    ramp->remove = malloc(count * sizeof(double));
+    if (ramp->nicks == NULL || ramp->elements == NULL ||
+	ramp->connect == NULL || ramp->find == NULL || ramp->remove == NULL)
+	return -1;
+
+    for (i = 0; i < count; i++)
+	sprintf(ramp->nicks[i], "user%d", i);
+    return 0;
+}
+
+/*
+ * Free the samples of a ramp.
+ */
+static void ramp_free(ramp_t *const ramp)
+{
+    free(ramp->nicks);
+    free(ramp->elements);
+    free(ramp->connect);
+    free(ramp->find);
+    free(ramp->remove);
+}
+
+/*
+ * Connect every client as the server does (look the nickname up, then add
+ * it), look each one up while others connect, then remove them all.
+ * Returns -1 if an operation gave a wrong result.
+ */
+static int run_ramp(ramp_t *const ramp)
+{
+    int     i;     /* Connection index */
+    double  start; /* Operation start  */
+    hash_t  hash;  /* Nickname table   */
+
+    hash_init(&hash);
+
+    for (i = 0; i < ramp->count; i++) {
+	start = bench_time();
+	if (hash_find(&hash, ramp->nicks[i]) != NULL ||
+	    (ramp->elements[i] = hash_add(&hash, ramp->nicks[i], NULL,
+					  NULL)) == NULL)
+	    break;
+	ramp->connect[i] = bench_time() - start;
+
+	/* Look up an earlier client (tables are being resized meanwhile) */
+	start = bench_time();
+	if (hash_find(&hash, ramp->nicks[i / 2]) != ramp->elements[i / 2])
+	    break;
+	ramp->find[i] = bench_time() - start;
+    }
+
+    for (i = i == ramp->count ? 0 : ramp->count; i < ramp->count; i++) {
+	start = bench_time();
+	hash_remove(&hash, ramp->elements[i]);
+	ramp->remove[i] = bench_time() - start;
+    }
+
+    i = i == ramp->count && hash_get_count(&hash) == 0 ? 0 : -1;
+    hash_free(&hash);
+    return i;
+}
+
+/*
+ * Get the time taken to add all nicknames to an empty table at once.
+ */
+static double time_rebuild(const ramp_t *const ramp)
+{
+    int    i;     /* Nickname index */
+    double start; /* Rebuild start  */
+    hash_t hash;  /* Nickname table */
+
+    hash_init(&hash);
+    start = bench_time();
+    for (i = 0; i < ramp->count; i++)
+	if (hash_add(&hash, ramp->nicks[i], NULL, NULL) == NULL)
+	    break;
+    start = bench_time() - start;
+    hash_free(&hash);
+
+    return i == ramp->count ? start : -1;
+}
+
+
+/*****************************************************************************
+ *
+ * Public functions
+ *
+ */
+
+/*
+ * Measure the latency of hash operations while the table grows.
+ */
+int bench_rehash(const bench_options_t *const options)
+{
+    int           i;         /* Operation index        */
+    int           res;       /* Result                 */
+    double        rebuild;   /* Time of a full rebuild */
+    ramp_t        ramp;      /* Connection ramp        */
+    bench_stats_t stats[3];  /* Latency statistics     */
+
+    /* Measured operations */
+    static const char *const names[] = {"connect", "find", "remove"};
+
+    assert(options != NULL);
+
+    if (ramp_init(&ramp, options->quick ? REHASH_CONNECTIONS / 10 :
+		  REHASH_CONNECTIONS) != 0) {
+	perror("Error while allocating memory");
+	ramp_free(&ramp);
+	return -1;
+    }
+
+    if (run_ramp(&ramp) != 0 || (rebuild = time_rebuild(&ramp)) < 0) {
+	printf("  hash operations failed\n");
+	ramp_free(&ramp);
+	return -1;
+    }
+
+    bench_get_stats(ramp.connect, ramp.count, &stats[0]);
+    bench_get_stats(ramp.find, ramp.count, &stats[1]);
+    bench_get_stats(ramp.remove, ramp.count, &stats[2]);
+
+    printf("  %d connections, full rebuild of the table: %.0f us\n",
+	   ramp.count, rebuild * 1e6);
+    printf("  %-8s %9s %9s %9s %9s\n", "(ns)", "mean", "p50", "p99", "max");
+    for (i = 0; i < 3; i++)
+	printf("  %-8s %9.0f %9.0f %9.0f %9.0f\n", names[i],
+	       stats[i].mean * 1e9, stats[i].p50 * 1e9, stats[i].p99 * 1e9,
+	       stats[i].max * 1e9);
+
+    /* Connections must not wait for the table to be resized */
+    res = 0;
+    if (stats[0].p99 * REHASH_MIN_RATIO > rebuild) {
+	printf("  connect p99 is not %d times below a full rebuild\n",
+	       REHASH_MIN_RATIO);
+	res = -1;
+    }
+
+    ramp_free(&ramp);
+    return res;
+}
+
+/* End of file */
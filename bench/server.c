@@ -0,0 +1,488 @@
+/*
+ * ---------------------------------------------------------------------------
+ *
+ * Minitalk: a basic talk-like server/client
+ * Copyright (C) 2004 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: bench/server.c
+ *
+ * Description: Server Process Helpers
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+/*****************************************************************************
+ *
+ * Headers
+ *
+ */
+
+/* Feature test macros (fork(), kill(), nanosleep(), __WALL) */
+#define _DEFAULT_SOURCE
+
+/* System headers */
+#include <stdio.h>    /* sprintf(), fprintf(), fflush(), perror()  */
+#include <string.h>   /* memset(), memcmp(), memmove(), strlen()   */
+#include <unistd.h>   /* fork(), execv(), pipe(), dup2(), close()  */
+#include <fcntl.h>    /* open(), O_WRONLY                          */
+#include <signal.h>   /* kill(), SIGKILL                           */
+#include <errno.h>    /* errno, EINTR                              */
+#include <time.h>     /* nanosleep()                               */
+#include <poll.h>     /* poll(), POLLIN                            */
+#include <assert.h>   /* assert()                                  */
+#include <sys/wait.h> /* waitpid(), WNOHANG, WIFEXITED()           */
+#ifdef __linux__
+# include <sys/ptrace.h> /* ptrace(), PTRACE_TRACEME, PTRACE_SYSCALL */
+#endif
+
+/* Network-related headers */
+#include <sys/socket.h>  /* socket(), connect(), bind(), setsockopt() */
+#include <netinet/in.h>  /* struct sockaddr_in, IPPROTO_TCP           */
+#include <netinet/tcp.h> /* TCP_NODELAY                               */
+#include <arpa/inet.h>   /* htonl(), htons(), ntohs()                 */
+
+/* Project headers */
+#include <common.h>
+#include "bench.h"
+
+
+/*****************************************************************************
+ *
+ * Constants
+ *
+ */
+
+/* Maximum number of arguments given to the server */
+#define SERVER_MAX_ARGS 16
+
+/* Time given to the server to start or to exit, in seconds */
+#define SERVER_TIMEOUT 5.0
+
+
+
+/*****************************************************************************
+ *
+ * Private functions
+ *
+ */
+
+/*
+ * Sleep for some milliseconds.
+ */
+static void sleep_ms(const int ms)
+{
+    struct timespec delay; /* Sleep duration */
+
+    delay.tv_sec = ms / 1000;
+    delay.tv_nsec = (ms % 1000) * 1000000L;
+    nanosleep(&delay, NULL);
+}
+
+/*
+ * Get the address of the loopback interface at a given port.
+ */
+static void get_address(struct sockaddr_in *const addr,
+			const unsigned short port)
+{
+    memset(addr, 0, sizeof(*addr));
+    addr->sin_family = AF_INET;
+    addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr->sin_port = htons(port);
+}
+
+/*
+ * Find a free port (returns 0 on error).
+ */
+static unsigned short find_port(void)
+{
+    int                sock;     /* Probe socket   */
+    socklen_t          addr_len; /* Address length */
+    struct sockaddr_in addr;     /* Bound address  */
+
+    if ((sock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP)) == -1)
+	return 0;
+
+    get_address(&addr, 0);
+    addr_len = sizeof(addr);
+    if (bind(sock, (struct sockaddr *) &addr, sizeof(addr)) != 0 ||
+	getsockname(sock, (struct sockaddr *) &addr, &addr_len) != 0)
+	addr.sin_port = 0;
+
+    close(sock);
+    return ntohs(addr.sin_port);
+}
+
+/*
+ * Execute the server with its standard input read from a pipe and its
+ * output discarded (in the child process).
+ */
+static void exec_server(const char *const path, const char *const *args,
+			const unsigned short port, const int input)
+{
+    int   i;                         /* Argument index   */
+    int   null;                      /* Null device      */
+    char  port_arg[8];               /* Port argument    */
+    char *argv[SERVER_MAX_ARGS + 3]; /* Server arguments */
+
+    argv[0] = (char *) path;
+    for (i = 0; args != NULL && args[i] != NULL && i < SERVER_MAX_ARGS; i++)
+	argv[i + 1] = (char *) args[i];
+    sprintf(port_arg, "%u", port);
+    argv[i + 1] = port_arg;
+    argv[i + 2] = NULL;
+
+    if (dup2(input, STDIN_FILENO) == -1 ||
+	(null = open("/dev/null", O_WRONLY)) == -1 ||
+	dup2(null, STDOUT_FILENO) == -1 || dup2(null, STDERR_FILENO) == -1)
+	_exit(127);
+
+    execv(path, argv);
+    _exit(127);
+}
+
+
+#ifdef __linux__
+/*
+ * Run the server as a child traced with ptrace(), count the stops of its
+ * threads at the entry and exit of system calls and exit with its status
+ * (in the tracer process).
+ */
+static void trace_server(const char *const path, const char *const *args,
+			 const unsigned short port, const int input,
+			 volatile unsigned long *const stops)
+{
+    int   status; /* Stop or exit status          */
+    int   sig;    /* Signal delivered to a thread */
+    pid_t pid;    /* Stopped thread               */
+    pid_t child;  /* Server process               */
+
+    if ((child = fork()) == -1)
+	_exit(127);
+    if (child == 0) {
+	/* Stop until the tracer is ready */
+	if (ptrace(PTRACE_TRACEME, 0, NULL, NULL) != 0)
+	    _exit(127);
+	raise(SIGSTOP);
+	exec_server(path, args, port, input);
+    }
+    close(input);
+
+    /* Follow new threads; the server is killed if the tracer dies */
+    if (waitpid(child, &status, 0) != child || !WIFSTOPPED(status) ||
+	ptrace(PTRACE_SETOPTIONS, child, NULL,
+	       (void *) (long) (PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACECLONE |
+				PTRACE_O_EXITKILL)) != 0) {
+	kill(child, SIGKILL);
+	_exit(127);
+    }
+    ptrace(PTRACE_SYSCALL, child, NULL, NULL);
+
+    while ((pid = waitpid(-1, &status, __WALL)) != -1) {
+	if (WIFEXITED(status) || WIFSIGNALED(status)) {
+	    if (pid == child)
+		_exit(WIFEXITED(status) ? WEXITSTATUS(status) : 127);
+	    continue;
+	}
+
+	/* System calls and ptrace events (and the initial stop of new
+	 * threads) are not signals to deliver */
+	sig = WSTOPSIG(status);
+	if (sig == (SIGTRAP | 0x80))
+	    (*stops)++;
+	if (sig == (SIGTRAP | 0x80) || sig == SIGTRAP || sig == SIGSTOP)
+	    sig = 0;
+	ptrace(PTRACE_SYSCALL, pid, NULL, (void *) (long) sig);
+    }
+    _exit(127);
+}
+#endif /* __linux__ */
+
+/*
+ * Launch the server, traced if stops is not NULL, and wait until it accepts
+ * connections.
+ */
+static int start_server(bench_server_t *const server,
+			const bench_options_t *const options,
+			const char *const *args,
+			volatile unsigned long *const stops)
+{
+    int            fds[2];   /* Standard input pipe      */
+    int            status;   /* Early exit status        */
+    double         deadline; /* End of the starting time */
+    bench_client_t probe;    /* Probe connection         */
+
+    if ((server->port = find_port()) == 0 || pipe(fds) != 0) {
+	perror("Error while preparing the server");
+	return -1;
+    }
+
+    if ((server->pid = fork()) == -1) {
+	perror("Error while launching the server");
+	close(fds[0]);
+	close(fds[1]);
+	return -1;
+    }
+    if (server->pid == 0) {
+	close(fds[1]);
+#ifdef __linux__
+	if (stops != NULL)
+	    trace_server(options->server, args, server->port, fds[0], stops);
+#else
+	if (stops != NULL)
+	    _exit(127);
+#endif
+	exec_server(options->server, args, server->port, fds[0]);
+    }
+    close(fds[0]);
+    server->input = fds[1];
+
+    /* Wait until the server accepts connections */
+    deadline = bench_time() + SERVER_TIMEOUT;
+    while (bench_client_open(&probe, server, 0) != 0) {
+	if (waitpid(server->pid, &status, WNOHANG) == server->pid ||
+	    bench_time() > deadline) {
+	    fflush(stdout);
+	    fprintf(stderr, "Server `%s' did not start%s\n", options->server,
+		    stops != NULL ? " under ptrace()" : "");
+	    if (kill(server->pid, SIGKILL) == 0)
+		waitpid(server->pid, &status, 0);
+	    close(server->input);
+	    return -1;
+	}
+	sleep_ms(10);
+    }
+    bench_client_close(&probe);
+
+    return 0;
+}
+
+
+/*****************************************************************************
+ *
+ * Public functions
+ *
+ */
+
+/*
+ * Launch the server with the given arguments (NULL-terminated, the port is
+ * added) and wait until it accepts connections.
+ */
+int bench_server_start(bench_server_t *const server,
+		       const bench_options_t *const options,
+		       const char *const *args)
+{
+    assert(server != NULL);
+    assert(options != NULL);
+
+    return start_server(server, options, args, NULL);
+}
+
+/*
+ * Launch the server as bench_server_start() does, counting its system calls:
+ * *syscalls is incremented on their entry and on their exit (by another
+ * process: it must be in shared memory).  This needs ptrace() on Linux.
+ */
+int bench_server_start_traced(bench_server_t *const server,
+			      const bench_options_t *const options,
+			      const char *const *args,
+			      volatile unsigned long *const syscalls)
+{
+    assert(server != NULL);
+    assert(options != NULL);
+    assert(syscalls != NULL);
+
+    return start_server(server, options, args, syscalls);
+}
+
+/*
+ * Stop the server by closing its standard input (returns -1 if it did not
+ * exit successfully).
+ */
+int bench_server_stop(bench_server_t *const server)
+{
+    int    status;   /* Exit status            */
+    double deadline; /* End of the exiting time */
+
+    assert(server != NULL);
+
+    close(server->input);
+
+    /* End of file on the console makes it exit */
+    deadline = bench_time() + SERVER_TIMEOUT;
+    while (waitpid(server->pid, &status, WNOHANG) == 0) {
+	if (bench_time() > deadline) {
+	    kill(server->pid, SIGKILL);
+	    waitpid(server->pid, &status, 0);
+	    return -1;
+	}
+	sleep_ms(10);
+    }
+
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : -1;
+}
+
+/*
+ * Connect a client to the server, with a given receive buffer size (0 for
+ * the default one).  The socket is reset when closed, so that many
+ * connections do not exhaust local ports.
+ */
+int bench_client_open(bench_client_t *const client,
+		      const bench_server_t *const server, const int rcvbuf)
+{
+    int                on;     /* Option value   */
+    struct linger      linger; /* Linger option  */
+    struct sockaddr_in addr;   /* Server address */
+
+    assert(client != NULL);
+    assert(server != NULL);
+
+    client->size = 0;
+    if ((client->sock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP)) == -1)
+	return -1;
+
+    on = 1;
+    linger.l_onoff = 1;
+    linger.l_linger = 0;
+    get_address(&addr, server->port);
+    if (setsockopt(client->sock, IPPROTO_TCP, TCP_NODELAY, &on,
+		   sizeof(on)) != 0 ||
+	setsockopt(client->sock, SOL_SOCKET, SO_LINGER, &linger,
+		   sizeof(linger)) != 0 ||
+	(rcvbuf != 0 && setsockopt(client->sock, SOL_SOCKET, SO_RCVBUF,
+				   &rcvbuf, sizeof(rcvbuf)) != 0) ||
+	connect(client->sock, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+	close(client->sock);
+	client->sock = -1;
+	return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Connect a client and authenticate it with a nickname (returns -1 on error
+ * or if the server did not welcome it in time).
+ */
+int bench_client_join(bench_client_t *const client,
+		      const bench_server_t *const server,
+		      const char *const nick, const int rcvbuf,
+		      const double timeout)
+{
+    char line[64]; /* Command or expected text */
+
+    assert(strlen(nick) < sizeof(line) - 16);
+
+    if (bench_client_open(client, server, rcvbuf) != 0)
+	return -1;
+
+    sprintf(line, "/connect %s\n", nick);
+    if (bench_client_send(client, line) != 0)
+	return -1;
+    sprintf(line, "Hello, %s!", nick);
+    return bench_client_expect(client, line, timeout);
+}
+
+/*
+ * Disconnect a client.
+ */
+void bench_client_close(bench_client_t *const client)
+{
+    assert(client != NULL);
+
+    if (client->sock != -1)
+	close(client->sock);
+    client->sock = -1;
+}
+
+/*
+ * Send a string to the server (returns -1 on error).
+ */
+int bench_client_send(bench_client_t *const client, const char *const str)
+{
+    int len;  /* Written length */
+    int done; /* Sent length    */
+    int size; /* String length  */
+
+    assert(client != NULL);
+    assert(str != NULL);
+
+    size = strlen(str);
+    for (done = 0; done < size; )
+	if ((len = write(client->sock, str + done, size - done)) != -1)
+	    done += len;
+	else if (errno != EINTR)
+	    return -1;
+
+    return 0;
+}
+
+/*
+ * Receive data until some text comes (returns -1 on error, at end of file
+ * or if it did not come in time).  Data before the text is skipped; data
+ * after it is kept for the next call.
+ */
+int bench_client_expect(bench_client_t *const client, const char *const text,
+			const double timeout)
+{
+    int           i;        /* Position in data    */
+    int           len;      /* Text or read length */
+    int           wait;     /* Time left, in ms    */
+    double        deadline; /* Time limit          */
+    struct pollfd fd;       /* Polled socket       */
+
+    assert(client != NULL);
+    assert(text != NULL);
+    assert((int) strlen(text) < BENCH_CLIENT_BUFFER / 2);
+
+    fd.fd = client->sock;
+    fd.events = POLLIN;
+    deadline = bench_time() + timeout;
+
+    while (1) {
+	/* Search the text (data may contain NUL characters) */
+	len = strlen(text);
+	for (i = 0; i + len <= client->size; i++)
+	    if (memcmp(client->data + i, text, len) == 0) {
+		client->size -= i + len;
+		memmove(client->data, client->data + i + len, client->size);
+		return 0;
+	    }
+
+	/* Keep the end of data, which may be the beginning of the text */
+	if (client->size >= len) {
+	    memmove(client->data, client->data + client->size - len + 1,
+		    len - 1);
+	    client->size = len - 1;
+	}
+
+	/* Wait for more data */
+	if ((wait = (deadline - bench_time()) * 1000) <= 0 ||
+	    poll(&fd, 1, wait) <= 0)
+	    return -1;
+	if ((len = read(client->sock, client->data + client->size,
+			BENCH_CLIENT_BUFFER - client->size)) <= 0)
+	    return -1;
+	client->size += len;
+    }
+}
+
+/* End of file */
@@ -0,0 +1,266 @@
+/*
+ * ---------------------------------------------------------------------------
+ *
+ * Minitalk: a basic talk-like server/client
+ * Copyright (C) 2004 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: bench/stall.c
+ *
+ * Description: Stalled Reader Stress Test
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+/*****************************************************************************
+ *
+ * Headers
+ *
+ */
+
+/* System headers */
+#include <stdlib.h> /* malloc(), free()             */
+#include <stdio.h>  /* printf(), sprintf(), perror() */
+#include <string.h> /* memset()                     */
+#include <assert.h> /* assert()                     */
+
+/* Project headers */
+#include <common.h>
+#include "bench.h"
+
+
+/*****************************************************************************
+ *
+ * Constants
+ *
+ */
+
+/* Number of clients which never read */
+#define STALL_STALLED 16
+
+/* Number of clients which read everything */
+#define STALL_ACTIVE 4
+
+/* Receive buffer of stalled clients (the kernel may round it up) */
+#define STALL_RCVBUF 4096
+
+/* Size of each broadcast message */
+#define STALL_MESSAGE 4000
+
+/* Number of broadcast messages (divided in quick mode) */
+#define STALL_ROUNDS 2000
+
+/* Time given to the server to deliver a message, in seconds */
+#define STALL_TIMEOUT 5.0
+
+
+/*****************************************************************************
+ *
+ * Data types
+ *
+ */
+
+/* Clients of a run */
+typedef struct session {
+    bench_client_t talker;                  /* Client sending messages */
+    bench_client_t active[STALL_ACTIVE];    /* Clients reading them    */
+    bench_client_t stalled[STALL_STALLED];  /* Clients never reading   */
+} session_t;
+
+
+/*****************************************************************************
+ *
+ * Local functions
+ *
+ */
+
+/*
+ * Connect all clients of a session (returns -1 on error).
+ */
+static int session_open(session_t *const session,
+			const bench_server_t *const server)
+{
+    int  i;        /* Client index */
+    char nick[16]; /* Nickname     */
+
+    /* Nothing is connected yet */
+    session->talker.sock = -1;
+    for (i = 0; i < STALL_ACTIVE; i++)
+	session->active[i].sock = -1;
+    for (i = 0; i < STALL_STALLED; i++)
+	session->stalled[i].sock = -1;
+
+    /* Stalled clients read their welcome, then nothing else */
+    for (i = 0; i < STALL_STALLED; i++) {
+	sprintf(nick, "stalled%d", i);
+	if (bench_client_join(&session->stalled[i], server, nick,
+			      STALL_RCVBUF, STALL_TIMEOUT) != 0)
+	    return -1;
+    }
+    for (i = 0; i < STALL_ACTIVE; i++) {
+	sprintf(nick, "active%d", i);
+	if (bench_client_join(&session->active[i], server, nick, 0,
+			      STALL_TIMEOUT) != 0)
+	    return -1;
+    }
+    return bench_client_join(&session->talker, server, "talker", 0,
+			     STALL_TIMEOUT);
+}
+
+/*
+ * Disconnect all clients of a session.
+ */
+static void session_close(session_t *const session)
+{
+    int i; /* Client index */
+
+    bench_client_close(&session->talker);
+    for (i = 0; i < STALL_ACTIVE; i++)
+	bench_client_close(&session->active[i]);
+    for (i = 0; i < STALL_STALLED; i++)
+	bench_client_close(&session->stalled[i]);
+}
+
+/*
+ * Broadcast messages and wait for each active client to receive them.
+ * Returns the number of delivered messages and the time each one took.
+ */
+static int broadcast(session_t *const session, const int rounds,
+		     double *const times)
+{
+    int    i;                         /* Round index          */
+    int    j;                         /* Active client index  */
+    int    len;                       /* Header length        */
+    double start;                     /* Sending time         */
+    char   header[32];                /* Expected text        */
+    char   message[STALL_MESSAGE + 1]; /* Broadcast message   */
+
+    memset(message, 'x', STALL_MESSAGE - 1);
+    message[STALL_MESSAGE - 1] = '\n';
+    message[STALL_MESSAGE] = '\0';
+
+    for (i = 0; i < rounds; i++) {
+	len = sprintf(message, "round %d ", i);
+	message[len] = 'x';
+	sprintf(header, "talker: round %d ", i);
+
+	start = bench_time();
+	if (bench_client_send(&session->talker, message) != 0)
+	    return i;
+	for (j = 0; j < STALL_ACTIVE; j++) {
+	    if (bench_client_expect(&session->active[j], header,
+				    STALL_TIMEOUT) != 0)
+		return i;
+	    times[i * STALL_ACTIVE + j] = bench_time() - start;
+	}
+    }
+
+    return rounds;
+}
+
+
+/*****************************************************************************
+ *
+ * Public functions
+ *
+ */
+
+/*
+ * Check that clients which never read do not keep the server from serving
+ * the others.
+ */
+int bench_stall(const bench_options_t *const options)
+{
+    int            i;         /* Configuration index */
+    int            rounds;    /* Number of messages  */
+    int            done;      /* Delivered messages  */
+    int            res;       /* Result              */
+    double        *times;     /* Delivery times      */
+    session_t     *session;   /* Connected clients   */
+    bench_stats_t  stats;     /* Delivery statistics */
+    bench_server_t server;    /* Launched server     */
+
+    /* Server configurations */
+    static const struct {
+	const char *name;    /* Configuration name */
+	const char *args[3]; /* Server arguments   */
+    } configs[] = {
+	{"default",  {NULL}},
+	{"no limit", {"-q", "0", NULL}},
+	{"rings",    {"-r", NULL}}
+    };
+
+    assert(options != NULL);
+
+    rounds = options->quick ? STALL_ROUNDS / 10 : STALL_ROUNDS;
+    times = malloc(rounds * STALL_ACTIVE * sizeof(double));
+    session = malloc(sizeof(session_t));
+    if (times == NULL || session == NULL) {
+	perror("Error while allocating memory");
+	free(times);
+	free(session);
+	return -1;
+    }
+
+    printf("  %d stalled and %d active clients, %d messages of %d bytes\n",
+	   STALL_STALLED, STALL_ACTIVE, rounds, STALL_MESSAGE);
+    printf("  %-8s %10s %10s %10s %10s\n", "server", "delivered",
+	   "p50 (us)", "p99 (us)", "max (us)");
+
+    res = 0;
+    for (i = 0; i < (int) (sizeof(configs) / sizeof(configs[0])); i++) {
+	if (bench_server_start(&server, options, configs[i].args) != 0) {
+	    res = -1;
+	    break;
+	}
+
+	done = -1;
+	if (session_open(session, &server) == 0)
+	    done = broadcast(session, rounds, times);
+	session_close(session);
+
+	/* Every message must have reached every active client in time */
+	if (done != rounds) {
+	    if (done == -1)
+		printf("  %-8s clients could not connect\n", configs[i].name);
+	    else
+		printf("  %-8s %10d messages, then the server stopped "
+		       "serving active clients\n", configs[i].name, done);
+	    res = -1;
+	} else {
+	    bench_get_stats(times, rounds * STALL_ACTIVE, &stats);
+	    printf("  %-8s %10d %10.0f %10.0f %10.0f\n", configs[i].name,
+		   done, stats.p50 * 1e6, stats.p99 * 1e6, stats.max * 1e6);
+	}
+
+	if (bench_server_stop(&server) != 0) {
+	    printf("  %-8s the server did not exit properly\n",
+		   configs[i].name);
+	    res = -1;
+	}
+    }
+
+    free(times);
+    free(session);
+    return res;
+}
+
+/* End of file */
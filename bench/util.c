@@ -0,0 +1,110 @@
+/*
+ * ---------------------------------------------------------------------------
+ *
+ * Minitalk: a basic talk-like server/client
+ * Copyright (C) 2004 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: bench/util.c
+ *
+ * Description: Benchmark Measures
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+/*****************************************************************************
+ *
+ * Headers
+ *
+ */
+
+/* Feature test macros (clock_gettime()) */
+#define _POSIX_C_SOURCE 200112L
+
+/* System headers */
+#include <stdlib.h> /* qsort()                          */
+#include <time.h>   /* clock_gettime(), CLOCK_MONOTONIC */
+#include <assert.h> /* assert()                         */
+
+/* Project headers */
+#include <common.h>
+#include "bench.h"
+
+
+/*****************************************************************************
+ *
+ * Private functions
+ *
+ */
+
+/*
+ * Compare two samples (for qsort()).
+ */
+static int compare_samples(const void *const a, const void *const b)
+{
+    const double x = *(const double *) a; /* First sample  */
+    const double y = *(const double *) b; /* Second sample */
+
+    return x < y ? -1 : x > y;
+}
+
+
+/*****************************************************************************
+ *
+ * Public functions
+ *
+ */
+
+/*
+ * Get the time elapsed since an arbitrary point, in seconds.
+ */
+double bench_time(void)
+{
+    struct timespec now; /* Current time */
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/*
+ * Summarize samples (which are sorted in place).
+ */
+void bench_get_stats(double *const samples, const int count,
+		     bench_stats_t *const stats)
+{
+    int    i;   /* Sample index    */
+    double sum; /* Sum of samples  */
+
+    assert(samples != NULL);
+    assert(count > 0);
+    assert(stats != NULL);
+
+    qsort(samples, count, sizeof(double), compare_samples);
+    for (sum = 0, i = 0; i < count; i++)
+	sum += samples[i];
+
+    stats->mean = sum / count;
+    stats->p50 = samples[count / 2];
+    stats->p99 = samples[(int) (count * 0.99)];
+    stats->max = samples[count - 1];
+}
+
+/* End of file */
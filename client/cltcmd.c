@@ -71,7 +71,8 @@ typedef struct srvcmd_data {
  */
 
 /*
- * Console `/connect', `/quit' and `/who' command (executed on server).
+ * Console `/connect', `/quit', `/who' and `/complete' commands (executed on
+ * server).
  */
 static int cmd_cns_server(int arg_count, const char *const *args,
 			  iobuffer_t *const console UNUSED,
@@ -229,7 +230,8 @@ static int cmd_cns_help(int arg_count UNUSED, const char *const *args UNUSED,
 {
     static const char msg_help[] =
 	"/connect <nickname>: choose nickname once connected to a server.\n"
-	"/who: get the currently connected user list.\n"
+	"/who [prefix] [page]: get the currently connected user list.\n"
+	"/complete <prefix>: complete a nickname.\n"
 	"/allow <nickname>: allow a user to transfer files.\n"
 	"/forbid <nickname>: forbid a user to transfer files.\n"
 	"/mode {secure|fast}: select file transfer mode.\n"
@@ -347,29 +349,34 @@ static int cmd_srv_refuse(int arg_count UNUSED, const char *const *args,
 
 /* Commands executed from console */
 static const command_t console_commands[] = {
-    {"allow",    1, "<nickname>",    (command_func_t) cmd_cns_allow   },
-    {"connect",  1, "<nickname>",    (command_func_t) cmd_cns_server  },
-    {"forbid",   1, "<nickname>",    (command_func_t) cmd_cns_forbid  },
-    {"help",     0, NULL,            (command_func_t) cmd_cns_help    },
-    {"mode",     1, "{secure|fast}", (command_func_t) cmd_cns_mode    },
-    {"quit",     0, NULL,            (command_func_t) cmd_cns_server  },
-    {"transfer", 2, "<[user:]from> <[user:]to>",
-                                     (command_func_t) cmd_cns_transfer},
-    {"who",      0, NULL,            (command_func_t) cmd_cns_server  }
+    {"allow",    1, 0, "<nickname>",    (command_func_t) cmd_cns_allow   },
+    {"complete", 1, 0, "<prefix>",      (command_func_t) cmd_cns_server  },
+    {"connect",  1, 0, "<nickname>",    (command_func_t) cmd_cns_server  },
+    {"forbid",   1, 0, "<nickname>",    (command_func_t) cmd_cns_forbid  },
+    {"help",     0, 0, NULL,            (command_func_t) cmd_cns_help    },
+    {"mode",     1, 0, "{secure|fast}", (command_func_t) cmd_cns_mode    },
+    {"quit",     0, 0, NULL,            (command_func_t) cmd_cns_server  },
+    {"transfer", 2, 0, "<[user:]from> <[user:]to>",
+                                        (command_func_t) cmd_cns_transfer},
+    {"who",      0, 2, "[prefix] [page]",
+                                        (command_func_t) cmd_cns_server  }
 };
 
 /* Commands executed from server */
 static const command_t server_commands[] = {
-    {"accept",  5, "<nickname> <id1> <id2> <address> <port>",
+    {"accept",  5, 0, "<nickname> <id1> <id2> <address> <port>",
      (command_func_t) cmd_srv_accept},
-    {"receive", 4, "<nickname> <id> <mode> <filename>",
+    {"receive", 4, 0, "<nickname> <id> <mode> <filename>",
      (command_func_t) cmd_srv_receive},
-    {"refuse",  3, "<nickname> <id> <reason>",
+    {"refuse",  3, 0, "<nickname> <id> <reason>",
      (command_func_t) cmd_srv_refuse},
-    {"send",    4, "<nickname> <id> <mode> <filename>",
+    {"send",    4, 0, "<nickname> <id> <mode> <filename>",
      (command_func_t) cmd_srv_send}
 };
 
+/* Perfect hashes of the tables above */
+#include "cltcmd.tab"
+
 
 /*****************************************************************************
  *
@@ -384,9 +391,8 @@ int cltcmd_exec(char *const command, cltcmd_type_t type,
 		struct iobuffer *const console, struct server *const server,
 		struct files *const files)
 {
-    int              count;    /* Command count               */
-    const command_t *commands; /* Command list                */
-    cltcmd_data_t    data;     /* Data for callback functions */
+    const command_table_t *table; /* Command table               */
+    cltcmd_data_t          data;  /* Data for callback functions */
 
     assert(command != NULL);
     assert(type == CLTCMD_TYPE_CONSOLE || type == CLTCMD_TYPE_SERVER);
@@ -400,22 +406,19 @@ int cltcmd_exec(char *const command, cltcmd_type_t type,
     /* Select the right command list */
     switch (type) {
     case CLTCMD_TYPE_CONSOLE:
-	commands = console_commands;
-	count = sizeof(console_commands) / sizeof(command_t);
+	table = &console_commands_table;
 	break;
 
     case CLTCMD_TYPE_SERVER:
-	commands = server_commands;
-	count = sizeof(server_commands) / sizeof(command_t);
+	table = &server_commands_table;
 	break;
 
     default:
-	commands = NULL;
-	count = 0;
+	table = NULL;
     }
 
     /* Execute command */
-    return command_exec(command, commands, count, console, console, &data);
+    return command_exec(command, table, console, console, &data);
 }
 
 /* End of file */
@@ -39,9 +39,10 @@
 /* System headers */
 #include <stdlib.h>   /* malloc(), free(), srand(), rand(), NULL */
 #include <stdio.h>    /* snprintf()                              */
-#include <fcntl.h>    /* open(), creat()                         */
+#include <fcntl.h>    /* open(), creat(), fcntl(), O_NONBLOCK    */
 #include <unistd.h>   /* close()                                 */
 #include <string.h>   /* strlen(), strchr(), memcpy()            */
+#include <errno.h>    /* errno, E*                               */
 #include <time.h>     /* time()                                  */
 #include <assert.h>   /* assert()                                */
 #include <sys/stat.h> /* stat()                                  */
@@ -49,12 +50,12 @@
 /* Network-related headers */
 #include <sys/types.h>
 #include <sys/socket.h> /* socket(), connect(), listen(), accept() */
-#include <sys/select.h> /* FD_*()                                  */
 #include <netinet/in.h> /* sockaddr_in, IPPROTO_TCP, IPPROTO_UDP   */
 #include <netdb.h>      /* hostent, gethostbyname()                */
 
 /* Project headers */
 #include <common.h>
+#include <events.h>
 #include <iobuffer.h>
 #include <hash.h>
 #include "server.h"
@@ -128,7 +129,7 @@ static file_t *file_new(files_t *const files, const char *const nick,
 			const char *const name, const files_mode_t mode,
 			const file_dir_t dir);
 static void    file_delete(files_t *const files, file_t *const file);
-static file_t *file_find(const files_t *const files, const char *const key);
+static file_t *file_find(files_t *const files, const char *const key);
 static int     create_socket(const files_mode_t mode, unsigned short *port);
 static void    send_transfer_init(files_t *const files, file_t *const file);
 static void    send_accept(files_t *const files, file_t *const file,
@@ -209,7 +210,11 @@ static file_t *file_new(files_t *const files, const char *const nick,
 	srand(time(NULL));
 	generate_key(file->key, FILE_KEY_LENGTH);
     }
-    hash_add(&files->file_keys, file->key, file, &file->element);
+    if (hash_add(&files->file_keys, file->key, file, &file->element)
+	== NULL) {
+	free(file);
+	return NULL;
+    }
 
     /* Initialize structure */
     file->prev = NULL;
@@ -243,15 +248,15 @@ static void file_delete(files_t *const files, file_t *const file)
 
     /* Free file/socket descriptors */
     if (file->from_fd != -1) {
-	FD_CLR(file->from_fd, files->server->read_fds);
+	events_remove(files->server->events, file->from_fd);
 	close(file->from_fd);
     }
     if (file->to_fd != -1) {
-	FD_CLR(file->to_fd, files->server->write_fds);
+	events_remove(files->server->events, file->to_fd);
 	close(file->to_fd);
     }
     if (file->sock_fd != -1) {
-	FD_CLR(file->sock_fd, files->server->read_fds);
+	events_remove(files->server->events, file->sock_fd);
 	close(file->sock_fd);
     }
 
@@ -269,7 +274,7 @@ static void file_delete(files_t *const files, file_t *const file)
 /*
  * Find a file transfer by its key.
  */
-static file_t *file_find(const files_t *const files, const char *const key)
+static file_t *file_find(files_t *const files, const char *const key)
 {
     hash_element_t *element;
 
@@ -316,9 +321,10 @@ static int create_socket(const files_mode_t mode, unsigned short *port)
     addr.sin_addr.s_addr = htonl(INADDR_ANY);
     addr.sin_port = htons(0);
 
-    /* Bind and listen to the socket */
+    /* Bind and listen to the socket (which never blocks) */
     len = sizeof(addr);
-    if (bind(sock, (struct sockaddr *) &addr, sizeof(addr)) != 0 ||
+    if (fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK) != 0 ||
+	bind(sock, (struct sockaddr *) &addr, sizeof(addr)) != 0 ||
 	(mode == FILES_MODE_SECURE && listen(sock, 1) != 0) ||
 	getsockname(sock, (struct sockaddr *) &addr, &len) != 0) {
 	close(sock);
@@ -441,7 +447,9 @@ void files_init(files_t *const files, struct iobuffer *const console)
 
     /* Initialize structure */
     files->nicks = NULL;
+    files->files = NULL;
     files->console = console;
+    files->mode = FILES_MODE_SECURE;
 
     /* Initialize hash tables */
     hash_init(&files->forbid);
@@ -453,7 +461,14 @@ void files_init(files_t *const files, struct iobuffer *const console)
  */
 void files_free(files_t *const files)
 {
-    hash_free(&files->forbid);
+    assert(files != NULL);
+
+    /* Abort pending transfers */
+    while (files->files != NULL)
+	file_delete(files, files->files);
+
+    /* Empty hash tables */
+    files_reset_forbidden(files);
     hash_free(&files->file_keys);
 }
 
@@ -487,14 +502,22 @@ int files_forbid(files_t *const files, const char *const nick)
 	if ((snick = malloc(len + sizeof(nick_t))) == NULL)
 	    return 1;
 
-	/* Add to linked list */
-	snick->prev = NULL;
-	snick->next = files->nicks;
 	snick->nick = (char *) (snick + 1);
 	memcpy(snick->nick, nick, len);
 
 	/* Add to hash table */
-	hash_add(&files->forbid, snick->nick, snick, &snick->element);
+	if (hash_add(&files->forbid, snick->nick, snick, &snick->element)
+	    == NULL) {
+	    free(snick);
+	    return 1;
+	}
+
+	/* Add to linked list */
+	snick->prev = NULL;
+	snick->next = files->nicks;
+	if (files->nicks != NULL)
+	    files->nicks->prev = snick;
+	files->nicks = snick;
     } else
 	iobuffer_put_data(files->console, msg_already,
 			  sizeof(msg_already) - 1);
@@ -545,21 +568,22 @@ void files_reset_forbidden(files_t *const files)
 
     assert(files != NULL);
 
+    /* Empty hash table (its elements are in the nicknames) */
+    hash_free(&files->forbid);
+
     /* Empty linked list */
-    next = NULL;
     for (nick = files->nicks; nick != NULL; nick = next) {
-	nick = nick->next;
+	next = nick->next;
 	free(nick);
     }
 
     files->nicks = NULL;
-    hash_init(&files->forbid);
 }
 
 /*
  * Let know if a user is forbidden.
  */
-int files_is_forbidden(const files_t *const files, const char *const nick)
+int files_is_forbidden(files_t *const files, const char *const nick)
 {
     assert(files != NULL);
     assert(nick != NULL);
@@ -744,10 +768,7 @@ int files_exec_receive(files_t *const files, const char *const nick,
     file->from_fd = fd;
     file->to_fd = -1;
     file->sock_fd = sock;
-    FD_SET(sock, files->server->read_fds);
-
-    if (sock >= *files->server->num_fds)
-	*files->server->num_fds = sock + 1;
+    events_watch(files->server->events, sock, EVENTS_READ);
 
     send_accept(files, file, key, port);
     free(buffer);
@@ -834,10 +855,7 @@ int files_exec_send(files_t *const files, const char *const nick,
 	file->from_fd = sock;
 	file->sock_fd = -1;
     }
-    FD_SET(sock, files->server->read_fds);
-
-    if (sock >= *files->server->num_fds)
-	*files->server->num_fds = sock + 1;
+    events_watch(files->server->events, sock, EVENTS_READ);
 
     send_accept(files, file, key, port);
     free(buffer);
@@ -891,8 +909,9 @@ int files_accept(files_t *const files, const char *const nick,
     memcpy(&addr.sin_addr, host->h_addr, sizeof(addr.sin_addr));
     addr.sin_port = htons(iport);
 
-    /* Connect to peer */
-    if (connect(sock, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+    /* Connect to peer, then never block on the socket */
+    if (connect(sock, (struct sockaddr *) &addr, sizeof(addr)) != 0 ||
+	fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK) != 0) {
 	iobuffer_put_data(files->console, msg_connect,
 			  sizeof(msg_connect) - 1);
 	send_refuse(files, nick, host_key, "connect");
@@ -906,19 +925,17 @@ int files_accept(files_t *const files, const char *const nick,
 
 	if (file->mode == FILES_MODE_FAST) {
 	    file->sock_fd = sock;
-	    FD_SET(sock, files->server->write_fds);
+	    events_watch(files->server->events, sock, EVENTS_WRITE);
 	} else
-	    FD_SET(sock, files->server->read_fds);
+	    events_watch(files->server->events, sock, EVENTS_READ);
 	break;
 
     case FILE_DIR_SEND:
 	file->to_fd = sock;
-	FD_SET(sock, files->server->write_fds);
+	events_watch(files->server->events, sock, EVENTS_WRITE);
     }
 
     /* Update file descriptor number */
-    if (sock >= *files->server->num_fds)
-	*files->server->num_fds = sock + 1;
 
     iobuffer_put_data(files->console, msg_accept, sizeof(msg_accept) - 1);
     return 0;
@@ -954,11 +971,13 @@ int files_transfer(files_t *const files)
     char               buffer[1024]; /* File transfer buffer    */
     socklen_t          addr_len;     /* Peer address length     */
     struct sockaddr_in addr;         /* Peer address (UDP)      */
+    events_t          *events;       /* Event manager           */
 
     static const char msg_data[] = "Arbitrary data to initiate transfer.";
     static const char msg_success[] = "File succesfully transfered.\n";
 
     assert(files != NULL);
+    events = files->server->events;
 
     for (file = files->files; file != NULL; file = next) {
 	next = file->next;
@@ -968,17 +987,17 @@ int files_transfer(files_t *const files)
 	    file->sock_fd != -1) {
 	    write(file->sock_fd, msg_data, sizeof(msg_data) - 1);
 
-	    FD_SET(file->sock_fd, files->server->read_fds);
-	    FD_CLR(file->sock_fd, files->server->write_fds);
+	    events_watch(events, file->sock_fd, EVENTS_READ);
+	    events_unwatch(events, file->sock_fd, EVENTS_WRITE);
 
 	    file->sock_fd = -1;
 	    continue;
 	}
 
 	if ((file->from_fd != -1 &&
-	     FD_ISSET(file->from_fd, files->server->read_fds)) ||
+	     events_is_ready(events, file->from_fd, EVENTS_READ)) ||
 	    (file->to_fd != -1 &&
-	     FD_ISSET(file->to_fd, files->server->write_fds))) {
+	     events_is_ready(events, file->to_fd, EVENTS_WRITE))) {
 	    /* Socket is ready to be read or written */
 	    switch (file->mode) {
 	    case FILES_MODE_SECURE:
@@ -991,24 +1010,33 @@ int files_transfer(files_t *const files)
 		    file_delete(files, file);
 		    continue;
 		}
-		if (len == -1)
-		    return 1;
+		if (len == -1) {
+		    if (errno != EAGAIN && errno != EINTR)
+			return 1;
+		    continue;
+		}
 
 		/* Read and write until read buffer is empty */
-		do {
-		    written = write(file->to_fd, buffer, len);
-		    if (written == -1)
-			return 1;
-		    if (written != len && file->dir == FILE_DIR_SEND)
-			lseek(file->from_fd, written - len, SEEK_CUR);
+		while (len > 0) {
+		    if ((written = write(file->to_fd, buffer, len)) == -1) {
+			if (errno != EAGAIN && errno != EINTR)
+			    return 1;
+			written = 0;
+		    }
 
-		    len = read(file->from_fd, buffer, sizeof(buffer));
-		} while (len == sizeof(buffer));
+		    /* Socket is full: read the rest again once writable */
+		    if (written != len) {
+			if (file->dir == FILE_DIR_SEND)
+			    lseek(file->from_fd, written - len, SEEK_CUR);
+			break;
+		    }
 
-		if (len == -1)
-		    return 1;
-		if (len > 0)
-		    write(file->to_fd, buffer, len);
+		    if (len != sizeof(buffer))
+			break;
+		    if ((len = read(file->from_fd, buffer, sizeof(buffer)))
+			== -1 && errno != EAGAIN && errno != EINTR)
+			return 1;
+		}
 		break;
 
 	    case FILES_MODE_FAST:
@@ -1017,8 +1045,11 @@ int files_transfer(files_t *const files)
 		case FILE_DIR_RECEIVE:
 		    /* Read one datagram */
 		    len = read(file->from_fd, buffer, sizeof(buffer));
-		    if (len == -1)
-			return 1;
+		    if (len == -1) {
+			if (errno != EAGAIN && errno != EINTR)
+			    return 1;
+			continue;
+		    }
 		    if (len != 1 && write(file->to_fd, buffer + 1,
 					  len - 1) == -1)
 			return 1;
@@ -1045,63 +1076,69 @@ int files_transfer(files_t *const files)
 		    if (len == -1)
 			return 1;
 
-		    if (len == sizeof(buffer) - 1) {
-			/* Beginning or middle of file */
-			buffer[0] = '\0';
-			write(file->to_fd, buffer, sizeof(buffer));
-		    } else {
-			/* End of file */
-			buffer[0] = '\1';
-			write(file->to_fd, buffer, len + 1);
+		    /* Beginning or middle of file, or end of file */
+		    buffer[0] = len == sizeof(buffer) - 1 ? '\0' : '\1';
+		    if (write(file->to_fd, buffer, len + 1) == -1) {
+			if (errno != EAGAIN && errno != EINTR)
+			    return 1;
+
+			/* Socket is full: send the datagram again later */
+			lseek(file->from_fd, -len, SEEK_CUR);
+		    } else if (buffer[0] == '\1')
 			file->sock_fd = -2;
-		    }
 		}
 	    }
 	} else {
 	    /* No read or write can be done on this socket */
 	    if (file->sock_fd != -1 && file->sock_fd != -2 &&
 		(file->from_fd == -1 || file->to_fd == -1)) {
-		if (FD_ISSET(file->sock_fd, files->server->read_fds)) {
+		if (events_is_ready(events, file->sock_fd, EVENTS_READ)) {
 		    /* Peer is connecting to our listening socket */
 		    if (file->mode == FILES_MODE_SECURE) {
 			/* Secure mode: client connected */
 			addr_len = sizeof(addr);
 			sock = accept(file->sock_fd,
 				      (struct sockaddr *) &addr, &addr_len);
-			if (sock == -1)
-			    return 1;
-			if (sock >= *files->server->num_fds)
-			    *files->server->num_fds = sock + 1;
-			FD_CLR(file->sock_fd, files->server->read_fds);
+			if (sock == -1) {
+			    if (errno != EAGAIN && errno != EINTR)
+				return 1;
+			    continue;
+			}
+			fcntl(sock, F_SETFL,
+			      fcntl(sock, F_GETFL) | O_NONBLOCK);
+			events_unwatch(events, file->sock_fd, EVENTS_READ);
 
 			switch (file->dir) {
 			case FILE_DIR_RECEIVE:
 			    file->from_fd = sock;
-			    FD_SET(sock, files->server->read_fds);
+			    events_watch(events, sock, EVENTS_READ);
 			    break;
 
 			case FILE_DIR_SEND:
 			    file->to_fd = sock;
-			    FD_SET(sock, files->server->write_fds);
+			    events_watch(events, sock, EVENTS_WRITE);
 			}
 		    } else {
 			/* Fast mode: we received an initiating datagram */
 			addr_len = sizeof(addr);
 			if (recvfrom(file->sock_fd, buffer, sizeof(buffer), 0,
 				     (struct sockaddr *) &addr, &addr_len)
-			    == -1)
-			    return -1;
+			    == -1) {
+			    if (errno != EAGAIN && errno != EINTR)
+				return -1;
+			    continue;
+			}
 			if (connect(file->sock_fd, (struct sockaddr *) &addr,
 				    addr_len) != 0)
 			    return 1;
 
-			FD_CLR(file->sock_fd, files->server->read_fds);
-			FD_SET(file->sock_fd, files->server->write_fds);
+			events_unwatch(events, file->sock_fd, EVENTS_READ);
+			events_watch(events, file->sock_fd, EVENTS_WRITE);
 			file->to_fd = file->sock_fd;
 			file->sock_fd = -1;
 		    }
 		} else
-		    FD_SET(file->sock_fd, files->server->read_fds);
+		    events_watch(events, file->sock_fd, EVENTS_READ);
 
 		continue;
 	    }
@@ -1110,15 +1147,15 @@ int files_transfer(files_t *const files)
 	    switch (file->dir) {
 	    case FILE_DIR_RECEIVE:
 		if (file->from_fd != -1)
-		    FD_SET(file->from_fd, files->server->read_fds);
+		    events_watch(events, file->from_fd, EVENTS_READ);
 		if (file->mode == FILES_MODE_FAST &&
 		    file->sock_fd != -1 && file->sock_fd != -2)
-		    FD_SET(file->from_fd, files->server->write_fds);
+		    events_watch(events, file->from_fd, EVENTS_WRITE);
 		break;
 
 	    case FILE_DIR_SEND:
 		if (file->to_fd != -1)
-		    FD_SET(file->to_fd, files->server->write_fds);
+		    events_watch(events, file->to_fd, EVENTS_WRITE);
 	    }
 	}
     }
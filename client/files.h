@@ -87,7 +87,7 @@ void files_set_server(files_t *const files, struct server *const server);
 int  files_forbid(files_t *const files, const char *const nick);
 void files_allow(files_t *const files, const char *const nick);
 void files_reset_forbidden(files_t *const files);
-int  files_is_forbidden(const files_t *const files, const char *const nick);
+int  files_is_forbidden(files_t *const files, const char *const nick);
 
 /* Methods called from commands */
 void files_set_mode(files_t *const files, const files_mode_t mode);
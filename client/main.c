@@ -41,17 +41,19 @@
 #include <stdio.h>  /* perror(), fprintf(), stderr       */
 #include <unistd.h> /* close(), read(), write()          */
 #include <string.h> /* strcmp()                          */
+#include <signal.h> /* signal(), SIGPIPE, SIG_IGN        */
 #include <time.h>   /* time()                            */
 #include <assert.h> /* assert()                          */
 
 /* Network-related headers */
 #include <sys/types.h>
 #include <sys/socket.h> /* socket(), bind(), listen()                  */
-#include <sys/select.h> /* select(), fd_set, FD_*                      */
 #include <netinet/in.h> /* struct sockaddr_in, INADDR_ANY, IPPROTO_TCP */
 
 /* Project headers */
 #include <common.h>
+#include <events.h>
+#include <hash.h>
 #include <iobuffer.h>
 #include <command.h>
 #include "cltcmd.h"
@@ -92,10 +94,10 @@ static void write_welcome(void)
 static int console_input(iobuffer_t *const console, server_t *const server,
 			 files_t *const files)
 {
-    int     cmd;       /* Command return value    */
-    int     arg_count; /* Command argument count  */
-    char  **args;      /* Command argument tokens */
-    line_t *line;      /* Input line              */
+    int     cmd;                    /* Command return value    */
+    int     arg_count;              /* Command argument count  */
+    char   *args[COMMAND_MAX_ARGS]; /* Command argument tokens */
+    line_t *line;                   /* Input line              */
 
     static const char msg_eof_console[] = "EOF from standard input; "
 	"exiting.\n";
@@ -117,7 +119,7 @@ static int console_input(iobuffer_t *const console, server_t *const server,
     cmd = 0;
 
     /* Input lines from the console */
-    while (cmd == 0 && (line = iobuffer_input_line(console, 0)) != NULL) {
+    while (cmd == 0 && (line = iobuffer_view_line(console, 0)) != NULL) {
 	if (server->sock != -1) {
 	    if (line->data[0] != '/')
 		/* Message */
@@ -128,7 +130,8 @@ static int console_input(iobuffer_t *const console, server_t *const server,
 				  console, server, files);
 	} else {
 	    if (line->data[0] == '/') {
-		arg_count = command_get_tokens(line->data + 1, &args);
+		arg_count = command_get_tokens(line->data + 1, args,
+					       COMMAND_MAX_ARGS);
 
 		if (arg_count > 0) {
 		    /* Authentication, connection of quit command */
@@ -151,15 +154,12 @@ static int console_input(iobuffer_t *const console, server_t *const server,
 		} else
 		    iobuffer_put_data(console, msg_connect,
 				      sizeof(msg_connect) - 1);
-
-		free(args);
 	    } else
 		iobuffer_put_data(console, msg_connect,
 				  sizeof(msg_connect) - 1);
 	}
-
-	free(line);
     }
+    iobuffer_release_line(console);
 
     return cmd;
 }
@@ -176,9 +176,7 @@ static int console_input(iobuffer_t *const console, server_t *const server,
  */
 int main(int argc, char *argv[])
 {
-    int        nfds;     /* Number of descriptors          */
-    fd_set     rfds;     /* Read descriptors for select()  */
-    fd_set     wfds;     /* Write descriptors for select() */
+    events_t   events;   /* Event manager                  */
     iobuffer_t console;  /* Console input/output buffer    */
     server_t   server;   /* Server connection informations */
     files_t    files;    /* Files being transfered         */
@@ -189,23 +187,29 @@ int main(int argc, char *argv[])
 	return 1;
     }
 
+    /* Initialize event manager */
+    if (events_init(&events, EVENTS_BACKEND_AUTO) != 0) {
+	perror("Error while initializing the event backend");
+	return 2;
+    }
+
+    /* Make hash keys unpredictable */
+    hash_randomize();
+
+    /* Lost connections are detected by write errors instead of a signal */
+    signal(SIGPIPE, SIG_IGN);
+
     /* Write welcome message */
     write_welcome();
 
     /* Initialize structures */
-    iobuffer_init(&console, STDIN_FILENO, STDOUT_FILENO, &rfds, &wfds, '\n');
+    iobuffer_init(&console, STDIN_FILENO, STDOUT_FILENO, &events, '\n');
     files_init(&files, &console);
-    server_init(&server, &console, &rfds, &wfds, &nfds, &files);
+    server_init(&server, &console, &events, &files);
     files_set_server(&files, &server);
 
-    /* Initialize read descriptor sets */
-    FD_ZERO(&rfds);
-    FD_SET(STDIN_FILENO, &rfds);
-    FD_ZERO(&wfds);
-    FD_SET(STDOUT_FILENO, &wfds);
-
-    /* Initialize descriptor number */
-    nfds = STDOUT_FILENO + 1;
+    /* Watch standard input */
+    events_watch(&events, STDIN_FILENO, EVENTS_READ);
 
     /* Initialize random number generator */
     srand(time(NULL));
@@ -213,7 +217,7 @@ int main(int argc, char *argv[])
     /* Main loop */
     while (1) {
 	/* Wait for a ready descriptor */
-	select(nfds, &rfds, &wfds, NULL, NULL);
+	events_wait(&events, -1);
 
 	/* Transfer files */
 	if (files_transfer(&files) != 0)
@@ -231,13 +235,18 @@ int main(int argc, char *argv[])
 	server_write(&server);
     }
 
-    /* Flush buffers */
-    FD_SET(STDOUT_FILENO, &wfds);
+    /* Flush buffers (write without waiting for readiness) */
+    if (server.sock != -1)
+	iobuffer_set_events(&server.buffer, NULL);
+    iobuffer_set_events(&console, NULL);
     server_write(&server);
     iobuffer_write(&console);
 
     /* Free memory and close sockets */
+    files_free(&files);
     iobuffer_free(&console);
+    events_free(&events);
+    dbuffer_pool_free();
 
     /* Exit silently */
     return 0;
@@ -37,22 +37,23 @@
  */
 
 /* System headers */
-#include <stdlib.h> /* atoi(), NULL       */
-#include <stdio.h>  /* snprintf()         */
-#include <unistd.h> /* close()            */
-#include <string.h> /* memcpy(), strlen() */
-#include <assert.h> /* assert()           */
+#include <stdlib.h> /* atoi(), NULL        */
+#include <stdio.h>  /* snprintf()          */
+#include <unistd.h> /* close()             */
+#include <fcntl.h>  /* fcntl(), O_NONBLOCK */
+#include <string.h> /* memcpy(), strlen()  */
+#include <assert.h> /* assert()            */
 
 /* Network-related headers */
 #include <sys/types.h>
 #include <sys/socket.h> /* connect()                */
-#include <sys/select.h> /* fd_set, FD_CLR()         */
 #include <netinet/in.h> /* htons()                  */
 #include <arpa/inet.h>  /* inet_ntoa                */
 #include <netdb.h>      /* hostent, gethostbyname() */
 
 /* Project headers */
 #include <common.h>
+#include <events.h>
 #include <iobuffer.h>
 #include <hash.h>
 #include "cltcmd.h"
@@ -81,8 +82,7 @@
  * Initialise the server handler.
  */
 void server_init(server_t *const server, iobuffer_t *const console,
-		 fd_set *const read_fds, fd_set *const write_fds,
-		 int *const num_fds, struct files *const files)
+		 events_t *const events, struct files *const files)
 {
     assert(server != NULL);
     assert(console != NULL);
@@ -91,9 +91,7 @@ void server_init(server_t *const server, iobuffer_t *const console,
     server->sock = -1;
     server->console = console;
     server->files = files;
-    server->read_fds = read_fds;
-    server->write_fds = write_fds;
-    server->num_fds = num_fds;
+    server->events = events;
 }
 
 /*
@@ -109,9 +107,8 @@ void server_free(server_t *const server)
 
     /* Close socket */
     if ((sock = server->sock) != -1) {
+	events_remove(server->events, sock);
 	close(sock);
-	FD_CLR(sock, server->read_fds);
-	FD_CLR(sock, server->write_fds);
 	server->sock = -1;
     }
 }
@@ -160,17 +157,21 @@ void server_connect(server_t *const server, const char *const nick,
 	     inet_ntoa(addr.sin_addr), iport, &len);
     iobuffer_put_data(server->console, str_buffer, len);
 
-    /* Connect to server */
-    if (connect(server->sock, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
+    /* Connect to server, then never block on the socket */
+    if (connect(server->sock, (struct sockaddr *) &addr, sizeof(addr)) != 0
+	|| fcntl(server->sock, F_SETFL,
+		 fcntl(server->sock, F_GETFL) | O_NONBLOCK) != 0
+	|| events_watch(server->events, server->sock, EVENTS_READ) != 0) {
 	iobuffer_put_data(server->console, msg_connect,
 			  sizeof(msg_connect) - 1);
+	close(server->sock);
 	server->sock = -1;
 	return;
     }
 
     /* Initialize I/O buffer */
     iobuffer_init(&server->buffer, server->sock, server->sock,
-		  server->read_fds, server->write_fds, '\n');
+		  server->events, '\n');
 
     iobuffer_put_data(server->console, msg_connected,
 		      sizeof(msg_connected) - 1);
@@ -179,9 +180,6 @@ void server_connect(server_t *const server, const char *const nick,
     iobuffer_put_data(&server->buffer, "/connect ", 9);
     iobuffer_put_data(&server->buffer, nick, strlen(nick));
     iobuffer_put_data(&server->buffer, "\n", 1);
-
-    if (*server->num_fds <= server->sock)
-	*server->num_fds = server->sock + 1;
 }
 
 /*
@@ -203,6 +201,7 @@ void server_disconnect(server_t *const server)
  */
 void server_read(server_t *const server)
 {
+    int     len;  /* Read data length     */
     int     cmd;  /* Command return value */
     line_t *line; /* Read line            */
 
@@ -212,15 +211,16 @@ void server_read(server_t *const server)
 	return;
 
     /* Read data */
-    if (iobuffer_read(&server->buffer) == 0) {
+    if ((len = iobuffer_read(&server->buffer)) == 0 || len == -1) {
 	/* Disconnect */
 	iobuffer_put_data(server->console, msg_eof, sizeof(msg_eof) - 1);
 	server_free(server);
+	return;
     }
 
     cmd = 0;
     while (cmd == 0 &&
-	   (line = iobuffer_input_line(&server->buffer, 0)) != NULL) {
+	   (line = iobuffer_view_line(&server->buffer, 0)) != NULL) {
 	if (line->data[0] != '/')
 	    /* Message */
 	    iobuffer_put_data(server->console, line->data, line->length);
@@ -228,9 +228,8 @@ void server_read(server_t *const server)
 	    /* Command */
 	    cmd = cltcmd_exec(line->data + 1, CLTCMD_TYPE_SERVER,
 			      server->console, server, server->files);
-
-	free(line);
     }
+    iobuffer_release_line(&server->buffer);
 }
 
 /*
@@ -38,10 +38,8 @@
  * Headers
  */
 
-/* System headers */
-#include <sys/select.h> /* fd_set */
-
 /* Project headers */
+#include <events.h>
 #include <iobuffer.h>
 #include <hash.h>
 
@@ -60,13 +58,11 @@ struct files;
 
 /* Server managing structure */
 typedef struct server {
-    int           sock;      /* Socket descriptor      */
-    iobuffer_t    buffer;    /* Server I/O buffer      */
-    iobuffer_t   *console;   /* Console I/O buffer     */
-    struct files *files;     /* Files being transfered */
-    fd_set       *read_fds;  /* Read descriptor set    */
-    fd_set       *write_fds; /* Write descriptor set   */
-    int          *num_fds;   /* Number of descriptors  */
+    int           sock;    /* Socket descriptor      */
+    iobuffer_t    buffer;  /* Server I/O buffer      */
+    iobuffer_t   *console; /* Console I/O buffer     */
+    struct files *files;   /* Files being transfered */
+    events_t     *events;  /* Event manager          */
 } server_t;
 
 
@@ -76,8 +72,7 @@ typedef struct server {
 
 /* Constructors and destructors */
 void server_init(server_t *const server, iobuffer_t *const console,
-		 fd_set *const read_fds, fd_set *const write_fds,
-		 int *const num_fds, struct files *const files);
+		 events_t *const events, struct files *const files);
 void server_free(server_t *const server);
 
 /* Methods */
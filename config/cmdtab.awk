@@ -0,0 +1,114 @@
+# ----------------------------------------------------------------------------
+#
+# Minitalk: a basic talk-like server/client
+# Copyright (C) 2004 Benjamin Gaillard
+#
+# ----------------------------------------------------------------------------
+#
+#        File: config/cmdtab.awk
+#
+# Description: Command Table Perfect Hash Generator
+#
+#     Comment: Reads a C source file and, for each `static const command_t'
+#              table, outputs a command_table_t whose slots form a perfect
+#              hash of the command names (see command_find() in
+#              strlib/command.c, which must compute the same hash).
+#              Usage: awk -f cmdtab.awk file.c > file.tab
+#
+# ----------------------------------------------------------------------------
+#
+# This program is free software; you can redistribute it and/or modify it
+# under the terms of the GNU General Public License as published by the Free
+# Software Foundation; either version 2 of the License, or (at your option)
+# any later version.
+#
+# This program is distributed in the hope that it will be useful, but WITHOUT
+# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+# FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+# more details.
+#
+# You should have received a copy of the GNU General Public License along
+# with this program; if not, write to the Free Software Foundation, Inc., 59
+# Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+#
+# ----------------------------------------------------------------------------
+
+
+# Character codes and file header
+BEGIN {
+    for (i = 32; i < 127; i++)
+	ord[sprintf("%c", i)] = i
+    table = ""
+    printf "/* Generated from `%s' by cmdtab.awk: do not edit */\n", ARGV[1]
+}
+
+# Beginning of a table
+/^static const command_t [A-Za-z_0-9]+\[\] = \{/ {
+    table = $4
+    sub(/\[\]$/, "", table)
+    count = 0
+    next
+}
+
+# Table entry
+table != "" && /^[ \t]*\{"/ {
+    name = $0
+    sub(/^[ \t]*\{"/, "", name)
+    sub(/".*$/, "", name)
+    names[count++] = name
+    next
+}
+
+# End of a table
+table != "" && /^\};/ {
+    generate()
+    table = ""
+}
+
+# Key of a name (first, middle and last characters, and length)
+function key(name,    len) {
+    len = length(name)
+    return ord[substr(name, 1, 1)] + \
+	131 * ord[substr(name, int(len / 2) + 1, 1)] + \
+	17161 * ord[substr(name, len, 1)] + 7 * len
+}
+
+# Find a size and a seed without collisions, then output the table
+function generate(    size, seed, i, h, found, slot) {
+    for (size = 1; size < count; size *= 2)
+	;
+
+    found = 0
+    for (; !found && size <= 4096; size *= 2)
+	for (seed = 1; !found && seed < 1000; seed++) {
+	    found = 1
+	    for (h = 0; h < size; h++)
+		slot[h] = -1
+	    for (i = 0; found && i < count; i++) {
+		h = int(key(names[i]) * seed / 256) % size
+		if (slot[h] != -1)
+		    found = 0
+		slot[h] = i
+	    }
+	}
+
+    if (!found) {
+	printf "cmdtab.awk: no perfect hash for `%s'\n", table > "/dev/stderr"
+	exit 1
+    }
+    size /= 2
+    seed--
+
+    printf "\n/* Perfect hash of `%s' */\n", table
+    printf "static const command_slot_t %s_slots[] = {\n", table
+    for (h = 0; h < size; h++)
+	printf "    {%d, %d}%s\n", slot[h],
+	    slot[h] == -1 ? 0 : length(names[slot[h]]),
+	    h < size - 1 ? "," : ""
+    printf "};\n"
+    printf "static const command_table_t %s_table = {\n", table
+    printf "    %s, %s_slots, %d, %d\n", table, table, size - 1, seed
+    printf "};\n"
+}
+
+# End of file
@@ -48,6 +48,13 @@
 # define UNUSED
 #endif
 
+/* Variable with one instance per thread */
+#ifdef __GNUC__
+# define THREAD_LOCAL __thread
+#else
+# define THREAD_LOCAL
+#endif
+
 /* Redefinitions of functions related to memory allocation for debugging
    purposes (memory allocation tracing) */
 #if defined(DEBUG) && !defined(NDEBUG) && defined(HARDDEBUG)
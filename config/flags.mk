@@ -45,6 +45,7 @@ RANLIB   ?= ranlib
 RM       ?= rm -f
 MV       ?= mv -f
 LN       ?= ln -sf
+AWK      ?= awk
 
 # Default flags
 CFLAGS   ?= -O2 -fomit-frame-pointer -pipe
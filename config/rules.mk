@@ -61,9 +61,10 @@ CWD := $(shell pwd)
 INCLUDES ?=
 LIBS     ?=
 
-# Source and object files
+# Source, generated and object files
 SRC := $(strip $(SRC) $(wildcard *.c))
 HDR := $(strip $(HDR) $(wildcard *.h))
+GEN ?=
 OBJ := $(strip $(OBJ) $(SRC:.c=.o))
 
 # Resulting program
@@ -102,7 +103,7 @@ SUBDIRS := $(SUBDIRS) $(sort $(foreach file,$(MKFNAMES),$(subst /$(file),, \
 
 # User file suffixes
 .SUFFIXES:
-.SUFFIXES: .c .o .a
+.SUFFIXES: .c .o .a .tab
 
 # Rules not generating files
 .PHONY: default final debug all infos clean run depend depclean $(SUBDIRS)
@@ -119,6 +120,12 @@ SUBDIRS := $(SUBDIRS) $(sort $(foreach file,$(MKFNAMES),$(subst /$(file),, \
 	echo "Compiling \`$<'..."
 	$(CC) $(CFLAGS) $(WARN) $(CPPFLAGS) $(INCLUDES) -c $< -o $@
 
+# Generation of the perfect hashes of command tables
+%.tab: %.c $(TOPDIR)/config/cmdtab.awk
+	echo "Generating \`$@'..."
+	$(AWK) -f $(TOPDIR)/config/cmdtab.awk $< > $@.tmp
+	$(MV) $@.tmp $@
+
 # Build a library in another directory
 %.a: $(RULEFILE)
 	echo "** Building \`$@'; entering directory $(dir $@) **"
@@ -194,7 +201,7 @@ $(SUBDIRS):
 clean: TARGET = clean
 clean: $(SUBDIRS) depclean
 	echo 'Cleaning up directory...'
-	$(RM) $(OBJ) $(LIB) $(EXE) $(DEPFILE).bak *~ \#*\#
+	$(RM) $(OBJ) $(LIB) $(EXE) $(GEN) $(DEPFILE).bak *~ \#*\#
 	$(RM) core $(addsuffix .core,$(EXE))
 
 # Launch the program
@@ -36,26 +36,32 @@
  *
  */
 
+/* Feature test macros (accept4()) */
+#define _GNU_SOURCE
+
 /* System headers */
 #include <stdlib.h> /* malloc(), free(), NULL */
 #include <stdio.h>  /* sprintf(), snprintf()  */
 #include <unistd.h> /* close()                */
+#include <fcntl.h>  /* fcntl(), O_NONBLOCK    */
 #include <string.h> /* strcmp(), strlen()     */
 #include <assert.h> /* assert()               */
 
 /* Network-related headers */
-#include <sys/socket.h> /* accept()           */
-#include <sys/select.h> /* fd_set, FD_*()     */
+#include <sys/socket.h> /* accept(), accept4()  */
 #include <netinet/in.h> /* struct sockaddr_in */
-#include <arpa/inet.h>  /* inet_ntoa()        */
+#include <arpa/inet.h>  /* inet_ntop()        */
 
 /* Project headers */
 #include <common.h>
+#include <events.h>
+#include <segment.h>
 #include <iobuffer.h>
-#include <hash.h>
 #include <command.h>
 #include "srvcmd.h"
+#include "registry.h"
 #include "clients.h"
+#include "workers.h"
 
 
 /*****************************************************************************
@@ -71,6 +77,14 @@ static int client_input_lines(client_t *const client,
 static int client_auth_command(client_t *const client,
 			       clients_t *const clients, int argc,
 			       char **const argv);
+static void clients_unqueue(clients_t *const clients,
+			    client_t *const client);
+static int clients_grow(clients_t *const clients, client_t *const block,
+			const int count);
+static client_t *clients_slot(const clients_t *const clients,
+			      const int slot);
+static void clients_limit_output(clients_t *const clients,
+				 client_t *const client);
 
 /*
  * Verify nickname correctness.
@@ -93,10 +107,10 @@ static int verify_nick(const char *const nick)
 static int client_input_lines(client_t *const client,
 			      clients_t *const clients)
 {
-    line_t *line;      /* Input line        */
-    int     arg_count; /* Argument count    */
-    int     len;       /* Command length    */
-    char  **args;      /* Command arguments */
+    line_t *line;                   /* Input line        */
+    int     arg_count;              /* Argument count    */
+    int     len;                    /* Command length    */
+    char   *args[COMMAND_MAX_ARGS]; /* Command arguments */
 
     /* Authentication message */
     static const char msg_auth[] = "You are not authenticated yet.  Use "
@@ -108,10 +122,10 @@ static int client_input_lines(client_t *const client,
 
     len = client->nick_len;
 
-    while ((line = iobuffer_input_line(&client->buffer, len + 2)) != NULL) {
+    while ((line = iobuffer_view_line(&client->buffer, len + 2)) != NULL) {
 	if (line->data[0] != '/') {
 	    /* Message */
-	    if (client->nick_len > 0) {
+	    if (clients->hot[client->slot].state == CLIENT_AUTHENTICATED) {
 		memcpy(line->start, client->nick, len);
 		line->start[len] = ':';
 		line->start[len + 1] = ' ';
@@ -123,26 +137,26 @@ static int client_input_lines(client_t *const client,
 				  sizeof(msg_auth) - 1);
 	} else {
 	    /* Command */
-	    if (client->nick_len > 0)
+	    if (clients->hot[client->slot].state == CLIENT_AUTHENTICATED)
 		srvcmd_exec(line->data + 1, SRVCMD_TYPE_CLIENT,
 			    clients->console, &client->buffer, clients,
 			    client);
 	    else {
-		arg_count = command_get_tokens(line->data + 1, &args);
+		arg_count = command_get_tokens(line->data + 1, args,
+					       COMMAND_MAX_ARGS);
 
 		if (client_auth_command(client, clients, arg_count, args)
 		    == 1)
 		    iobuffer_put_data(&client->buffer, msg_auth,
 				      sizeof(msg_auth) - 1);
-
-		if (args != NULL)
-		    free(args);
 	    }
 	}
-
-	free(line);
     }
 
+    /* Replies may have been queued for this client */
+    if (iobuffer_get_output_size(&client->buffer) != 0)
+	clients_dirty(clients, client);
+
     return 0;
 }
 
@@ -153,8 +167,11 @@ static int client_auth_command(client_t *const client,
 			       clients_t *const clients, int arg_count,
 			       char **const args)
 {
-    int   len;    /* Nickname length */
-    char *buffer; /* String buffer   */
+    int   len;                    /* Nickname length     */
+    int   size;                   /* String buffer size  */
+    int   error;                  /* Registration error  */
+    char *buffer;                 /* String buffer       */
+    char  local[CLIENT_MSG_SIZE]; /* Local string buffer */
 
     /* Messages */
     static const char msg_syntax[] = "Command error.  Syntax: "
@@ -189,31 +206,49 @@ static int client_auth_command(client_t *const client,
 	return 3;
     }
 
-    /* Verify if nickname is not already taken */
-    if (hash_find(&clients->hash, args[1]) != NULL) {
-	iobuffer_put_data(&client->buffer, msg_taken, sizeof(msg_taken) - 1);
+    /* Messages are formatted on the stack unless the nickname is long */
+    size = client->addr_len + len + 32;
+    if (size <= (int) sizeof(local))
+	buffer = local;
+    else if ((buffer = malloc(size)) == NULL) {
+	iobuffer_put_data(&client->buffer, msg_mem, sizeof(msg_mem) - 1);
 	return 4;
     }
 
-    /* Allocate memory for nickname */
-    if ((client->nick = malloc(len + 1)) == NULL) {
+    /* Short nicknames are stored in the client structure */
+    if (len < CLIENT_NICK_SIZE)
+	client->nick = client->nick_buf;
+    else if ((client->nick = malloc(len + 1)) == NULL) {
+	if (buffer != local)
+	    free(buffer);
 	iobuffer_put_data(&client->buffer, msg_mem, sizeof(msg_mem) - 1);
 	return 5;
     }
     memcpy(client->nick, args[1], len + 1);
 
-    /* Allocate memory for buffer */
-    if ((buffer = malloc(client->addr_len + len + 32)) == NULL) {
-	free(client->nick);
+    /* Register the nickname, unless it is taken (maybe by a client of
+     * another worker at the same time) */
+    client->entry.worker = clients->worker->index;
+    client->entry.slot = client->slot;
+    client->entry.generation = clients->hot[client->slot].generation;
+    if ((error = registry_add(clients->registry, client->nick,
+			      &client->entry)) != 0) {
+	if (client->nick != client->nick_buf)
+	    free(client->nick);
 	client->nick = NULL;
+	if (buffer != local)
+	    free(buffer);
+	if (error == -1) {
+	    iobuffer_put_data(&client->buffer, msg_taken,
+			      sizeof(msg_taken) - 1);
+	    return 6;
+	}
 	iobuffer_put_data(&client->buffer, msg_mem, sizeof(msg_mem) - 1);
-	return 6;
+	return 7;
     }
 
     client->nick_len = len;
-
-    /* Add this client in the hash table */
-    hash_add(&clients->hash, client->nick, client, &client->hash_elm);
+    clients->hot[client->slot].state = CLIENT_AUTHENTICATED;
 
     /* Send a message to other clients */
     sprintf(buffer, "** %s connected.\n", client->nick);
@@ -229,12 +264,145 @@ static int client_auth_command(client_t *const client,
     iobuffer_put_data(&client->buffer, buffer, len + 12);
 
     /* Free buffer */
-    free(buffer);
+    if (buffer != local)
+	free(buffer);
 
     return 0;
 }
 
 
+/*
+ * Remove a client from the output queue.
+ */
+static void clients_unqueue(clients_t *const clients,
+			    client_t *const client)
+{
+    assert(clients != NULL);
+    assert(client != NULL);
+
+    if (!client->dirty)
+	return;
+
+    if (client->dirty_prev != NULL)
+	client->dirty_prev->dirty_next = client->dirty_next;
+    else
+	clients->dirty_first = client->dirty_next;
+
+    if (client->dirty_next != NULL)
+	client->dirty_next->dirty_prev = client->dirty_prev;
+    else
+	clients->dirty_last = client->dirty_prev;
+
+    client->dirty = 0;
+}
+
+/*
+ * Add free slots stored in a block of client structures.
+ */
+static int clients_grow(clients_t *const clients, client_t *const block,
+			const int count)
+{
+    int           i;          /* Slot counter   */
+    int           capacity;   /* New capacity   */
+    client_t    **chunks;     /* Chunk table    */
+    client_hot_t *hot;        /* Hot fields     */
+    int          *free_slots; /* Free slot list */
+
+    assert(clients != NULL);
+    assert(block != NULL);
+    assert(count > 0 && count % CLIENTS_CHUNK == 0);
+
+    capacity = clients->capacity + count;
+
+    /* Client structures never move: they are referenced from elsewhere */
+    if ((chunks = realloc(clients->chunks, capacity / CLIENTS_CHUNK
+			  * sizeof(client_t *))) == NULL)
+	return -1;
+    clients->chunks = chunks;
+
+    /* Hot fields and the free list are only accessed by slot index */
+    if ((hot = realloc(clients->hot, capacity * sizeof(client_hot_t)))
+	== NULL)
+	return -1;
+    clients->hot = hot;
+    if ((free_slots = realloc(clients->free_slots, capacity * sizeof(int)))
+	== NULL)
+	return -1;
+    clients->free_slots = free_slots;
+
+    for (i = 0; i < count; i += CLIENTS_CHUNK)
+	chunks[(clients->capacity + i) / CLIENTS_CHUNK] = block + i;
+
+    /* Lowest slots are taken first */
+    for (i = capacity - 1; i >= clients->capacity; i--) {
+	hot[i].fd = -1;
+	hot[i].state = CLIENT_FREE;
+	hot[i].generation = 0;
+	block[i - clients->capacity].slot = i;
+	free_slots[clients->free_count++] = i;
+    }
+    clients->capacity = capacity;
+
+    return 0;
+}
+
+/*
+ * Apply the policy to a client whose pending output exceeds the limit.
+ */
+static void clients_limit_output(clients_t *const clients,
+				 client_t *const client)
+{
+    int  count;          /* Number of dropped messages */
+    int  len;            /* String length              */
+    char str_buffer[64]; /* String buffer              */
+
+    assert(clients != NULL);
+    assert(client != NULL);
+
+    switch (clients->policy) {
+    case CLIENTS_POLICY_DROP:
+    case CLIENTS_POLICY_COALESCE:
+	/* Drop the oldest broadcast messages (not partially written) */
+	count = iobuffer_drop_output(&client->buffer, clients->output_low);
+	__atomic_add_fetch(&clients->dropped, count, __ATOMIC_RELAXED);
+
+	if (count != 0 && clients->policy == CLIENTS_POLICY_COALESCE) {
+	    len = snprintf(str_buffer, sizeof(str_buffer),
+			   "** %d message(s) dropped.\n", count);
+	    iobuffer_put_data(&client->buffer, str_buffer, len);
+	}
+
+	/* Only replies are left (or rings, which cannot drop messages) */
+	if (iobuffer_get_output_size(&client->buffer) <= clients->output_high)
+	    break;
+	/* Fall through */
+
+    case CLIENTS_POLICY_DISCONNECT:
+	/* The client is removed once its (discarded) output is written */
+	iobuffer_discard_output(&client->buffer);
+	clients_disconnect(clients, client);
+	__atomic_add_fetch(&clients->evicted, 1, __ATOMIC_RELAXED);
+
+	len = snprintf(str_buffer, sizeof(str_buffer),
+		       "Client `%.32s' is too slow; disconnected.\n",
+		       client->nick);
+	iobuffer_put_data(clients->console, str_buffer, len);
+    }
+}
+
+/*
+ * Get the client structure of a slot.
+ */
+static client_t *clients_slot(const clients_t *const clients,
+			      const int slot)
+{
+    assert(clients != NULL);
+    assert(slot >= 0 && slot < clients->capacity);
+
+    return clients->chunks[slot / CLIENTS_CHUNK] + slot % CLIENTS_CHUNK;
+}
+
+
 /*****************************************************************************
  *
  * Public functions
@@ -244,19 +412,34 @@ static int client_auth_command(client_t *const client,
 /*
  * Initialize the client manager.
  */
-void clients_init(clients_t *const clients, fd_set *const read_fds,
-		  fd_set *const write_fds, struct iobuffer *const console,
-		  const int srv_sock)
+void clients_init(clients_t *const clients, events_t *const events,
+		  struct iobuffer *const console, const int srv_sock,
+		  struct worker *const worker)
 {
+    assert(clients != NULL);
+    assert(worker != NULL);
+
     clients->number = 0;
-    clients->first = NULL;
-    clients->last = NULL;
-    clients->read_fds = read_fds;
-    clients->write_fds = write_fds;
+    clients->capacity = 0;
+    clients->high = 0;
+    clients->hot = NULL;
+    clients->chunks = NULL;
+    clients->arena = NULL;
+    clients->reserved = 0;
+    clients->free_slots = NULL;
+    clients->free_count = 0;
+    clients->dirty_first = NULL;
+    clients->dirty_last = NULL;
+    clients->events = events;
     clients->console = console;
     clients->srv_sock = srv_sock;
-
-    hash_init(&clients->hash);
+    clients->output_high = CLIENTS_OUTPUT_HIGH;
+    clients->output_low = CLIENTS_OUTPUT_LOW;
+    clients->policy = CLIENTS_POLICY_COALESCE;
+    clients->dropped = 0;
+    clients->evicted = 0;
+    clients->worker = worker;
+    clients->registry = &worker->workers->registry;
 }
 
 /*
@@ -264,26 +447,98 @@ void clients_init(clients_t *const clients, fd_set *const read_fds,
  */
 void clients_free(clients_t *const clients)
 {
-    client_t *client; /* Current client  */
-    client_t *prev;   /* Previous client */
+    int       slot;   /* Current slot   */
+    client_t *client; /* Current client */
 
     assert(clients != NULL);
 
     /* Disconnect each client */
-    client = clients->first;
-    while (client != NULL) {
-	close(iobuffer_get_input_fd(&client->buffer));
+    for (slot = 0; slot < clients->high; slot++) {
+	if (clients->hot[slot].state == CLIENT_FREE)
+	    continue;
+
+	client = clients_slot(clients, slot);
+	events_remove(clients->events, clients->hot[slot].fd);
+	close(clients->hot[slot].fd);
 	iobuffer_free(&client->buffer);
-	if (client->nick != NULL)
-	    free(client->nick);
 
-	prev = client;
-	client = client->next;
-	free(prev);
+	/* Other workers must not find the nickname any more */
+	if (client->nick != NULL) {
+	    registry_remove(clients->registry, client->nick, &client->entry);
+	    if (client->nick != client->nick_buf)
+		free(client->nick);
+	}
     }
+    registry_add_connected(clients->registry, -clients->number);
+
+    /* Chunks of the arena are freed with it */
+    for (slot = clients->reserved; slot < clients->capacity;
+	 slot += CLIENTS_CHUNK)
+	free(clients->chunks[slot / CLIENTS_CHUNK]);
+    free(clients->arena);
+    free(clients->chunks);
+    free(clients->hot);
+    free(clients->free_slots);
+
     clients->number = 0;
+    clients->capacity = 0;
+    clients->high = 0;
+    clients->hot = NULL;
+    clients->chunks = NULL;
+    clients->arena = NULL;
+    clients->reserved = 0;
+    clients->free_slots = NULL;
+    clients->free_count = 0;
+    clients->dirty_first = NULL;
+    clients->dirty_last = NULL;
+}
+
+/*
+ * Allocate client slots and their first input chunks in advance.
+ */
+int clients_reserve(clients_t *const clients, const int count)
+{
+    int       size;  /* Number of slots */
+    client_t *arena; /* Slot storage    */
+
+    assert(clients != NULL);
+    assert(clients->capacity == 0);
+    assert(count > 0);
+
+    /* All the slots are taken from a single block */
+    size = (count + CLIENTS_CHUNK - 1) / CLIENTS_CHUNK * CLIENTS_CHUNK;
+    if ((arena = malloc(size * sizeof(client_t))) == NULL)
+	return -1;
+    if (clients_grow(clients, arena, size) != 0) {
+	free(arena);
+	return -1;
+    }
+    clients->arena = arena;
+    clients->reserved = size;
 
-    hash_free(&clients->hash);
+    /* Disconnected clients give their chunks back to the buffer pool */
+    if (dbuffer_pool_reserve(count) != count)
+	return -1;
+
+    return 0;
+}
+
+/*
+ * Set the watermarks of pending output per client (high is 0 for no limit)
+ * and the policy applied when it exceeds the high one.
+ */
+void clients_set_output_limit(clients_t *const clients, const int high,
+			      const int low, const clients_policy_t policy)
+{
+    assert(clients != NULL);
+    assert(high >= 0 && low >= 0 && low <= high);
+    assert(policy == CLIENTS_POLICY_DROP ||
+	   policy == CLIENTS_POLICY_COALESCE ||
+	   policy == CLIENTS_POLICY_DISCONNECT);
+
+    clients->output_high = high;
+    clients->output_low = low;
+    clients->policy = policy;
 }
 
 /*
@@ -291,24 +546,58 @@ void clients_free(clients_t *const clients)
  */
 int clients_add(clients_t *const clients)
 {
-    int                sock;       /* Socket descriptor */
-    int                len;        /* String length     */
-    client_t          *client;     /* Current client    */
-    char              *ip;         /* IP address        */
-    socklen_t          addr_len;   /* Address length    */
-    struct sockaddr_in addr;       /* Client address    */
-    char               buffer[43]; /* String buffer     */
+    int                sock;                /* Socket descriptor */
+    int                len;                 /* String length     */
+    int                slot;                /* Client slot       */
+    client_t          *client;              /* Current client    */
+    client_t          *chunk;               /* New slot chunk    */
+    socklen_t          addr_len;            /* Address length    */
+    struct sockaddr_in addr;                /* Client address    */
+    char               ip[INET_ADDRSTRLEN]; /* IP address        */
+    char               buffer[43];          /* String buffer     */
 
     assert(clients != NULL);
 
-    /* Allocate memory for the new client structure */
-    if ((client = malloc(sizeof(client_t))) == NULL)
+    /* Make sure there is a free slot for the new client */
+    if (clients->free_count == 0) {
+	if ((chunk = malloc(CLIENTS_CHUNK * sizeof(client_t))) == NULL)
+	    return -1;
+	if (clients_grow(clients, chunk, CLIENTS_CHUNK) != 0) {
+	    free(chunk);
+	    return -1;
+	}
+    }
+
+    /* Accept the connection (fails if there is none pending); a client
+     * which does not read its data must not block the server */
+    addr_len = sizeof(addr);
+#ifdef SOCK_NONBLOCK
+    if ((sock = accept4(clients->srv_sock, (struct sockaddr *) &addr,
+			&addr_len, SOCK_NONBLOCK | SOCK_CLOEXEC)) == -1)
 	return -1;
+#else
+    if ((sock = accept(clients->srv_sock, (struct sockaddr *) &addr,
+		       &addr_len)) == -1)
+	return -1;
+    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK);
+    fcntl(sock, F_SETFD, FD_CLOEXEC);
+#endif
+
+    /* Watch the new socket */
+    if (events_watch(clients->events, sock, EVENTS_READ) != 0) {
+	close(sock);
+	return -1;
+    }
+
+    /* Take a free slot */
+    slot = clients->free_slots[--clients->free_count];
+    client = clients_slot(clients, slot);
+    clients->hot[slot].fd = sock;
+    clients->hot[slot].state = CLIENT_CONNECTED;
+    if (slot >= clients->high)
+	clients->high = slot + 1;
 
-    /* Accept the connection */
-    addr_len = sizeof(client->addr);
-    sock = accept(clients->srv_sock, (struct sockaddr *) &addr, &addr_len);
-    ip = inet_ntoa(addr.sin_addr);
+    inet_ntop(AF_INET, &addr.sin_addr, ip, sizeof(ip));
     snprintf(client->addr, sizeof(client->addr), "%s:%d%n", ip,
 	     ntohs(addr.sin_port), &client->addr_len);
 
@@ -318,124 +607,171 @@ int clients_add(clients_t *const clients)
     iobuffer_put_data(clients->console, buffer, len);
 
     /* Initialize the structure */
-    client->next = NULL;
-    client->prev = clients->last;
-    iobuffer_init(&client->buffer, sock, sock, clients->read_fds,
-		  clients->write_fds, '\n');
+    client->dirty = 0;
+    iobuffer_init(&client->buffer, sock, sock, clients->events, '\n');
+    events_set_data(clients->events, sock, client);
     client->nick = NULL;
     client->nick_len = 0;
-
-    /* Add this new element to the linked list */
-    if (clients->first != NULL)
-	clients->last->next = client;
-    else
-	clients->first = client;
-    clients->last = client;
     clients->number++;
+    registry_add_connected(clients->registry, 1);
 
     return sock;
 }
 
+/*
+ * Accept pending connections, at most CLIENTS_ACCEPT_MAX at once.
+ */
+int clients_accept(clients_t *const clients)
+{
+    int count; /* Number of accepted clients */
+
+    assert(clients != NULL);
+
+    /* The server socket is non-blocking: stop when no more are pending */
+    for (count = 0; count < CLIENTS_ACCEPT_MAX; count++)
+	if (clients_add(clients) == -1)
+	    break;
+
+    return count;
+}
+
 /*
  * Remove a disconnected client.
  */
 void clients_remove(clients_t *const clients, client_t *const client)
 {
-    int   sock;       /* Socket descriptor */
-    int   len;        /* String length     */
-    char *name;       /* Client name       */
-    char *str_buffer; /* String buffer     */
+    int   sock;                   /* Socket descriptor   */
+    int   len;                    /* String length       */
+    char *name;                   /* Client name         */
+    char *str_buffer;             /* String buffer       */
+    char  local[CLIENT_MSG_SIZE]; /* Local string buffer */
 
     assert(client != NULL);
     assert(clients != NULL);
     assert(clients->number != 0);
 
-    sock = iobuffer_get_input_fd(&client->buffer);
+    assert(clients->hot[client->slot].state != CLIENT_FREE);
+
+    sock = clients->hot[client->slot].fd;
 
     /* Close socket */
+    events_remove(clients->events, sock);
     close(sock);
-    FD_CLR(sock, iobuffer_get_read_fds(&client->buffer));
     iobuffer_free(&client->buffer);
 
     /* Broadcast a message to tell that the client disconnected */
     name = client->nick != NULL ? client->nick : client->addr;
     len = strlen(name) + 25;
-    if ((str_buffer = malloc(len)) != NULL) {
+    str_buffer = len <= (int) sizeof(local) ? local : malloc(len);
+    if (str_buffer != NULL) {
 	snprintf(str_buffer, len, "Client `%s' disconnected.\n", name);
 	iobuffer_put_data(clients->console, str_buffer, len);
 
-	if (client->nick_len > 0) {
+	if (clients->hot[client->slot].state == CLIENT_AUTHENTICATED) {
 	    snprintf(str_buffer, len, "** %s disconnected.\n", name);
 	    clients_send(clients, str_buffer, len - 6, client);
 	}
 
-	free(str_buffer);
+	if (str_buffer != local)
+	    free(str_buffer);
     }
 
-    /* Remove the client from the hash table */
+    /* Unregister the nickname */
     if (client->nick != NULL) {
-	hash_remove(&clients->hash, &client->hash_elm);
-	free(client->nick);
+	registry_remove(clients->registry, client->nick, &client->entry);
+	if (client->nick != client->nick_buf)
+	    free(client->nick);
     }
 
-    /* Unlink the client from the linked list */
-    if (client->prev != NULL)
-	client->prev->next = client->next;
-    else
-	clients->first = client->next;
-
-    if (client->next != NULL)
-	client->next->prev = client->prev;
-    else
-	clients->last = client->prev;
-
-    free(client);
+    /* Unlink the client from the output queue and free its slot */
+    clients_unqueue(clients, client);
+    clients->hot[client->slot].fd = -1;
+    clients->hot[client->slot].state = CLIENT_FREE;
+    clients->hot[client->slot].generation++;
+    clients->free_slots[clients->free_count++] = client->slot;
+    while (clients->high > 0 &&
+	   clients->hot[clients->high - 1].state == CLIENT_FREE)
+	clients->high--;
     clients->number--;
+    registry_add_connected(clients->registry, -1);
 }
 
 /*
  * Disconnect a client before removing it.
  */
-void clients_disconnect(client_t *const client)
+void clients_disconnect(clients_t *const clients, client_t *const client)
+{
+    assert(clients != NULL);
+    assert(client != NULL);
+
+    clients->hot[client->slot].state = CLIENT_CLOSING;
+
+    events_unwatch(clients->events, clients->hot[client->slot].fd,
+		   EVENTS_READ);
+
+    /* The client is removed once its output is written */
+    clients_dirty(clients, client);
+}
+
+/*
+ * Queue a client which has pending output.
+ */
+void clients_dirty(clients_t *const clients, client_t *const client)
 {
+    assert(clients != NULL);
     assert(client != NULL);
 
-    client->nick_len = -1;
+    if (client->dirty)
+	return;
 
-    FD_CLR(iobuffer_get_input_fd(&client->buffer),
-	   iobuffer_get_read_fds(&client->buffer));
+    /* Append the client to the output queue */
+    client->dirty = 1;
+    client->dirty_next = NULL;
+    client->dirty_prev = clients->dirty_last;
+    if (clients->dirty_last != NULL)
+	clients->dirty_last->dirty_next = client;
+    else
+	clients->dirty_first = client;
+    clients->dirty_last = client;
 }
 
 /*
- * Read data from clients.
+ * Read data from clients reported ready by the event manager.
  */
 int clients_read(clients_t *const clients)
 {
-    int       error;  /* Error indicator  */
-    int       len;    /* Read data length */
-    client_t *client; /* Current client   */
-    client_t *next;   /* Next client      */
+    int       error;  /* Error indicator      */
+    int       len;    /* Read data length     */
+    int       i;      /* Index in ready list  */
+    int       count;  /* Number of ready fds  */
+    int       fd;     /* Ready descriptor     */
+    client_t *client; /* Current client       */
 
     assert(clients != NULL);
     assert(clients->console != NULL);
 
     error = 0;
+    count = events_get_ready_count(clients->events);
 
-    /* Input data for each client */
-    for (client = clients->first; client != NULL; client = next) {
-	next = client->next;
+    /* Input data for each ready client */
+    for (i = 0; i < count; i++) {
+	fd = events_get_ready_fd(clients->events, i);
 
-	if (client->nick_len != -1) {
-	    len = iobuffer_read(&client->buffer);
+	/* Skip other descriptors and clients removed in the meantime */
+	if (!events_is_ready(clients->events, fd, EVENTS_READ) ||
+	    (client = events_get_data(clients->events, fd)) == NULL ||
+	    clients->hot[client->slot].state == CLIENT_CLOSING)
+	    continue;
 
-	    if (len > 0) {
-		if (client_input_lines(client, clients) != 0)
-		    error = 1;
-	    } else if (len != -2) {
-		clients_remove(clients, client);
-		if (len == -1)
-		    error = 1;
-	    }
+	len = iobuffer_read(&client->buffer);
+
+	if (len > 0) {
+	    if (client_input_lines(client, clients) != 0)
+		error = 1;
+	} else if (len != -2) {
+	    clients_remove(clients, client);
+	    if (len == -1)
+		error = 1;
 	}
     }
 
@@ -443,30 +779,38 @@ int clients_read(clients_t *const clients)
 }
 
 /*
- * Write data to clients.
+ * Write data to clients in the output queue.
  */
 int clients_write(clients_t *const clients)
 {
     int       error;  /* Error indicator */
     client_t *client; /* Current client  */
-    client_t *prev;   /* Previous client */
+    client_t *next;   /* Next client     */
 
     assert(clients != NULL);
 
     error = 0;
 
-    /* Output data for each client */
-    client = clients->first;
+    /* Take the whole queue: clients still having output are queued again */
+    client = clients->dirty_first;
+    clients->dirty_first = NULL;
+    clients->dirty_last = NULL;
+
+    /* Output data for each queued client */
     while (client != NULL) {
-	if (iobuffer_write(&client->buffer) == -1)
+	next = client->dirty_next;
+	client->dirty = 0;
+
+	/* The connection is lost: its output can never be written */
+	if (iobuffer_write(&client->buffer) == -1) {
 	    error = 1;
-	if (client->nick_len == -1 &&
-	    iobuffer_get_output_size(&client->buffer) == 0) {
-	    prev = client;
-	    client = client->next;
-	    clients_remove(clients, prev);
-	} else
-	    client = client->next;
+	    clients_remove(clients, client);
+	} else if (iobuffer_get_output_size(&client->buffer) != 0)
+	    clients_dirty(clients, client);
+	else if (clients->hot[client->slot].state == CLIENT_CLOSING)
+	    clients_remove(clients, client);
+
+	client = next;
     }
 
     return error;
@@ -477,54 +821,213 @@ int clients_write(clients_t *const clients)
  */
 void clients_flush(const clients_t *const clients)
 {
+    int       slot;   /* Current slot   */
     client_t *client; /* Current client */
 
     assert(clients != NULL);
 
-    /* Flush all buffers */
-    for (client = clients->first; client != NULL; client = client->next) {
-	FD_SET(iobuffer_get_output_fd(&client->buffer), clients->write_fds);
-	iobuffer_write(&client->buffer);
-    }
+    /* Flush all buffers (write without waiting for readiness) */
+    for (slot = 0; slot < clients->high; slot++)
+	if (clients->hot[slot].state != CLIENT_FREE) {
+	    client = clients_slot(clients, slot);
+	    iobuffer_set_events(&client->buffer, NULL);
+	    iobuffer_write(&client->buffer);
+	}
 }
 
 /*
- * Send a message to one or all clients
+ * Send a message to all clients but one, those of other workers too.
  */
-int clients_send(const clients_t *const clients, const char *data,
+int clients_send(clients_t *const clients, const char *data,
 		 const int length, const client_t *const except)
 {
-    int       error;  /* Error indicator */
-    client_t *client; /* Current client  */
+    assert(clients != NULL);
+    assert(data != NULL);
+
+    worker_broadcast(clients->worker, data, length);
+    return clients_deliver(clients, data, length, except);
+}
+
+/*
+ * Send data to a client found by its nickname.  Returns -1 if there is no
+ * such client.
+ */
+int clients_send_to(clients_t *const clients, const char *const nick,
+		    const char *const data, const int length)
+{
+    registry_entry_t entry;  /* Location of the client */
+    client_handle_t  handle; /* Client in its worker   */
+
+    assert(clients != NULL);
+    assert(nick != NULL);
+    assert(data != NULL);
+
+    if (registry_find(clients->registry, nick, &entry) != 0)
+	return -1;
+    handle.slot = entry.slot;
+    handle.generation = entry.generation;
+
+    /* Clients of other workers are reached through their message queue */
+    if (entry.worker != clients->worker->index)
+	return worker_post(clients->worker, entry.worker, WORKER_MSG_DIRECT,
+			   handle, data, length) != 0;
+    return clients_deliver_to(clients, handle, data, length);
+}
+
+/*
+ * Kill a client found by its nickname.  Returns -1 if there is no such
+ * client.
+ */
+int clients_kill(clients_t *const clients, const char *const nick)
+{
+    registry_entry_t entry;  /* Location of the client */
+    client_handle_t  handle; /* Client in its worker   */
+
+    assert(clients != NULL);
+    assert(nick != NULL);
+
+    if (registry_find(clients->registry, nick, &entry) != 0)
+	return -1;
+    handle.slot = entry.slot;
+    handle.generation = entry.generation;
+
+    if (entry.worker != clients->worker->index)
+	return worker_post(clients->worker, entry.worker, WORKER_MSG_KILL,
+			   handle, NULL, 0) != 0;
+    return clients_deliver_kill(clients, handle);
+}
+
+/*
+ * Send a message to all the clients of this worker but one.
+ */
+int clients_deliver(clients_t *const clients, const char *data,
+		    const int length, const client_t *const except)
+{
+    int        error;   /* Error indicator        */
+    int        slot;    /* Current slot           */
+    client_t  *client;  /* Current client         */
+    segment_t *segment; /* Message shared by all  */
 
     assert(clients != NULL);
     assert(data != NULL);
 
+    /* Copy the message once: output buffers only reference it */
+    if ((segment = segment_new(data, length)) == NULL)
+	return 1;
+
     error = 0;
 
-    /* For each client */
-    for (client = clients->first; client != NULL; client = client->next)
-	/* Client must be authenticated */
-	if (client != except && client->nick_len > 0)
+    /* For each authenticated client (only hot fields are scanned) */
+    for (slot = 0; slot < clients->high; slot++)
+	if (clients->hot[slot].state == CLIENT_AUTHENTICATED &&
+	    (except == NULL || slot != except->slot)) {
 	    /* Send message */
-	    if (iobuffer_put_data(&client->buffer, data, length) != length)
+	    client = clients_slot(clients, slot);
+	    if (iobuffer_put_segment(&client->buffer, segment) != length)
 		error = 1;
+	    clients_dirty(clients, client);
+
+	    /* Do not let output grow for clients which do not read it */
+	    if (clients->output_high != 0 &&
+		iobuffer_get_output_size(&client->buffer)
+		> clients->output_high)
+		clients_limit_output(clients, client);
+	}
 
+    segment_release(segment);
     return error;
 }
 
 /*
- * Find a client by its name.
+ * Send data to an authenticated client of this worker.  Returns -1 if it
+ * has left in the meantime.
+ */
+int clients_deliver_to(clients_t *const clients,
+		       const client_handle_t handle, const char *const data,
+		       const int length)
+{
+    client_t *client; /* Target client */
+
+    assert(clients != NULL);
+    assert(data != NULL);
+
+    if ((client = clients_get_client(clients, handle)) == NULL ||
+	clients->hot[handle.slot].state != CLIENT_AUTHENTICATED)
+	return -1;
+
+    iobuffer_put_data(&client->buffer, data, length);
+    clients_dirty(clients, client);
+    return 0;
+}
+
+/*
+ * Kill an authenticated client of this worker.  Returns -1 if it has left in
+ * the meantime.
  */
-client_t *clients_get_client_from_name(const clients_t *const clients,
-				       const char *const name)
+int clients_deliver_kill(clients_t *const clients,
+			 const client_handle_t handle)
 {
-    hash_element_t *element; /* Hash table element */
+    int       len;                    /* String buffer size  */
+    client_t *client;                 /* Killed client       */
+    char     *str_buffer;             /* String buffer       */
+    char      local[CLIENT_MSG_SIZE]; /* Local string buffer */
+
+    static const char msg_you[] = "** You have been killed.\n";
+
+    assert(clients != NULL);
+
+    if ((client = clients_get_client(clients, handle)) == NULL ||
+	clients->hot[handle.slot].state != CLIENT_AUTHENTICATED)
+	return -1;
+
+    iobuffer_put_data(&client->buffer, msg_you, sizeof(msg_you) - 1);
+
+    /* Tell the others (the client is disconnected anyway) */
+    len = client->nick_len + 22;
+    str_buffer = len <= (int) sizeof(local) ? local : malloc(len);
+    if (str_buffer != NULL) {
+	snprintf(str_buffer, len, "** %s has been killed.\n", client->nick);
+	clients_send(clients, str_buffer, len - 1, client);
+	iobuffer_put_data(clients->console, str_buffer + 3, len - 4);
+
+	if (str_buffer != local)
+	    free(str_buffer);
+    }
+
+    clients_disconnect(clients, client);
+    return 0;
+}
+
+/*
+ * Get a handle on a client.
+ */
+client_handle_t clients_get_handle(const clients_t *const clients,
+				   const client_t *const client)
+{
+    client_handle_t handle; /* Client handle */
+
+    assert(clients != NULL);
+    assert(client != NULL);
+    assert(clients->hot[client->slot].state != CLIENT_FREE);
+
+    handle.slot = client->slot;
+    handle.generation = clients->hot[client->slot].generation;
+    return handle;
+}
+
+/*
+ * Get the client referenced by a handle (NULL if it has been removed).
+ */
+client_t *clients_get_client(const clients_t *const clients,
+			     const client_handle_t handle)
+{
+    assert(clients != NULL);
 
-    /* Search name */
-    if ((element = hash_find(&clients->hash, name)) != NULL)
-	return (client_t *) element->object;
-    return NULL;
+    if (handle.slot < 0 || handle.slot >= clients->capacity ||
+	clients->hot[handle.slot].state == CLIENT_FREE ||
+	clients->hot[handle.slot].generation != handle.generation)
+	return NULL;
+    return clients_slot(clients, handle.slot);
 }
 
 /* End of file */
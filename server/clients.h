@@ -37,12 +37,10 @@
  * Headers
  */
 
-/* System headers */
-#include <sys/select.h> /* fd_set */
-
 /* Project headers */
-#include <iobuffer.h> /* iobuffer_t */
-#include <hash.h>     /* hash_t     */
+#include <events.h>   /* events_t                     */
+#include <iobuffer.h> /* iobuffer_t                   */
+#include "registry.h" /* registry_t, registry_entry_t */
 
 
 #ifdef __cplusplus
@@ -50,32 +48,98 @@ extern "C" {
 #endif /* __cplusplus */
 
 
+/*
+ * Constants
+ */
+
+/* Number of client slots allocated at once */
+#define CLIENTS_CHUNK 64
+
+/* Maximum number of connections accepted per loop iteration */
+#define CLIENTS_ACCEPT_MAX 64
+
+/* Default watermarks of pending output per client (in bytes) */
+#define CLIENTS_OUTPUT_HIGH 1048576
+#define CLIENTS_OUTPUT_LOW  262144
+
+/* Size of nickname storage in client structures (longer are allocated) */
+#define CLIENT_NICK_SIZE 32
+
+/* Size of the stack buffers used to format messages about a client */
+#define CLIENT_MSG_SIZE (CLIENT_NICK_SIZE + 64)
+
+
 /*
  * Data types
  */
 
-/* Structure defining a connected client */
+/* Policy for clients whose pending output exceeds the high watermark */
+typedef enum clients_policy {
+    CLIENTS_POLICY_DROP,       /* Drop oldest messages down to low mark  */
+    CLIENTS_POLICY_COALESCE,   /* Same, replacing them with a notice     */
+    CLIENTS_POLICY_DISCONNECT  /* Disconnect the client                  */
+} clients_policy_t;
+
+/* State of a client slot */
+typedef enum client_state {
+    CLIENT_FREE,          /* Unused slot                          */
+    CLIENT_CONNECTED,     /* Connected, not authenticated yet     */
+    CLIENT_AUTHENTICATED, /* Authenticated (has a nickname)       */
+    CLIENT_CLOSING        /* Removed once its output is written   */
+} client_state_t;
+
+/* Client fields scanned by loops over all clients (indexed by slot) */
+typedef struct client_hot {
+    int            fd;         /* Socket descriptor                  */
+    client_state_t state;      /* Slot state                         */
+    unsigned       generation; /* Incremented each time it is freed  */
+} client_hot_t;
+
+/* Reference to a client which detects the reuse of its slot */
+typedef struct client_handle {
+    int      slot;       /* Slot of the client                */
+    unsigned generation; /* Generation of the slot when taken */
+} client_handle_t;
+
+/* Structure defining a connected client (other fields) */
 typedef struct client {
-    struct client *next;     /* Next element in linked list      */
-    struct client *prev;     /* Previous element in linked list  */
-    iobuffer_t     buffer;   /* Input/output buffer              */
-    char          *nick;     /* Nickname                         */
-    int            nick_len; /* Nickname length                  */
-    char           addr[22]; /* Client address and port (string) */
-    int            addr_len; /* Address length                   */
-    hash_element_t hash_elm; /* Element in hash table            */
+    int              slot;       /* Slot index                        */
+    struct client   *dirty_next; /* Next client in output queue       */
+    struct client   *dirty_prev; /* Previous client in output queue   */
+    int              dirty;      /* If client is in the output queue  */
+    iobuffer_t       buffer;     /* Input/output buffer               */
+    char            *nick;       /* Nickname (nick_buf if short)      */
+    int              nick_len;   /* Nickname length                   */
+    char             nick_buf[CLIENT_NICK_SIZE];
+				 /* Storage of short nicknames        */
+    char             addr[22];   /* Client address and port (string)  */
+    int              addr_len;   /* Address length                    */
+    registry_entry_t entry;      /* Entry in the nickname registry    */
 } client_t;
 
 /* Structure used for clients managing */
 typedef struct clients {
-    int         number;    /* Number of connected clients */
-    client_t   *first;     /* First client in linked list */
-    client_t   *last;      /* Last client in linked list  */
-    fd_set     *read_fds;  /* Read descriptor set         */
-    fd_set     *write_fds; /* Write descriptor set        */
-    iobuffer_t *console;   /* Console I/O buffer          */
-    int         srv_sock;  /* Server socket               */
-    hash_t      hash;      /* Client hash table           */
+    int              number;      /* Number of connected clients        */
+    int              capacity;    /* Number of slots                    */
+    int              high;        /* Past the highest slot in use       */
+    client_hot_t    *hot;         /* Hot fields of each slot            */
+    client_t       **chunks;      /* Clients, CLIENTS_CHUNK per chunk   */
+    client_t        *arena;       /* Chunks reserved at startup         */
+    int              reserved;    /* Number of slots in the arena       */
+    int             *free_slots;  /* Stack of free slots                */
+    int              free_count;  /* Number of free slots               */
+    client_t        *dirty_first; /* First client with pending output   */
+    client_t        *dirty_last;  /* Last client with pending output    */
+    events_t        *events;      /* Event manager                      */
+    iobuffer_t      *console;     /* Console I/O buffer                 */
+    int              srv_sock;    /* Server socket                      */
+    int              output_high; /* Output size limit (0 if unlimited) */
+    int              output_low;  /* Output size left when dropping     */
+    clients_policy_t policy;      /* Policy when output exceeds limit   */
+    unsigned long    dropped;     /* Messages dropped for slow clients  */
+    unsigned long    evicted;     /* Clients disconnected for slowness  */
+    struct worker   *worker;      /* Worker serving these clients       */
+    registry_t      *registry;    /* Nicknames of all workers' clients  */
 } clients_t;
 
 
@@ -84,22 +148,44 @@ typedef struct clients {
  */
 
 /* Constructors and destructors */
-void clients_init(clients_t *const clients, fd_set *const read_fds,
-		  fd_set *const write_fds, struct iobuffer *const console,
-		  const int srv_sock);
+void clients_init(clients_t *const clients, events_t *const events,
+		  struct iobuffer *const console, const int srv_sock,
+		  struct worker *const worker);
 void clients_free(clients_t *const clients);
+int  clients_reserve(clients_t *const clients, const int count);
+void clients_set_output_limit(clients_t *const clients, const int high,
+			      const int low, const clients_policy_t policy);
 
 /* Methods */
 int       clients_add(clients_t *const clients);
+int       clients_accept(clients_t *const clients);
 void      clients_remove(clients_t *const clients, client_t *const client);
-void      clients_disconnect(client_t *const client);
+void      clients_disconnect(clients_t *const clients,
+			     client_t *const client);
+void      clients_dirty(clients_t *const clients, client_t *const client);
 int       clients_read(clients_t *const clients);
 int       clients_write(clients_t *const clients);
 void      clients_flush(const clients_t *const clients);
-int       clients_send(const clients_t *const clients, const char *data,
+int       clients_send(clients_t *const clients, const char *data,
 		       const int length, const client_t *const except);
-client_t *clients_get_client_from_name(const clients_t *const clients,
-				       const char *const name);
+int       clients_send_to(clients_t *const clients, const char *const nick,
+			  const char *const data, const int length);
+int       clients_kill(clients_t *const clients, const char *const nick);
+
+/* Delivery to the clients of this worker only */
+int clients_deliver(clients_t *const clients, const char *data,
+		    const int length, const client_t *const except);
+int clients_deliver_to(clients_t *const clients,
+		       const client_handle_t handle, const char *const data,
+		       const int length);
+int clients_deliver_kill(clients_t *const clients,
+			 const client_handle_t handle);
+
+/* Handles */
+client_handle_t clients_get_handle(const clients_t *const clients,
+				   const client_t *const client);
+client_t       *clients_get_client(const clients_t *const clients,
+				   const client_handle_t handle);
 
 
 #ifdef __cplusplus
@@ -36,21 +36,31 @@
  *
  */
 
+/* Feature test macros (getopt(), setrlimit(), SO_REUSEPORT) */
+#define _DEFAULT_SOURCE
+
 /* System headers */
-#include <stdlib.h> /* malloc(), free(), atoi()              */
-#include <stdio.h>  /* perror(), printf(), fprintf(), stderr */
-#include <unistd.h> /* close(), read(), write()              */
-#include <assert.h> /* assert()                              */
+#include <stdlib.h>       /* malloc(), free(), atoi(), strtol()    */
+#include <stdio.h>        /* perror(), printf(), fprintf(), stderr */
+#include <string.h>       /* strcmp()                              */
+#include <signal.h>       /* signal(), SIGPIPE, SIG_IGN            */
+#include <unistd.h>       /* close(), read(), write(), getopt()    */
+#include <fcntl.h>        /* fcntl(), O_NONBLOCK                   */
+#include <assert.h>       /* assert()                              */
+#include <sys/resource.h> /* getrlimit(), setrlimit()              */
 
 /* Network-related headers */
-#include <sys/socket.h> /* socket(), bind(), listen()                  */
-#include <sys/select.h> /* select(), fd_set, FD_*()                    */
+#include <sys/socket.h> /* socket(), bind(), listen(), setsockopt()    */
 #include <netinet/in.h> /* struct sockaddr_in, INADDR_ANY, IPPROTO_TCP */
+#include <arpa/inet.h>  /* htonl(), htons(), ntohs()                   */
 
 /* Project headers */
 #include <common.h>
+#include <events.h>
+#include <hash.h>
 #include <iobuffer.h>
 #include "clients.h"
+#include "workers.h"
 #include "srvcmd.h"
 
 
@@ -64,6 +74,11 @@
 # define DEFAULT_PORT 4242
 #endif
 
+/* Length of the queue of pending connections */
+#ifndef DEFAULT_BACKLOG
+# define DEFAULT_BACKLOG 128
+#endif
+
 
 /*****************************************************************************
  *
@@ -93,18 +108,80 @@ static void write_welcome(void)
 }
 
 /*
- * Create the server socket.
+ * Print the command line syntax.
+ */
+static void write_usage(const char *const name)
+{
+    fprintf(stderr, "Usage: %s [-e backend] [-b size] [-r] [-c count] "
+	    "[-l backlog] [-q high[:low]] [-p policy] [-w workers] [port] "
+	    "(default %d)\n"
+	    "  -e backend: event backend (auto, select, epoll or uring)\n"
+	    "  -b size: initial size of buffer chunks (default %d)\n"
+	    "  -r: use ring buffers instead of chunk lists\n"
+	    "  -c count: allocate memory for count clients at startup\n"
+	    "  -l backlog: length of the pending connection queue "
+	    "(default %d)\n"
+	    "  -q high[:low]: watermarks of pending output per client\n"
+	    "    (default %d:%d, 0 for no limit)\n"
+	    "  -p policy: what to do above the high watermark (drop, "
+	    "coalesce or\n"
+	    "    disconnect, default coalesce)\n"
+	    "  -w workers: number of threads serving clients (default 1, at "
+	    "most %d)\n",
+	    name, DEFAULT_PORT, dbuffer_get_default_chunk_size(),
+	    DEFAULT_BACKLOG, CLIENTS_OUTPUT_HIGH, CLIENTS_OUTPUT_LOW,
+	    WORKERS_MAX);
+}
+
+/*
+ * Parse output watermarks given as `high[:low]' (low defaults to a quarter
+ * of high).
+ */
+static int parse_watermarks(const char *const arg, int *const high,
+			    int *const low)
+{
+    char *end; /* End of parsed number */
+
+    *high = strtol(arg, &end, 10);
+    *low = *end == ':' ? strtol(end + 1, &end, 10) : *high / 4;
+
+    if (end == arg || *end != '\0' || *high < 0 || *low < 0 || *low > *high)
+	return -1;
+    return 0;
+}
+
+/*
+ * Raise the descriptor limit so that many clients can be connected.
+ */
+static void raise_fd_limit(void)
+{
+    struct rlimit limit; /* Descriptor limit */
+
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 &&
+	limit.rlim_cur < limit.rlim_max) {
+	limit.rlim_cur = limit.rlim_max;
+	setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+/*
+ * Create a server socket (shared if other sockets listen to the same port).
+ * The port is updated if it was 0.
  */
-static int create_socket(const unsigned short port)
+static int create_socket(unsigned short *const port, const int backlog,
+			 const int shared)
 {
     int                sock;     /* Created socket */
+#ifdef SO_REUSEPORT
+    int                on;       /* Option value   */
+#endif
     socklen_t          addr_len; /* Address length */
     struct sockaddr_in addr;     /* Server address */
 
     /* Specify server address to use */
     addr.sin_family = AF_INET;
     addr.sin_addr.s_addr = htonl(INADDR_ANY);
-    addr.sin_port = htons(port);
+    addr.sin_port = htons(*port);
 
     /* Create socket */
     if ((sock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP)) == -1) {
@@ -112,6 +189,20 @@ static int create_socket(const unsigned short port)
 	return -1;
     }
 
+    /* Each worker has its socket: the kernel spreads connections (several
+     * workers are refused without SO_REUSEPORT) */
+#ifdef SO_REUSEPORT
+    on = 1;
+    if (shared &&
+	setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) != 0) {
+	perror("Error while setting socket options");
+	close(sock);
+	return -1;
+    }
+#else
+    (void) shared;
+#endif
+
     /* Bind socket */
     if (bind(sock, (struct sockaddr *) &addr, sizeof(addr)) != 0) {
 	perror("Error while binding socket");
@@ -119,25 +210,45 @@ static int create_socket(const unsigned short port)
 	return -1;
     }
 
+    /* Connections are accepted until none is left: never block on it */
+    if (fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK) != 0) {
+	perror("Error while setting socket options");
+	close(sock);
+	return -1;
+    }
+
     /* Listen to the socket */
-    if (listen(sock, 5) != 0) {
+    if (listen(sock, backlog) != 0) {
 	perror("Error while listening to the socket");
 	close(sock);
 	return -1;
     }
 
-    /* Display port information */
+    /* Get port information */
     addr_len = sizeof(addr);
     if (getsockname(sock, (struct sockaddr *) &addr, &addr_len) != 0) {
 	perror("Error while getting socket informations");
 	close(sock);
 	return -1;
     }
-    printf("Server is listening on port %u.\n\n", ntohs(addr.sin_port));
+    *port = ntohs(addr.sin_port);
 
     return sock;
 }
 
+/*
+ * Free the first count workers, which have been initialized.
+ */
+static void free_workers(workers_t *const workers, const int count)
+{
+    int i; /* Worker index */
+
+    for (i = 0; i < count; i++)
+	worker_free(&workers->workers[i]);
+    workers_free(workers);
+    dbuffer_pool_free();
+}
+
 /*
  * Input messages and commands from console.
  */
@@ -164,7 +275,7 @@ static int console_input(clients_t *const clients, iobuffer_t *const console)
 
     /* Analyze each line */
     cmd = 0;
-    while ((line = iobuffer_input_line(console, 3)) != NULL && cmd == 0) {
+    while (cmd == 0 && (line = iobuffer_view_line(console, 3)) != NULL) {
 	if (line->data[0] == '/')
 	    /* Command */
 	    cmd = srvcmd_exec(line->data + 1, SRVCMD_TYPE_SERVER, console,
@@ -176,8 +287,8 @@ static int console_input(clients_t *const clients, iobuffer_t *const console)
 	    line->start[2] = ' ';
 	    clients_send(clients, line->start, line->length + 3, NULL);
 	}
-	free(line);
     }
+    iobuffer_release_line(console);
 
     return cmd;
 }
@@ -194,82 +305,182 @@ static int console_input(clients_t *const clients, iobuffer_t *const console)
  */
 int main(int argc, char *argv[])
 {
-    int        srv_sock; /* Server socket descriptor       */
-    int        sock;     /* A socket descriptor            */
-    int        nfds;     /* Number of descriptors          */
-    fd_set     rfds;     /* Read descriptors for select()  */
-    fd_set     wfds;     /* Write descriptors for select() */
-    clients_t  clients;  /* Clients structure              */
-    iobuffer_t console;  /* Console input/output buffer    */
+    int              opt;      /* Command line option         */
+    int              reserve;  /* Number of reserved slots    */
+    int              backlog;  /* Pending connection queue    */
+    int              high;     /* Output high watermark       */
+    int              low;      /* Output low watermark        */
+    int              count;    /* Number of workers           */
+    int              i;        /* Worker index                */
+    int              srv_sock; /* Server socket descriptor    */
+    unsigned short   port;     /* Server port                 */
+    events_backend_t backend;  /* Event backend to use        */
+    clients_policy_t policy;   /* Policy for slow clients     */
+    workers_t        workers;  /* Worker threads              */
+    worker_t        *worker;   /* Current worker              */
+
+    /* Parse options */
+    backend = EVENTS_BACKEND_AUTO;
+    reserve = 0;
+    backlog = DEFAULT_BACKLOG;
+    high = CLIENTS_OUTPUT_HIGH;
+    low = CLIENTS_OUTPUT_LOW;
+    policy = CLIENTS_POLICY_COALESCE;
+    count = 1;
+    while ((opt = getopt(argc, argv, "e:b:rc:l:q:p:w:")) != -1)
+	switch (opt) {
+	case 'e':
+	    if (strcmp(optarg, "auto") == 0)
+		backend = EVENTS_BACKEND_AUTO;
+	    else if (strcmp(optarg, "select") == 0)
+		backend = EVENTS_BACKEND_SELECT;
+	    else if (strcmp(optarg, "epoll") == 0)
+		backend = EVENTS_BACKEND_EPOLL;
+	    else if (strcmp(optarg, "uring") == 0)
+		backend = EVENTS_BACKEND_URING;
+	    else {
+		write_usage(argv[0]);
+		return 1;
+	    }
+	    break;
+
+	case 'b':
+	    if (dbuffer_set_default_chunk_size(atoi(optarg)) != 0) {
+		write_usage(argv[0]);
+		return 1;
+	    }
+	    break;
+
+	case 'r':
+	    dbuffer_set_default_backend(DBUFFER_BACKEND_RING);
+	    break;
+
+	case 'c':
+	    if ((reserve = atoi(optarg)) <= 0) {
+		write_usage(argv[0]);
+		return 1;
+	    }
+	    break;
+
+	case 'l':
+	    if ((backlog = atoi(optarg)) <= 0) {
+		write_usage(argv[0]);
+		return 1;
+	    }
+	    break;
+
+	case 'q':
+	    if (parse_watermarks(optarg, &high, &low) != 0) {
+		write_usage(argv[0]);
+		return 1;
+	    }
+	    break;
+
+	case 'p':
+	    if (strcmp(optarg, "drop") == 0)
+		policy = CLIENTS_POLICY_DROP;
+	    else if (strcmp(optarg, "coalesce") == 0)
+		policy = CLIENTS_POLICY_COALESCE;
+	    else if (strcmp(optarg, "disconnect") == 0)
+		policy = CLIENTS_POLICY_DISCONNECT;
+	    else {
+		write_usage(argv[0]);
+		return 1;
+	    }
+	    break;
+
+	case 'w':
+	    if ((count = atoi(optarg)) <= 0 || count > WORKERS_MAX) {
+		write_usage(argv[0]);
+		return 1;
+	    }
+	    break;
+
+	default:
+	    write_usage(argv[0]);
+	    return 1;
+	}
 
     /* Verify parameters */
-    if (argc > 2) {
-	fprintf(stderr, "Usage: %s [port] (default %d)\n",
-		argv[0], DEFAULT_PORT);
+    if (argc - optind > 1) {
+	write_usage(argv[0]);
 	return 1;
     }
+#ifndef SO_REUSEPORT
+    if (count > 1) {
+	fprintf(stderr, "Several workers need SO_REUSEPORT, which this "
+		"system lacks.\n");
+	return 1;
+    }
+#endif
 
-    /* Write welcome message */
-    write_welcome();
-
-    /* Open server socket */
-    srv_sock = create_socket(argc == 2 ? atoi(argv[1]) : DEFAULT_PORT);
-    if (srv_sock == -1)
+    /* Initialize workers and the registry they share */
+    if (workers_init(&workers, count) != 0) {
+	perror("Error while initializing workers");
 	return 2;
+    }
+    raise_fd_limit();
 
-    /* Initialize structures */
-    clients_init(&clients, &rfds, &wfds, &console, srv_sock);
-    iobuffer_init(&console, STDIN_FILENO, STDOUT_FILENO, &rfds, &wfds, '\n');
+    /* Make hash keys unpredictable */
+    hash_randomize();
 
-    /* Initialize read descriptor set */
-    FD_ZERO(&rfds);
-    FD_SET(STDIN_FILENO, &rfds);
-    FD_SET(srv_sock, &rfds);
+    /* Lost connections are detected by write errors instead of a signal */
+    signal(SIGPIPE, SIG_IGN);
 
-    /* Initialize write descriptor set */
-    FD_ZERO(&wfds);
-    FD_SET(STDOUT_FILENO, &wfds);
+    /* Write welcome message */
+    write_welcome();
 
-    /* Initialize descriptor number */
-    nfds = srv_sock + 1;
+    /* Open a server socket per worker (the first one reads the console) */
+    port = optind < argc ? atoi(argv[optind]) : DEFAULT_PORT;
+    for (i = 0; i < count; i++) {
+	worker = &workers.workers[i];
+	if ((srv_sock = create_socket(&port, backlog, count > 1)) == -1)
+	    break;
+	if (worker_init(worker, srv_sock, i == 0 ? STDIN_FILENO : -1,
+			backend) != 0) {
+	    perror("Error while initializing the event loop");
+	    close(srv_sock);
+	    break;
+	}
+	clients_set_output_limit(&worker->clients, high, low, policy);
+	worker->reserve = (reserve + count - 1) / count;
+    }
+    if (i < count) {
+	free_workers(&workers, i);
+	return 2;
+    }
+    printf("Server is listening on port %u.\n\n", port);
+
+    /* Other workers allocate their slots in their own thread */
+    worker = &workers.workers[0];
+    if (reserve != 0 &&
+	clients_reserve(&worker->clients, worker->reserve) != 0) {
+	perror("Error while allocating client slots");
+	free_workers(&workers, count);
+	return 2;
+    }
+    if (workers_start(&workers) != 0) {
+	perror("Error while starting workers");
+	free_workers(&workers, count);
+	return 2;
+    }
 
-    /* Main loop */
+    /* Main loop (of the first worker) */
     while (1) {
 	/* Wait for a ready descriptor */
-	select(nfds, &rfds, &wfds, NULL, NULL);
+	events_wait(&worker->events, -1);
 
 	/* Check standard input stream */
-	if (console_input(&clients, &console) != 0)
+	if (console_input(&worker->clients, &worker->console) != 0)
 	    break;
 
-	/* Check main server socket */
-	if (FD_ISSET(srv_sock, &rfds)) {
-	    /* Accept connection and add client */
-	    sock = clients_add(&clients);
-
-	    /* Update descriptor number */
-	    if (sock >= nfds)
-		nfds = sock + 1;
-	} else
-	    FD_SET(srv_sock, &rfds);
-
-	/* Check client sockets */
-	clients_read(&clients);
-
-	/* Check output streams */
-	clients_write(&clients);
-	iobuffer_write(&console);
+	/* Check sockets and output streams */
+	worker_process(worker);
     }
 
-    /* Flush buffers */
-    FD_SET(STDOUT_FILENO, &wfds);
-    iobuffer_write(&console);
-    clients_flush(&clients);
-
-    /* Free memory and close sockets */
-    clients_free(&clients);
-    iobuffer_free(&console);
-    close(srv_sock);
+    /* Other workers flush their clients and exit */
+    workers_stop(&workers);
+    free_workers(&workers, count);
 
     /* Exit silently */
     return 0;
@@ -0,0 +1,199 @@
+/*
+ * ---------------------------------------------------------------------------
+ *
+ * Minitalk: a basic talk-like server/client
+ * Copyright (C) 2004 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: server/registry.c
+ *
+ * Description: Nickname Registry Shared by Workers
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+/*****************************************************************************
+ *
+ * Headers
+ *
+ */
+
+/* System headers */
+#include <stdlib.h>  /* NULL              */
+#include <assert.h>  /* assert()          */
+#include <pthread.h> /* pthread_mutex_*() */
+
+/* Project headers */
+#include <common.h>
+#include <hash.h>
+#include <lexicon.h>
+#include "registry.h"
+
+
+/*****************************************************************************
+ *
+ * Public functions
+ *
+ */
+
+/*
+ * Initialize the registry.
+ */
+int registry_init(registry_t *const registry)
+{
+    assert(registry != NULL);
+
+    if (pthread_mutex_init(&registry->mutex, NULL) != 0)
+	return -1;
+
+    hash_init(&registry->hash);
+    lexicon_init(&registry->names);
+    registry->connected = 0;
+    return 0;
+}
+
+/*
+ * Free the registry (entries are not freed: they are in the clients).
+ */
+void registry_free(registry_t *const registry)
+{
+    assert(registry != NULL);
+
+    hash_free(&registry->hash);
+    lexicon_free(&registry->names);
+    pthread_mutex_destroy(&registry->mutex);
+}
+
+/*
+ * Get the number of connected clients (authenticated or not).
+ */
+int registry_get_connected(registry_t *const registry)
+{
+    assert(registry != NULL);
+
+    return __atomic_load_n(&registry->connected, __ATOMIC_RELAXED);
+}
+
+/*
+ * Count connecting (positive count) or disconnected (negative) clients.
+ */
+void registry_add_connected(registry_t *const registry, const int count)
+{
+    assert(registry != NULL);
+
+    __atomic_add_fetch(&registry->connected, count, __ATOMIC_RELAXED);
+}
+
+/*
+ * Register a nickname (the entry must stay valid until it is removed).
+ * Returns -1 if it is already taken, or -2 if there is no more memory (it
+ * is not registered then).
+ */
+int registry_add(registry_t *const registry, const char *const nick,
+		 registry_entry_t *const entry)
+{
+    int error; /* Error code */
+
+    assert(registry != NULL);
+    assert(nick != NULL);
+    assert(entry != NULL);
+
+    /* Clients of two workers may ask for the same nickname at once */
+    pthread_mutex_lock(&registry->mutex);
+    if (hash_find(&registry->hash, nick) != NULL)
+	error = -1;
+    else if (hash_add(&registry->hash, nick, entry, &entry->element)
+	     == NULL)
+	error = -2;
+    else if (lexicon_add(&registry->names, nick, entry) != 0) {
+	hash_remove(&registry->hash, &entry->element);
+	error = -2;
+    } else
+	error = 0;
+    pthread_mutex_unlock(&registry->mutex);
+
+    return error;
+}
+
+/*
+ * Unregister a nickname.
+ */
+void registry_remove(registry_t *const registry, const char *const nick,
+		     registry_entry_t *const entry)
+{
+    assert(registry != NULL);
+    assert(nick != NULL);
+    assert(entry != NULL);
+
+    pthread_mutex_lock(&registry->mutex);
+    hash_remove(&registry->hash, &entry->element);
+    lexicon_remove(&registry->names, nick);
+    pthread_mutex_unlock(&registry->mutex);
+}
+
+/*
+ * Find a nickname and copy the location of its client (the entry itself
+ * belongs to another worker).  Returns -1 if it is not registered.
+ */
+int registry_find(registry_t *const registry, const char *const nick,
+		  registry_entry_t *const found)
+{
+    hash_element_t         *element; /* Hash table element */
+    const registry_entry_t *entry;   /* Registered entry   */
+
+    assert(registry != NULL);
+    assert(nick != NULL);
+    assert(found != NULL);
+
+    pthread_mutex_lock(&registry->mutex);
+    if ((element = hash_find(&registry->hash, nick)) != NULL) {
+	entry = element->object;
+	found->worker = entry->worker;
+	found->slot = entry->slot;
+	found->generation = entry->generation;
+    }
+    pthread_mutex_unlock(&registry->mutex);
+
+    return element != NULL ? 0 : -1;
+}
+
+/*
+ * Lock the registry to read its nickname index, which is returned.
+ */
+const lexicon_t *registry_lock(registry_t *const registry)
+{
+    assert(registry != NULL);
+
+    pthread_mutex_lock(&registry->mutex);
+    return &registry->names;
+}
+
+/*
+ * Unlock the registry after reading its nickname index.
+ */
+void registry_unlock(registry_t *const registry)
+{
+    assert(registry != NULL);
+
+    pthread_mutex_unlock(&registry->mutex);
+}
+
+/* End of file */
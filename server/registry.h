@@ -0,0 +1,105 @@
+/*
+ * ---------------------------------------------------------------------------
+ *
+ * Minitalk: a basic talk-like server/client
+ * Copyright (C) 2004 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: server/registry.h
+ *
+ * Description: Nickname Registry Shared by Workers (Header)
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+#ifndef REGISTRY_H
+#define REGISTRY_H
+
+/*
+ * Headers
+ */
+
+/* System headers */
+#include <pthread.h> /* pthread_mutex_t */
+
+/* Project headers */
+#include <hash.h>    /* hash_t         */
+#include <lexicon.h> /* lexicon_t      */
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+
+/*
+ * Data types
+ */
+
+/* Registered nickname (stored in the client structure) */
+typedef struct registry_entry {
+    hash_element_t element;    /* Element in the hash table        */
+    int            worker;     /* Index of the worker owning it    */
+    int            slot;       /* Client slot in the worker        */
+    unsigned       generation; /* Generation of the slot           */
+} registry_entry_t;
+
+/* Nicknames of the clients of all workers */
+typedef struct registry {
+    pthread_mutex_t mutex;     /* Lock of the tables below         */
+    hash_t          hash;      /* Entries by nickname              */
+    lexicon_t       names;     /* Nicknames in sorted order        */
+    int             connected; /* Number of connected clients      */
+} registry_t;
+
+
+/*
+ * Prototypes
+ */
+
+/* Constructors and destructors */
+int  registry_init(registry_t *const registry);
+void registry_free(registry_t *const registry);
+
+/* Accessors */
+int  registry_get_connected(registry_t *const registry);
+void registry_add_connected(registry_t *const registry, const int count);
+
+/* Methods */
+int  registry_add(registry_t *const registry, const char *const nick,
+		  registry_entry_t *const entry);
+void registry_remove(registry_t *const registry, const char *const nick,
+		     registry_entry_t *const entry);
+int  registry_find(registry_t *const registry, const char *const nick,
+		   registry_entry_t *const found);
+
+/* Access to the nickname index */
+const lexicon_t *registry_lock(registry_t *const registry);
+void             registry_unlock(registry_t *const registry);
+
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !REGISTRY_H */
+
+/* End of file */
@@ -37,19 +37,33 @@
  */
 
 /* System headers */
-#include <stdlib.h> /* malloc(), free()             */
-#include <stdio.h>  /* snprintf()                   */
-#include <string.h> /* strcmp(), strchr(), memcpy() */
+#include <stdlib.h> /* malloc(), free(), atoi()     */
+#include <stdio.h>  /* sprintf(), snprintf()        */
+#include <string.h> /* strcmp(), strchr(), strlen() */
 #include <assert.h> /* assert()                     */
 
 /* Project headers */
 #include <common.h>
+#include <events.h>
 #include <iobuffer.h>
+#include <lexicon.h>
 #include <command.h>
+#include "registry.h"
 #include "clients.h"
+#include "workers.h"
 #include "srvcmd.h"
 
 
+/*****************************************************************************
+ *
+ * Constants
+ *
+ */
+
+/* Number of nicknames listed by `/who' and `/complete' at once */
+#define WHO_PAGE_SIZE 50
+
+
 /*****************************************************************************
  *
  * Data types
@@ -63,6 +77,135 @@ typedef struct srvcmd_data {
 } srvcmd_data_t;
 
 
+/*****************************************************************************
+ *
+ * Private functions
+ *
+ */
+
+/*
+ * List the nicknames beginning with a prefix, by pages.
+ */
+static void list_names(const lexicon_t *const names, const int connected,
+		       const char *const prefix, const int page,
+		       iobuffer_t *const buffer)
+{
+    int         i;               /* Entry index              */
+    int         first;           /* First matching entry     */
+    int         count;           /* Number of matching names */
+    int         pages;           /* Number of pages          */
+    int         len;             /* String length            */
+    const char *name;            /* Current nickname         */
+    char        str_buffer[128]; /* String buffer            */
+
+    static const char msg_none[] = "No client connected.\n";
+    static const char msg_match[] = "No nickname matches.\n";
+    static const char msg_page[] = "No such page.\n";
+
+    assert(names != NULL);
+    assert(prefix != NULL);
+    assert(buffer != NULL);
+
+    count = lexicon_find_prefix(names, prefix, &first);
+    if (count == 0) {
+	if (prefix[0] == '\0')
+	    iobuffer_put_data(buffer, msg_none, sizeof(msg_none) - 1);
+	else
+	    iobuffer_put_data(buffer, msg_match, sizeof(msg_match) - 1);
+	return;
+    }
+
+    pages = (count + WHO_PAGE_SIZE - 1) / WHO_PAGE_SIZE;
+    if (page < 1 || page > pages) {
+	iobuffer_put_data(buffer, msg_page, sizeof(msg_page) - 1);
+	return;
+    }
+
+    /* Output client number */
+    if (prefix[0] == '\0')
+	len = snprintf(str_buffer, sizeof(str_buffer),
+		       "There are %d client(s) connected:\n", connected);
+    else
+	len = snprintf(str_buffer, sizeof(str_buffer),
+		       "%d client(s) matching:\n", count);
+    iobuffer_put_data(buffer, str_buffer, len);
+
+    /* Output client names of the page */
+    first += (page - 1) * WHO_PAGE_SIZE;
+    count -= (page - 1) * WHO_PAGE_SIZE;
+    for (i = 0; i < count && i < WHO_PAGE_SIZE; i++) {
+	name = lexicon_get_string(names, first + i);
+	iobuffer_put_data(buffer, name, strlen(name));
+	iobuffer_put_data(buffer, "\n", 1);
+    }
+
+    /* Tell how to get the next page (the prefix may be long) */
+    if (page < pages) {
+	len = snprintf(str_buffer, sizeof(str_buffer),
+		       "Page %d of %d; type `/who ", page, pages);
+	iobuffer_put_data(buffer, str_buffer, len);
+	if (prefix[0] != '\0')
+	    iobuffer_put_data(buffer, prefix, strlen(prefix));
+	else
+	    iobuffer_put_data(buffer, "*", 1);
+	len = snprintf(str_buffer, sizeof(str_buffer),
+		       " %d' for the next one.\n", page + 1);
+	iobuffer_put_data(buffer, str_buffer, len);
+    }
+}
+
+/*
+ * Complete a nickname prefix and list the candidates.
+ */
+static void complete_name(const lexicon_t *const names,
+			  const char *const prefix, iobuffer_t *const buffer)
+{
+    int         i;               /* Entry index              */
+    int         first;           /* First matching entry     */
+    int         count;           /* Number of matching names */
+    int         len;             /* Common prefix length     */
+    const char *low;             /* First matching nickname  */
+    const char *high;            /* Last matching nickname   */
+    const char *name;            /* Current nickname         */
+    char        str_buffer[32];  /* String buffer            */
+
+    static const char msg_match[] = "No nickname matches.\n";
+
+    assert(names != NULL);
+    assert(prefix != NULL);
+    assert(buffer != NULL);
+
+    count = lexicon_find_prefix(names, prefix, &first);
+    if (count == 0) {
+	iobuffer_put_data(buffer, msg_match, sizeof(msg_match) - 1);
+	return;
+    }
+
+    /* Names are sorted: the common prefix is the one of the extremes */
+    low = lexicon_get_string(names, first);
+    high = lexicon_get_string(names, first + count - 1);
+    for (len = 0; low[len] != '\0' && low[len] == high[len]; len++)
+	;
+    iobuffer_put_data(buffer, low, len);
+    iobuffer_put_data(buffer, "\n", 1);
+
+    /* Candidates */
+    if (count > 1) {
+	for (i = 0; i < count && i < WHO_PAGE_SIZE; i++) {
+	    name = lexicon_get_string(names, first + i);
+	    iobuffer_put_data(buffer, "  ", 2);
+	    iobuffer_put_data(buffer, name, strlen(name));
+	    iobuffer_put_data(buffer, "\n", 1);
+	}
+	if (count > WHO_PAGE_SIZE) {
+	    len = snprintf(str_buffer, sizeof(str_buffer),
+			   "  (%d more)\n", count - WHO_PAGE_SIZE);
+	    iobuffer_put_data(buffer, str_buffer, len);
+	}
+    }
+}
+
+
 /*****************************************************************************
  *
  * Server commands
@@ -72,64 +215,55 @@ typedef struct srvcmd_data {
 /*
  * Console `/who' command.
  */
-static int cmd_srv_who(int arg_count UNUSED, const char *const *args UNUSED,
+static int cmd_srv_who(int arg_count, const char *const *args,
 		       iobuffer_t *const console UNUSED,
 		       iobuffer_t *const buffer,
 		       const srvcmd_data_t *const data)
 {
-    int       size;       /* String buffer size       */
-    int       max;        /* Maximum printable number */
-    int       len;        /* Number length            */
-    char     *str_buffer; /* String buffer            */
-    client_t *clt;        /* Current client           */
-
-    static const char msg_none[] = "No client connected.\n";
+    int         page;     /* Page number                 */
+    int         count;    /* Number of connected clients */
+    const char *prefix;   /* Nickname prefix             */
+    registry_t *registry; /* Nicknames of all workers    */
 
-    assert(arg_count == 1);
+    assert(arg_count >= 1 && arg_count <= 3);
     assert(args != NULL);
     assert(buffer != NULL);
     assert(data != NULL);
     assert(data->clients != NULL);
 
-    /* Calculate buffer size */
-    size = 0;
-    for (clt = data->clients->first; clt != NULL; clt = clt->next)
-	if (clt->nick_len > 0)
-	    size += clt->nick_len + 1;
+    /* `*' (or no prefix) matches every nickname */
+    prefix = arg_count > 1 && strcmp(args[1], "*") != 0 ? args[1] : "";
+    page = arg_count > 2 ? atoi(args[2]) : 1;
 
-    /* No client connected */
-    if (size == 0) {
-	iobuffer_put_data(buffer, msg_none, sizeof(msg_none) - 1);
-	return 0;
-    }
+    /* Other workers must not change the index while it is read */
+    registry = data->clients->registry;
+    count = registry_get_connected(registry);
+    list_names(registry_lock(registry), count, prefix, page, buffer);
+    registry_unlock(registry);
 
-    /* Calculate the number length */
-    max = 10;
-    len = 1;
-    while (max <= data->clients->number) {
-	max *= 10;
-	len++;
-    }
-    len += 32;
+    return 0;
+}
 
-    if ((str_buffer = malloc(size + len)) == NULL)
-	return 2;
+/*
+ * Console `/complete' command.
+ */
+static int cmd_srv_complete(int arg_count UNUSED, const char *const *args,
+			    iobuffer_t *const console UNUSED,
+			    iobuffer_t *const buffer,
+			    const srvcmd_data_t *const data)
+{
+    registry_t *registry; /* Nicknames of all workers */
 
-    /* Output client number */
-    size = len;
-    snprintf(str_buffer, len + 1, "There are %d client(s) connected:\n",
-	     data->clients->number);
-
-    /* Output client names */
-    for (clt = data->clients->first; clt != NULL; clt = clt->next)
-	if (clt->nick_len > 0) {
-	    memcpy(str_buffer + size, clt->nick, clt->nick_len);
-	    str_buffer[size + clt->nick_len] = '\n';
-	    size += clt->nick_len + 1;
-	}
-    iobuffer_put_data(buffer, str_buffer, size);
+    assert(arg_count == 2);
+    assert(args != NULL);
+    assert(args[1] != NULL);
+    assert(buffer != NULL);
+    assert(data != NULL);
+    assert(data->clients != NULL);
 
-    free(str_buffer);
+    registry = data->clients->registry;
+    complete_name(registry_lock(registry), args[1], buffer);
+    registry_unlock(registry);
 
     return 0;
 }
@@ -142,12 +276,7 @@ static int cmd_srv_kill(int arg_count UNUSED, const char *const *args,
 			iobuffer_t *const buffer UNUSED,
 			const srvcmd_data_t *const data)
 {
-    int       len;        /* String buffer size */
-    client_t *clt;        /* Current client     */
-    char     *str_buffer; /* String buffer      */
-
     static const char msg_nick[] = "No such nickname.\n";
-    static const char msg_you[] = "** You have been killed.\n";
 
     assert(arg_count == 2);
     assert(args != NULL);
@@ -156,24 +285,9 @@ static int cmd_srv_kill(int arg_count UNUSED, const char *const *args,
     assert(data != NULL);
     assert(data->clients != NULL);
 
-    if ((clt = clients_get_client_from_name(data->clients, args[1]))
-	== NULL) {
+    /* The client may be served by another worker */
+    if (clients_kill(data->clients, args[1]) == -1)
 	iobuffer_put_data(console, msg_nick, sizeof(msg_nick) - 1);
-	return 0;
-    }
-
-    len = clt->nick_len + 22;
-    if ((str_buffer = malloc(len)) == NULL)
-	return 2;
-
-    iobuffer_put_data(&clt->buffer, msg_you, sizeof(msg_you) - 1);
-
-    snprintf(str_buffer, len, "** %s has been killed.\n", clt->nick);
-    clients_send(data->clients, str_buffer, len, clt);
-    iobuffer_put_data(console, str_buffer + 3, len - 3);
-
-    free(str_buffer);
-    clients_disconnect(clt);
     return 0;
 }
 
@@ -198,6 +312,47 @@ static int cmd_srv_shutdown(int arg_count UNUSED,
     return 1;
 }
 
+/*
+ * Console `/stats' command.
+ */
+static int cmd_srv_stats(int arg_count UNUSED, const char *const *args UNUSED,
+			 iobuffer_t *const console UNUSED,
+			 iobuffer_t *const buffer,
+			 const srvcmd_data_t *const data)
+{
+    int             len;             /* String length          */
+    workers_t      *workers;         /* Set of all workers     */
+    unsigned long   dropped;         /* Messages dropped       */
+    unsigned long   evicted;         /* Clients disconnected   */
+    char            str_buffer[256]; /* String buffer          */
+    dbuffer_stats_t stats;           /* Buffer pool counters   */
+
+    assert(arg_count == 1);
+    assert(args != NULL);
+    assert(buffer != NULL);
+    assert(data != NULL);
+    assert(data->clients != NULL);
+
+    workers = data->clients->worker->workers;
+    workers_get_stats(workers, &dropped, &evicted);
+
+    /* Buffer pools are per worker: only the console one is reported */
+    dbuffer_get_stats(&stats);
+
+    len = snprintf(str_buffer, sizeof(str_buffer),
+		   "Clients: %d (%d worker(s), %s)\n"
+		   "Slow clients: %lu messages dropped, %lu disconnected\n"
+		   "Buffer pool: %lu hits, %lu misses, %lu released, "
+		   "%lu freed, %d pooled\n",
+		   registry_get_connected(data->clients->registry),
+		   workers->count,
+		   events_get_backend_name(data->clients->events), dropped,
+		   evicted, stats.hits, stats.misses, stats.releases,
+		   stats.frees, stats.pooled);
+    iobuffer_put_data(buffer, str_buffer, len);
+    return 0;
+}
+
 /*
  * Console `/help' command.
  */
@@ -207,9 +362,12 @@ static int cmd_srv_help(int arg_count UNUSED, const char *const *args UNUSED,
 			const srvcmd_data_t *const data UNUSED)
 {
     static const char msg_help[] =
-	"/who: get the list of the currently connected clients.\n"
+	"/who [prefix] [page]: get the list of the connected clients (whose\n"
+	"  nickname begins with prefix, by pages).\n"
+	"/complete <prefix>: complete a nickname.\n"
 	"/kill <nickname>: disconnect a client from the server.\n"
 	"/shutdown: stop the server.\n"
+	"/stats: get server statistics.\n"
 	"/help: get the command list.\n";
 
     assert(arg_count == 1);
@@ -254,8 +412,9 @@ static int cmd_clt_quit(int arg_count UNUSED, const char *const *args UNUSED,
 			iobuffer_t *const buffer UNUSED,
 			const srvcmd_data_t *const data)
 {
-    int   len;        /* String buffer length */
-    char *str_buffer; /* String buffer        */
+    int   len;                    /* String buffer length */
+    char *str_buffer;             /* String buffer        */
+    char  local[CLIENT_MSG_SIZE]; /* Local string buffer  */
 
     static const char msg_mem[] = "Error: no more memory!\n";
     static const char msg_bye[] = "** Goodbye!\n";
@@ -269,7 +428,9 @@ static int cmd_clt_quit(int arg_count UNUSED, const char *const *args UNUSED,
     assert(data->client != NULL);
 
     len = data->client->nick_len + 22;
-    if ((str_buffer = malloc(len)) == NULL) {
+    if (len <= (int) sizeof(local))
+	str_buffer = local;
+    else if ((str_buffer = malloc(len)) == NULL) {
 	iobuffer_put_data(console, msg_mem, sizeof(msg_mem) - 1);
 	return 1;
     }
@@ -280,8 +441,9 @@ static int cmd_clt_quit(int arg_count UNUSED, const char *const *args UNUSED,
     clients_send(data->clients, str_buffer, len, data->client);
     iobuffer_put_data(console, str_buffer + 3, len - 3);
 
-    free(str_buffer);
-    clients_disconnect(data->client);
+    if (str_buffer != local)
+	free(str_buffer);
+    clients_disconnect(data->clients, data->client);
     return 0;
 }
 
@@ -293,8 +455,10 @@ static int cmd_clt_p2p(int arg_count UNUSED, const char *const *args,
 		       iobuffer_t *const buffer,
 		       const srvcmd_data_t *const data)
 {
-    int       i;   /* Argument counter */
-    client_t *clt; /* Current client   */
+    int   i;                          /* Argument counter    */
+    int   len;                        /* Command length      */
+    char *str_buffer;                 /* String buffer       */
+    char  local[CLIENT_MSG_SIZE * 2]; /* Local string buffer */
 
     static const char msg_nick[] = " nick\nNo such nickname.\n";
 
@@ -305,33 +469,32 @@ static int cmd_clt_p2p(int arg_count UNUSED, const char *const *args,
     assert(args[2] != NULL);
     assert(data != NULL);
 
-    if ((clt = clients_get_client_from_name(data->clients, args[1]))
-	== NULL) {
+    /* The command is forwarded at once (maybe to another worker) */
+    len = strlen(args[0]) + data->client->nick_len + 4;
+    for (i = 2; i < arg_count; i++)
+	len += strlen(args[i]) + 1;
+    if (len <= (int) sizeof(local))
+	str_buffer = local;
+    else if ((str_buffer = malloc(len)) == NULL)
+	return 2;
+
+    /* Command, nickname and other parameters */
+    len = sprintf(str_buffer, "/%s %s", args[0], data->client->nick);
+    for (i = 2; i < arg_count; i++)
+	len += sprintf(str_buffer + len, " %s", args[i]);
+    str_buffer[len++] = '\n';
+
+    if (clients_send_to(data->clients, args[1], str_buffer, len) == -1) {
 	/* Error command */
 	iobuffer_put_data(buffer, "/refuse ", 6);
 	iobuffer_put_data(buffer, args[2], strlen(args[2]));
 
 	/* End of error command and message */
 	iobuffer_put_data(buffer, msg_nick, sizeof(msg_nick) - 1);
-	return 0;
     }
 
-    /* Command */
-    iobuffer_put_data(&clt->buffer, "/", 1);
-    iobuffer_put_data(&clt->buffer, args[0], strlen(args[0]));
-
-    /* Nickname */
-    iobuffer_put_data(&clt->buffer, " ", 1);
-    iobuffer_put_data(&clt->buffer, data->client->nick,
-		      data->client->nick_len);
-
-    /* Other parameters */
-    for (i = 2; i < arg_count; i++) {
-	iobuffer_put_data(&clt->buffer, " ", 1);
-	iobuffer_put_data(&clt->buffer, args[i], strlen(args[i]));
-    }
-    iobuffer_put_data(&clt->buffer, "\n", 1);
-
+    if (str_buffer != local)
+	free(str_buffer);
     return 0;
 }
 
@@ -343,8 +506,10 @@ static int cmd_clt_accept(int arg_count UNUSED, const char *const *args,
 			  iobuffer_t *const buffer,
 			  const srvcmd_data_t *const data)
 {
-    char     *sep; /* Separator character */
-    client_t *clt; /* Current client      */
+    int   len;                        /* Command length      */
+    int   addr_len;                   /* Address length      */
+    char *str_buffer;                 /* String buffer       */
+    char  local[CLIENT_MSG_SIZE * 2]; /* Local string buffer */
 
     static const char msg_nick[] = " nick\nNo such nickname.\n";
 
@@ -355,41 +520,32 @@ static int cmd_clt_accept(int arg_count UNUSED, const char *const *args,
     assert(args[2] != NULL);
     assert(data != NULL);
 
-    if ((clt = clients_get_client_from_name(data->clients, args[1]))
-	== NULL) {
+    /* The address is sent without the port */
+    addr_len = strchr(data->client->addr, ':') - data->client->addr;
+
+    len = data->client->nick_len + strlen(args[2]) + strlen(args[3])
+	+ addr_len + strlen(args[4]) + 14;
+    if (len <= (int) sizeof(local))
+	str_buffer = local;
+    else if ((str_buffer = malloc(len)) == NULL)
+	return 2;
+
+    /* Command, nickname, IDs, address and port */
+    len = sprintf(str_buffer, "/accept %s %s %s %.*s %s\n",
+		  data->client->nick, args[2], args[3], addr_len,
+		  data->client->addr, args[4]);
+
+    if (clients_send_to(data->clients, args[1], str_buffer, len) == -1) {
 	/* Error command */
 	iobuffer_put_data(buffer, "/refuse ", 6);
 	iobuffer_put_data(buffer, args[2], strlen(args[2]));
 
 	/* End of error command and message */
 	iobuffer_put_data(buffer, msg_nick, sizeof(msg_nick) - 1);
-	return 0;
     }
 
-    /* Command */
-    iobuffer_put_data(&clt->buffer, "/accept ", 8);
-
-    /* Nickname */
-    iobuffer_put_data(&clt->buffer, data->client->nick,
-		      data->client->nick_len);
-
-    /* IDs */
-    iobuffer_put_data(&clt->buffer, " ", 1);
-    iobuffer_put_data(&clt->buffer, args[2], strlen(args[2]));
-    iobuffer_put_data(&clt->buffer, " ", 1);
-    iobuffer_put_data(&clt->buffer, args[3], strlen(args[3]));
-
-    /* Address */
-    sep = strchr(data->client->addr, ':');
-    iobuffer_put_data(&clt->buffer, " ", 1);
-    iobuffer_put_data(&clt->buffer, data->client->addr,
-		      sep - data->client->addr);
-
-    /* Port */
-    iobuffer_put_data(&clt->buffer, " ", 1);
-    iobuffer_put_data(&clt->buffer, args[4], strlen(args[4]));
-    iobuffer_put_data(&clt->buffer, "\n", 1);
-
+    if (str_buffer != local)
+	free(str_buffer);
     return 0;
 }
 
@@ -403,7 +559,8 @@ static int cmd_clt_help(int arg_count UNUSED, const char *const *args UNUSED,
 {
     static const char msg_help[] =
 	"/connect <nickname>: choose a nickname.\n"
-	"/who: get the connected client list.\n"
+	"/who [prefix] [page]: get the connected client list.\n"
+	"/complete <prefix>: complete a nickname.\n"
 	"/quit: disconnect from the server.\n"
 	"/help: get the command list.\n"
 	"/receive <nickname> <id> <mode> <filename>: recieve a file from a "
@@ -430,29 +587,36 @@ static int cmd_clt_help(int arg_count UNUSED, const char *const *args UNUSED,
 
 /* Console commands */
 static const command_t server_commands[] = {
-    {"help",     0, NULL,         (command_func_t) cmd_srv_help    },
-    {"kill",     1, "<nickname>", (command_func_t) cmd_srv_kill    },
-    {"shutdown", 0, NULL,         (command_func_t) cmd_srv_shutdown},
-    {"who",      0, NULL,         (command_func_t) cmd_srv_who     }
+    {"complete", 1, 0, "<prefix>",        (command_func_t) cmd_srv_complete},
+    {"help",     0, 0, NULL,              (command_func_t) cmd_srv_help    },
+    {"kill",     1, 0, "<nickname>",      (command_func_t) cmd_srv_kill    },
+    {"shutdown", 0, 0, NULL,              (command_func_t) cmd_srv_shutdown},
+    {"stats",    0, 0, NULL,              (command_func_t) cmd_srv_stats   },
+    {"who",      0, 2, "[prefix] [page]", (command_func_t) cmd_srv_who     }
 };
 
 /* Client commands */
 static const command_t client_commands[] = {
-    {"accept",  4, "<nickname> <id1> <id2> <port>",
-                                      (command_func_t) cmd_clt_accept },
-    {"connect", 1, "<nickname>",      (command_func_t) cmd_clt_connect},
-    {"help",    0, NULL,              (command_func_t) cmd_clt_help   },
-    {"quit",    0, NULL,              (command_func_t) cmd_clt_quit   },
-    {"receive", 4, "<nickname> <id> <mode> <filename>",
-                                      (command_func_t) cmd_clt_p2p    },
-    {"refuse",  3, "<nickname> <id> <reason>",
-                                      (command_func_t) cmd_clt_p2p    },
-    {"send",    4, "<nickname> <id> <mode> <filename>",
-                                      (command_func_t) cmd_clt_p2p    },
-    {"who",     0, NULL,              (command_func_t) cmd_srv_who    }
-                                      /* Same as server version */
+    {"accept",   4, 0, "<nickname> <id1> <id2> <port>",
+                                          (command_func_t) cmd_clt_accept  },
+    {"complete", 1, 0, "<prefix>",        (command_func_t) cmd_srv_complete},
+                                          /* Same as server version */
+    {"connect",  1, 0, "<nickname>",      (command_func_t) cmd_clt_connect },
+    {"help",     0, 0, NULL,              (command_func_t) cmd_clt_help    },
+    {"quit",     0, 0, NULL,              (command_func_t) cmd_clt_quit    },
+    {"receive",  4, 0, "<nickname> <id> <mode> <filename>",
+                                          (command_func_t) cmd_clt_p2p     },
+    {"refuse",   3, 0, "<nickname> <id> <reason>",
+                                          (command_func_t) cmd_clt_p2p     },
+    {"send",     4, 0, "<nickname> <id> <mode> <filename>",
+                                          (command_func_t) cmd_clt_p2p     },
+    {"who",      0, 2, "[prefix] [page]", (command_func_t) cmd_srv_who     }
+                                          /* Same as server version */
 };
 
+/* Perfect hashes of the tables above */
+#include "srvcmd.tab"
+
 
 /*****************************************************************************
  *
@@ -468,9 +632,8 @@ int srvcmd_exec(char *const command, srvcmd_type_t type,
 		struct iobuffer *const buffer, struct clients *const clients,
 		struct client *const client)
 {
-    int              count;    /* Command count in list       */
-    const command_t *commands; /* Command list                */
-    srvcmd_data_t    data;     /* Data for callback functions */
+    const command_table_t *table; /* Command table               */
+    srvcmd_data_t          data;  /* Data for callback functions */
 
     assert(command != NULL);
     assert(type == SRVCMD_TYPE_SERVER || type == SRVCMD_TYPE_CLIENT);
@@ -481,25 +644,22 @@ int srvcmd_exec(char *const command, srvcmd_type_t type,
     data.clients = clients;
     data.client = client;
 
-    /* Select the right command list and count */
+    /* Select the right command table */
     switch (type) {
     case SRVCMD_TYPE_SERVER:
-	commands = server_commands;
-	count = sizeof(server_commands) / sizeof(command_t);
+	table = &server_commands_table;
 	break;
 
     case SRVCMD_TYPE_CLIENT:
-	commands = client_commands;
-	count = sizeof(client_commands) / sizeof(command_t);
+	table = &client_commands_table;
 	break;
 
     default:
-	commands = NULL;
-	count = 0;
+	table = NULL;
     }
 
     /* Execute command */
-    return command_exec(command, commands, count, console, buffer, &data);
+    return command_exec(command, table, console, buffer, &data);
 }
 
 /* End of file */
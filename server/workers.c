@@ -0,0 +1,618 @@
+/*
+ * ---------------------------------------------------------------------------
+ *
+ * Minitalk: a basic talk-like server/client
+ * Copyright (C) 2004 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: server/workers.c
+ *
+ * Description: Worker Threads
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+/*****************************************************************************
+ *
+ * Headers
+ *
+ */
+
+/* Feature test macros (sched_yield()) */
+#define _POSIX_C_SOURCE 200112L
+
+/* System headers */
+#include <stdlib.h>  /* malloc(), calloc(), free(), NULL */
+#include <string.h>  /* memcpy()                         */
+#include <unistd.h>  /* pipe(), read(), write(), close() */
+#include <fcntl.h>   /* fcntl(), O_NONBLOCK              */
+#include <sched.h>   /* sched_yield()                    */
+#include <assert.h>  /* assert()                         */
+#include <pthread.h> /* pthread_create(), pthread_join() */
+#ifdef __linux__
+# include <sys/eventfd.h> /* eventfd(), EFD_NONBLOCK */
+#endif
+
+/* Project headers */
+#include <common.h>
+#include <events.h>
+#include <dbuffer.h>
+#include <iobuffer.h>
+#include <queue.h>
+#include "registry.h"
+#include "clients.h"
+#include "workers.h"
+
+
+/*****************************************************************************
+ *
+ * Data types
+ *
+ */
+
+/* Message sent to another worker */
+typedef struct worker_msg {
+    worker_msg_type_t type;   /* Message type                         */
+    int               refs;   /* Number of workers still to handle it */
+    client_handle_t   handle; /* Target client (unless broadcast)     */
+    int               length; /* Data length                          */
+    char              data[]; /* Data sent to clients                 */
+} worker_msg_t;
+
+
+/*****************************************************************************
+ *
+ * Local variables
+ *
+ */
+
+/* Stop message (never freed, so that stopping cannot fail) */
+static worker_msg_t msg_stop = {WORKER_MSG_STOP, 0, {-1, 0}, 0};
+
+
+/*****************************************************************************
+ *
+ * Private functions
+ *
+ */
+
+/* Prototypes */
+static worker_msg_t *worker_msg_new(const worker_msg_type_t type,
+				    const client_handle_t handle,
+				    const char *const data, const int length,
+				    const int refs);
+static void worker_msg_release(worker_msg_t *const msg);
+static int  worker_push(worker_t *const worker, const int to,
+			worker_msg_t *const msg);
+static void worker_wake(worker_t *const worker);
+static void worker_notify(worker_t *const worker);
+static int  worker_handle(worker_t *const worker, worker_msg_t *const msg);
+static int  worker_receive(worker_t *const worker);
+static void workers_join(workers_t *const workers, const int count);
+static void *worker_thread(void *const data);
+
+/*
+ * Create a message handled by refs workers.
+ */
+static worker_msg_t *worker_msg_new(const worker_msg_type_t type,
+				    const client_handle_t handle,
+				    const char *const data, const int length,
+				    const int refs)
+{
+    worker_msg_t *msg; /* New message */
+
+    assert(data != NULL || length == 0);
+    assert(length >= 0);
+    assert(refs > 0);
+
+    if ((msg = malloc(sizeof(worker_msg_t) + length)) == NULL)
+	return NULL;
+
+    msg->type = type;
+    msg->refs = refs;
+    msg->handle = handle;
+    msg->length = length;
+    if (length != 0)
+	memcpy(msg->data, data, length);
+
+    return msg;
+}
+
+/*
+ * Drop a reference to a message, deleting it with the last one.
+ */
+static void worker_msg_release(worker_msg_t *const msg)
+{
+    assert(msg != NULL);
+
+    if (msg != &msg_stop &&
+	__atomic_sub_fetch(&msg->refs, 1, __ATOMIC_ACQ_REL) == 0)
+	free(msg);
+}
+
+/*
+ * Queue a message for another worker, which sees it (and is woken up) at the
+ * end of the iteration.  The message is released if the queue is full.
+ */
+static int worker_push(worker_t *const worker, const int to,
+		       worker_msg_t *const msg)
+{
+    worker_t *target; /* Receiving worker */
+
+    assert(worker != NULL);
+    assert(to >= 0 && to < worker->workers->count && to != worker->index);
+    assert(msg != NULL);
+
+    target = &worker->workers->workers[to];
+    if (queue_push(&target->inbox[worker->index], msg) != 0) {
+	/* The worker is too slow: its clients lose the message */
+	worker_msg_release(msg);
+	__atomic_add_fetch(&worker->clients.dropped, 1, __ATOMIC_RELAXED);
+	return -1;
+    }
+
+    worker->notify[to] = 1;
+    return 0;
+}
+
+/*
+ * Wake a worker up.
+ */
+static void worker_wake(worker_t *const worker)
+{
+    /* An eventfd needs 8 bytes: they add up to its counter */
+    static const unsigned long long one = 1;
+
+    assert(worker != NULL);
+
+    /* It may be full: the worker is already woken up then */
+    write(worker->wake[1], &one, sizeof(one));
+}
+
+/*
+ * Publish the messages queued for other workers and wake them up.
+ */
+static void worker_notify(worker_t *const worker)
+{
+    int       i;      /* Worker index     */
+    worker_t *target; /* Receiving worker */
+
+    assert(worker != NULL);
+
+    /* Once per iteration and worker, whatever the number of messages */
+    for (i = 0; i < worker->workers->count; i++)
+	if (worker->notify[i]) {
+	    worker->notify[i] = 0;
+	    target = &worker->workers->workers[i];
+	    queue_publish(&target->inbox[worker->index]);
+	    worker_wake(target);
+	}
+}
+
+/*
+ * Handle a message sent by another worker.  Returns 1 if the worker must
+ * stop.
+ */
+static int worker_handle(worker_t *const worker, worker_msg_t *const msg)
+{
+    assert(worker != NULL);
+    assert(msg != NULL);
+
+    switch (msg->type) {
+    case WORKER_MSG_BROADCAST:
+	clients_deliver(&worker->clients, msg->data, msg->length, NULL);
+	break;
+
+    case WORKER_MSG_DIRECT:
+	clients_deliver_to(&worker->clients, msg->handle, msg->data,
+			   msg->length);
+	break;
+
+    case WORKER_MSG_KILL:
+	clients_deliver_kill(&worker->clients, msg->handle);
+	break;
+
+    case WORKER_MSG_STOP:
+	return 1;
+    }
+
+    worker_msg_release(msg);
+    return 0;
+}
+
+/*
+ * Handle the messages sent by other workers, by batches.  Returns 1 if the
+ * worker must stop.
+ */
+static int worker_receive(worker_t *const worker)
+{
+    int   i;                         /* Sending worker    */
+    int   j;                         /* Message index     */
+    int   count;                     /* Received messages */
+    int   stop;                      /* Stop indicator    */
+    void *batch[WORKERS_BATCH_SIZE]; /* Received messages */
+
+    assert(worker != NULL);
+
+    stop = 0;
+    for (i = 0; i < worker->workers->count; i++) {
+	if (i == worker->index)
+	    continue;
+
+	while ((count = queue_pop_batch(&worker->inbox[i], batch,
+					WORKERS_BATCH_SIZE)) != 0)
+	    for (j = 0; j < count; j++)
+		if (worker_handle(worker, batch[j]) != 0)
+		    stop = 1;
+    }
+
+    return stop;
+}
+
+/*
+ * Stop the workers started by the first one, up to count, and wait for them.
+ */
+static void workers_join(workers_t *const workers, const int count)
+{
+    int       i;      /* Worker index   */
+    worker_t *target; /* Stopped worker */
+
+    assert(workers != NULL);
+    assert(count <= workers->count);
+
+    /* Queues keep their order: messages sent before are handled first */
+    for (i = 1; i < count; i++) {
+	target = &workers->workers[i];
+	while (queue_push(&target->inbox[0], &msg_stop) != 0) {
+	    queue_publish(&target->inbox[0]);
+	    worker_wake(target);
+	    sched_yield();
+	}
+	queue_publish(&target->inbox[0]);
+	worker_wake(target);
+    }
+
+    for (i = 1; i < count; i++)
+	pthread_join(workers->workers[i].thread, NULL);
+}
+
+/*
+ * Run the loop of a worker other than the first one.
+ */
+static void *worker_thread(void *const data)
+{
+    worker_t *worker; /* Running worker */
+
+    static const char msg_reserve[] = "Error while allocating client "
+	"slots.\n";
+
+    worker = data;
+
+    /* Buffer pools are per thread: reserve them in the thread itself */
+    if (worker->reserve != 0 &&
+	clients_reserve(&worker->clients, worker->reserve) != 0)
+	iobuffer_put_data(&worker->console, msg_reserve,
+			  sizeof(msg_reserve) - 1);
+
+    do
+	events_wait(&worker->events, -1);
+    while (worker_process(worker) == 0);
+
+    /* The worker is freed by the main thread: its buffers go to that pool */
+    dbuffer_pool_free();
+    return NULL;
+}
+
+
+/*****************************************************************************
+ *
+ * Public functions
+ *
+ */
+
+/*
+ * Initialize a set of workers and the queues between them.
+ */
+int workers_init(workers_t *const workers, const int count)
+{
+    int       i;      /* Worker index   */
+    int       j;      /* Sender index   */
+    worker_t *worker; /* Current worker */
+
+    assert(workers != NULL);
+    assert(count > 0 && count <= WORKERS_MAX);
+
+    if (registry_init(&workers->registry) != 0)
+	return -1;
+    workers->count = count;
+    if ((workers->workers = calloc(count, sizeof(worker_t))) == NULL) {
+	registry_free(&workers->registry);
+	return -1;
+    }
+
+    for (i = 0; i < count; i++) {
+	worker = &workers->workers[i];
+	worker->index = i;
+	worker->workers = workers;
+	worker->srv_sock = -1;
+	worker->wake[0] = -1;
+	worker->wake[1] = -1;
+    }
+
+    /* One queue per pair of workers: each has a single producer */
+    for (i = 0; i < count; i++) {
+	worker = &workers->workers[i];
+	if ((worker->inbox = calloc(count, sizeof(queue_t))) == NULL ||
+	    (worker->notify = calloc(count, 1)) == NULL) {
+	    workers_free(workers);
+	    return -1;
+	}
+
+	for (j = 0; j < count; j++)
+	    if (j != i &&
+		queue_init(&worker->inbox[j], WORKERS_QUEUE_SIZE) != 0) {
+		workers_free(workers);
+		return -1;
+	    }
+    }
+
+    return 0;
+}
+
+/*
+ * Free the set of workers (once they are all stopped).
+ */
+void workers_free(workers_t *const workers)
+{
+    int           i;      /* Worker index    */
+    int           j;      /* Sender index    */
+    worker_t     *worker; /* Current worker  */
+    worker_msg_t *msg;    /* Pending message */
+
+    assert(workers != NULL);
+
+    for (i = 0; i < workers->count; i++) {
+	worker = &workers->workers[i];
+
+	/* Messages sent to stopped workers are lost */
+	if (worker->inbox != NULL)
+	    for (j = 0; j < workers->count; j++)
+		if (worker->inbox[j].items != NULL) {
+		    while ((msg = queue_pop(&worker->inbox[j])) != NULL)
+			worker_msg_release(msg);
+		    queue_free(&worker->inbox[j]);
+		}
+	free(worker->inbox);
+	free(worker->notify);
+
+	/* Others may wake a worker up until they stop too */
+	if (worker->wake[0] != -1)
+	    close(worker->wake[0]);
+	if (worker->wake[1] != worker->wake[0])
+	    close(worker->wake[1]);
+    }
+
+    free(workers->workers);
+    registry_free(&workers->registry);
+    workers->workers = NULL;
+    workers->count = 0;
+}
+
+/*
+ * Initialize a worker listening on a server socket (the first worker also
+ * reads the console from input_fd, others use -1).
+ */
+int worker_init(worker_t *const worker, const int srv_sock,
+		const int input_fd, const events_backend_t backend)
+{
+    assert(worker != NULL);
+    assert(srv_sock >= 0);
+
+    /* Wake-up descriptor: written by other workers, never blocking them
+     * (an eventfd is cheaper than a pipe, which is the fallback) */
+#ifdef EFD_NONBLOCK
+    worker->wake[0] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    worker->wake[1] = worker->wake[0];
+#endif
+    if (worker->wake[0] == -1) {
+	if (pipe(worker->wake) != 0) {
+	    worker->wake[0] = -1;
+	    worker->wake[1] = -1;
+	    return -1;
+	}
+	fcntl(worker->wake[0], F_SETFL, fcntl(worker->wake[0], F_GETFL)
+	      | O_NONBLOCK);
+	fcntl(worker->wake[1], F_SETFL, fcntl(worker->wake[1], F_GETFL)
+	      | O_NONBLOCK);
+    }
+
+    if (events_init(&worker->events, backend) != 0)
+	return -1;
+
+    worker->srv_sock = srv_sock;
+    iobuffer_init(&worker->console, input_fd, STDOUT_FILENO,
+		  &worker->events, '\n');
+    clients_init(&worker->clients, &worker->events, &worker->console,
+		 srv_sock, worker);
+
+    /* Watch the console, the server socket and the wake-up descriptor */
+    if (input_fd != -1)
+	events_watch(&worker->events, input_fd, EVENTS_READ);
+    events_watch(&worker->events, srv_sock, EVENTS_READ);
+    events_watch(&worker->events, worker->wake[0], EVENTS_READ);
+
+    return 0;
+}
+
+/*
+ * Free a worker, flushing its output and closing its sockets.
+ */
+void worker_free(worker_t *const worker)
+{
+    assert(worker != NULL);
+
+    /* Flush buffers (write without waiting for readiness) */
+    iobuffer_set_events(&worker->console, NULL);
+    iobuffer_write(&worker->console);
+    clients_flush(&worker->clients);
+
+    /* Free memory and close sockets */
+    clients_free(&worker->clients);
+    iobuffer_free(&worker->console);
+    close(worker->srv_sock);
+    events_free(&worker->events);
+}
+
+/*
+ * Start the threads of the workers other than the first one, which runs in
+ * the calling thread.
+ */
+int workers_start(workers_t *const workers)
+{
+    int i; /* Worker index */
+
+    assert(workers != NULL);
+
+    for (i = 1; i < workers->count; i++)
+	if (pthread_create(&workers->workers[i].thread, NULL, worker_thread,
+			   &workers->workers[i]) != 0) {
+	    workers_join(workers, i);
+	    return -1;
+	}
+
+    return 0;
+}
+
+/*
+ * Stop the threads of the other workers (called by the first one), which
+ * can be freed then.
+ */
+void workers_stop(workers_t *const workers)
+{
+    assert(workers != NULL);
+
+    workers_join(workers, workers->count);
+}
+
+/*
+ * Handle the events of a worker once they have been waited for.  Returns 1
+ * if the worker must stop.
+ */
+int worker_process(worker_t *const worker)
+{
+    char drain[64]; /* Wake-up counter or bytes */
+
+    assert(worker != NULL);
+
+    /* Check main server socket: accept connections and add clients */
+    if (events_is_ready(&worker->events, worker->srv_sock, EVENTS_READ))
+	clients_accept(&worker->clients);
+
+    /* Queues are checked at each iteration: wake-up bytes are just eaten */
+    if (events_is_ready(&worker->events, worker->wake[0], EVENTS_READ))
+	while (read(worker->wake[0], drain, sizeof(drain)) > 0)
+	    ;
+    if (worker_receive(worker) != 0)
+	return 1;
+
+    /* Check client sockets */
+    clients_read(&worker->clients);
+
+    /* Check output streams */
+    clients_write(&worker->clients);
+    iobuffer_write(&worker->console);
+
+    /* Other workers handle the messages sent during this iteration */
+    worker_notify(worker);
+    return 0;
+}
+
+/*
+ * Send a message to a client of another worker, or kill it.
+ */
+int worker_post(worker_t *const worker, const int to,
+		const worker_msg_type_t type, const client_handle_t handle,
+		const char *const data, const int length)
+{
+    worker_msg_t *msg; /* New message */
+
+    assert(worker != NULL);
+    assert(type == WORKER_MSG_DIRECT || type == WORKER_MSG_KILL);
+
+    if ((msg = worker_msg_new(type, handle, data, length, 1)) == NULL)
+	return -1;
+    return worker_push(worker, to, msg);
+}
+
+/*
+ * Send a message to the clients of all other workers.
+ */
+void worker_broadcast(worker_t *const worker, const char *const data,
+		      const int length)
+{
+    int             i;      /* Worker index   */
+    worker_msg_t   *msg;    /* Shared message */
+    client_handle_t handle; /* Unused target  */
+
+    assert(worker != NULL);
+    assert(data != NULL);
+
+    if (worker->workers->count == 1)
+	return;
+
+    /* One copy is shared by all workers: the last one frees it */
+    handle.slot = -1;
+    handle.generation = 0;
+    if ((msg = worker_msg_new(WORKER_MSG_BROADCAST, handle, data, length,
+			      worker->workers->count - 1)) == NULL) {
+	__atomic_add_fetch(&worker->clients.dropped, 1, __ATOMIC_RELAXED);
+	return;
+    }
+
+    for (i = 0; i < worker->workers->count; i++)
+	if (i != worker->index)
+	    worker_push(worker, i, msg);
+}
+
+/*
+ * Get the numbers of messages dropped and clients evicted by all workers.
+ */
+void workers_get_stats(workers_t *const workers,
+		       unsigned long *const dropped,
+		       unsigned long *const evicted)
+{
+    int i; /* Worker index */
+
+    assert(workers != NULL);
+    assert(dropped != NULL);
+    assert(evicted != NULL);
+
+    *dropped = 0;
+    *evicted = 0;
+    for (i = 0; i < workers->count; i++) {
+	*dropped += __atomic_load_n(&workers->workers[i].clients.dropped,
+				    __ATOMIC_RELAXED);
+	*evicted += __atomic_load_n(&workers->workers[i].clients.evicted,
+				    __ATOMIC_RELAXED);
+    }
+}
+
+/* End of file */
@@ -0,0 +1,140 @@
+/*
+ * ---------------------------------------------------------------------------
+ *
+ * Minitalk: a basic talk-like server/client
+ * Copyright (C) 2004 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: server/workers.h
+ *
+ * Description: Worker Threads (Header)
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+#ifndef WORKERS_H
+#define WORKERS_H
+
+/*
+ * Headers
+ */
+
+/* System headers */
+#include <pthread.h> /* pthread_t */
+
+/* Project headers */
+#include <events.h>   /* events_t   */
+#include <iobuffer.h> /* iobuffer_t */
+#include <queue.h>    /* queue_t    */
+#include "clients.h"  /* clients_t  */
+#include "registry.h" /* registry_t */
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+
+/*
+ * Constants
+ */
+
+/* Maximum number of workers */
+#define WORKERS_MAX 64
+
+/* Number of messages which can be pending between two workers */
+#define WORKERS_QUEUE_SIZE 4096
+
+/* Number of messages taken from a queue at once */
+#define WORKERS_BATCH_SIZE 64
+
+
+/*
+ * Data types
+ */
+
+/* Type of a message sent to another worker */
+typedef enum worker_msg_type {
+    WORKER_MSG_BROADCAST, /* Send data to all authenticated clients */
+    WORKER_MSG_DIRECT,    /* Send data to one client                */
+    WORKER_MSG_KILL,      /* Kill one client                        */
+    WORKER_MSG_STOP       /* Stop the worker                        */
+} worker_msg_type_t;
+
+/* Thread serving the clients accepted on its own listening socket */
+typedef struct worker {
+    int             index;    /* Index of the worker                  */
+    struct workers *workers;  /* Set of all workers                   */
+    pthread_t       thread;   /* Thread (unused for the first worker) */
+    int             reserve;  /* Client slots to allocate at startup  */
+    int             srv_sock; /* Server socket                        */
+    int             wake[2];  /* Eventfd (twice) or pipe waking it up */
+    events_t        events;   /* Event manager                        */
+    iobuffer_t      console;  /* Console (only first worker reads it) */
+    clients_t       clients;  /* Clients served by the worker         */
+    queue_t        *inbox;    /* Messages from each other worker      */
+    char           *notify;   /* Workers to wake up after iteration   */
+} worker_t;
+
+/* Set of workers */
+typedef struct workers {
+    int        count;    /* Number of workers                   */
+    worker_t  *workers;  /* Workers (the first runs in main())  */
+    registry_t registry; /* Nicknames of all workers' clients   */
+} workers_t;
+
+
+/*
+ * Prototypes
+ */
+
+/* Constructors and destructors */
+int  workers_init(workers_t *const workers, const int count);
+void workers_free(workers_t *const workers);
+int  worker_init(worker_t *const worker, const int srv_sock,
+		 const int input_fd, const events_backend_t backend);
+void worker_free(worker_t *const worker);
+
+/* Threads */
+int  workers_start(workers_t *const workers);
+void workers_stop(workers_t *const workers);
+int  worker_process(worker_t *const worker);
+
+/* Messages */
+int  worker_post(worker_t *const worker, const int to,
+		 const worker_msg_type_t type, const client_handle_t handle,
+		 const char *const data, const int length);
+void worker_broadcast(worker_t *const worker, const char *const data,
+		      const int length);
+
+/* Statistics */
+void workers_get_stats(workers_t *const workers,
+		       unsigned long *const dropped,
+		       unsigned long *const evicted);
+
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !WORKERS_H */
+
+/* End of file */
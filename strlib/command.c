@@ -37,10 +37,10 @@
  */
 
 /* System headers */
-#include <stdlib.h> /* malloc(), free()             */
+#include <stdlib.h> /* NULL                         */
 #include <stdio.h>  /* snprintf()                   */
 #include <unistd.h> /* write()                      */
-#include <string.h> /* strcmp(), strlen(), memcpy() */
+#include <string.h> /* strlen(), memcmp()           */
 #include <assert.h> /* assert()                     */
 
 /* Project headers */
@@ -57,39 +57,33 @@
 
 /* Prototypes */
 static const command_t *command_find(const char *const command,
-				     const command_t *const commands,
-				     const int count);
+				     const command_table_t *const table);
 
 /*
- * Search a command in a provided command list.
+ * Search a command in a provided command table.
  */
 static const command_t *command_find(const char *const command,
-				     const command_t *const commands,
-				     const int count)
+				     const command_table_t *const table)
 {
-    int start;
-    int end;
-    int pos;
-    int cmp;
+    int                   len;  /* Command length */
+    unsigned              key;  /* Hash key       */
+    const command_slot_t *slot; /* Hash slot      */
 
     assert(command != NULL);
-    assert(commands != NULL);
-
-    start = 0;
-    end = count - 1;
-    pos = end / 2;
-
-    /* Dichotomic search */
-    while ((cmp = strcmp(command, commands[pos].name)) != 0 && start < end) {
-	if (cmp < 0)
-	    end = pos - 1;
-	else
-	    start = pos + 1;
-	pos = (start + end) / 2;
-    }
+    assert(table != NULL);
+
+    if ((len = strlen(command)) == 0)
+	return NULL;
 
-    if (cmp == 0)
-	return commands + pos;
+    /* Same key as in config/cmdtab.awk: the slot is the only candidate */
+    key = (unsigned char) command[0] +
+	131 * (unsigned) (unsigned char) command[len / 2] +
+	17161 * (unsigned) (unsigned char) command[len - 1] + 7 * len;
+    slot = table->slots + (((key * table->seed) >> 8) & table->mask);
+
+    if (slot->index != -1 && slot->length == len &&
+	memcmp(command, table->commands[slot->index].name, len) == 0)
+	return table->commands + slot->index;
     return NULL;
 }
 
@@ -101,61 +95,40 @@ static const command_t *command_find(const char *const command,
  */
 
 /*
- * Split a command line in different tokens (blank-character-separated).
+ * Split a command line in different tokens (blank-character-separated) in a
+ * single pass; return -1 if there are more than `size' of them.
  */
-int command_get_tokens(char *const command, char ***const args)
+int command_get_tokens(char *const command, char **const args,
+		       const int size)
 {
-    int i;
-    int count;
-    char chr;
+    int   count; /* Number of tokens  */
+    char *chr;   /* Current character */
 
     assert(command != NULL);
     assert(args != NULL);
 
     count = 0;
-    i = 0;
-    chr = command[0];
-
-    /* Count arguments */
-    while (chr != '\n') {
-	while ((chr == ' ' || chr == '\t') && chr != '\n')
-	    chr = command[++i];
+    chr = command;
 
-	if (chr != '\n')
-	    count++;
-	else
+    while (1) {
+	/* Skip blanks */
+	while (*chr == ' ' || *chr == '\t')
+	    chr++;
+	if (*chr == '\n' || *chr == '\0')
 	    break;
 
-	do
-	    chr = command[++i];
-	while (chr != ' ' && chr != '\t' && chr != '\n');
-    }
-
-    if (count == 0)
-	return 0;
-
-    /* Allocate argument table */
-    if ((*args = malloc(count * sizeof(**args))) == NULL)
-	return -1;
+	if (count == size)
+	    return -1;
+	args[count++] = chr;
 
-    count = 0;
-    i = 0;
-    chr = command[0];
-
-    /* Split arguments and fill argument table */
-    while (chr != '\n') {
-	while ((chr == ' ' || chr == '\t') && chr != '\n')
-	    chr = command[++i];
-
-	if (chr != '\n')
-	    (*args)[count++] = command + i;
-	else
+	/* Find the end of the token and terminate it */
+	while (*chr != ' ' && *chr != '\t' && *chr != '\n' && *chr != '\0')
+	    chr++;
+	if (*chr == '\n' || *chr == '\0') {
+	    *chr = '\0';
 	    break;
-
-	do
-	    chr = command[++i];
-	while (chr != ' ' && chr != '\t' && chr != '\n');
-	command[i] = '\0';
+	}
+	*chr++ = '\0';
     }
 
     return count;
@@ -164,30 +137,31 @@ int command_get_tokens(char *const command, char ***const args)
 /**
  * Execute a command line in the provided command list, with given parameters.
  */
-int command_exec(char *const command, const command_t *const commands,
-		 const int count, struct iobuffer *const console,
-		 struct iobuffer *const buffer, void *const data)
+int command_exec(char *const command, const command_table_t *const table,
+		 struct iobuffer *const console, struct iobuffer *const buffer,
+		 void *const data)
 {
     int arg_count;
     const command_t *cmd;
     int res;
-    char **args;
+    char *args[COMMAND_MAX_ARGS];
 
     /* Error messages */
     static const char msg_no_cmd[] = "No command entered.  Syntax: "
 	"/command [arg 1] [arg 2] ... [arg n]\nType `/help' to get a command "
 	"list.\n";
     static const char msg_mem[] = "Error: no more memory!\n";
+    static const char msg_many[] = "Too many arguments.\n";
     static const char msg_count[] = "Wrong argument count";
     static const char msg_none[] = ": this command takes none.\n";
     static const char msg_unknown[] = "Unknown command.  Type `/help' to get "
 	"a command list.\n";
 
     assert(command != NULL);
-    assert(commands != NULL);
+    assert(table != NULL);
 
     /* Split arguments */
-    arg_count = command_get_tokens(command, &args);
+    arg_count = command_get_tokens(command, args, COMMAND_MAX_ARGS);
 
     if (arg_count == 0) {
 	if (buffer != NULL)
@@ -196,12 +170,13 @@ int command_exec(char *const command, const command_t *const commands,
     }
     if (arg_count == -1) {
 	if (buffer != NULL)
-	    iobuffer_put_data(buffer, msg_mem, sizeof(msg_mem) - 1);
-	return 2;
+	    iobuffer_put_data(buffer, msg_many, sizeof(msg_many) - 1);
+	return 0;
     }
 
-    if ((cmd = command_find(args[0], commands, count)) != NULL) {
-	if (arg_count == cmd->arg_count + 1) {
+    if ((cmd = command_find(args[0], table)) != NULL) {
+	if (arg_count > cmd->arg_count &&
+	    arg_count <= cmd->arg_count + cmd->opt_count + 1) {
 	    /* Correct syntax: execute command */
 	    res = cmd->function(arg_count, args, console, buffer, data);
 
@@ -216,7 +191,7 @@ int command_exec(char *const command, const command_t *const commands,
 	    /* Print the syntax error */
 	    if (buffer != NULL) {
 		iobuffer_put_data(buffer, msg_count, sizeof(msg_count) - 1);
-		if (cmd->arg_count != 0) {
+		if (cmd->arg_count + cmd->opt_count != 0) {
 		    iobuffer_put_data(buffer, ".  Syntax: /", 12);
 		    iobuffer_put_data(buffer, args[0], strlen(args[0]));
 		    iobuffer_put_data(buffer, " ", 1);
@@ -235,9 +210,6 @@ int command_exec(char *const command, const command_t *const commands,
 	res = 0;
     }
 
-    /* Free memory (because I'm worth it) */
-    free(args);
-
     return res;
 }
 
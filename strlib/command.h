@@ -38,6 +38,14 @@ extern "C" {
 #endif /* __cplusplus */
 
 
+/*
+ * Constants
+ */
+
+/* Maximum number of tokens in a command line (command name included) */
+#define COMMAND_MAX_ARGS 16
+
+
 /*
  * Data types
  */
@@ -53,20 +61,36 @@ typedef int (*command_func_t)(int arg_count, char **args,
 /* Command structure */
 typedef struct command {
     const char    *name;      /* Command name                     */
-    int            arg_count; /* Argument count                   */
+    int            arg_count; /* Mandatory argument count         */
+    int            opt_count; /* Optional argument count          */
     const char    *syntax;    /* String describing command syntax */
     command_func_t function;  /* Callback function                */
 } command_t;
 
+/* Slot of a command table hash */
+typedef struct command_slot {
+    int index;  /* Command index (-1 if empty) */
+    int length; /* Command name length         */
+} command_slot_t;
+
+/* Command table with its perfect hash (generated by config/cmdtab.awk) */
+typedef struct command_table {
+    const command_t      *commands; /* Commands                   */
+    const command_slot_t *slots;    /* Hash slots                 */
+    unsigned              mask;     /* Number of slots - 1        */
+    unsigned              seed;     /* Multiplier of the hash key */
+} command_table_t;
+
 
 /*
  * Prototypes
  */
 
-int command_get_tokens(char *const command, char ***const args);
-int command_exec(char *const command, const command_t *const commands,
-		 const int count, struct iobuffer *const console,
-		 struct iobuffer *const buffer, void *const data);
+int command_get_tokens(char *const command, char **const args,
+		       const int size);
+int command_exec(char *const command, const command_table_t *const table,
+		 struct iobuffer *const console, struct iobuffer *const buffer,
+		 void *const data);
 
 
 #ifdef __cplusplus
@@ -37,16 +37,21 @@
  */
 
 /* System headers */
-#include <stdlib.h> /* malloc(), free(), NULL */
-#include <unistd.h> /* read(), write()        */
-#include <string.h> /* memcpy()               */
-#include <assert.h> /* assert()               */
+#include <stdlib.h> /* malloc(), free(), NULL       */
+#include <string.h> /* memcpy(), memchr(), memset() */
+#include <errno.h>  /* errno, E*                    */
+#include <assert.h> /* assert()                     */
 
-/* Network-related headers */
-#include <sys/select.h> /* fd_set, FD_*() */
+/* Unix headers */
+#include <fcntl.h>      /* fcntl(), O_NONBLOCK             */
+#include <sys/uio.h>    /* readv(), writev(), struct iovec */
+#include <sys/socket.h> /* sendmsg(), MSG_MORE             */
 
 /* Project headers */
 #include <common.h>
+#include "events.h"
+#include "segment.h"
+#include "rbuffer.h"
 #include "dbuffer.h"
 
 
@@ -60,6 +65,26 @@
 # define BUFFER_SIZE 256
 #endif
 
+/* Chunk size limits: sizes are powers of two, one pool class per size */
+#define BUFFER_MIN_SIZE 64
+#define BUFFER_MAX_SIZE 65536
+#define BUFFER_CLASSES  11 /* Number of sizes from minimum to maximum */
+
+/* Maximum number of free internal buffers of default size in the pools */
+#ifndef BUFFER_POOL_SIZE
+# define BUFFER_POOL_SIZE 1024
+#endif
+
+/* Maximum number of internal buffers filled by a single readv() call */
+#ifndef BUFFER_READ_CHUNKS
+# define BUFFER_READ_CHUNKS 16
+#endif
+
+/* Maximum number of internal buffers written by a single writev() call */
+#ifndef BUFFER_IOVECS
+# define BUFFER_IOVECS 64
+#endif
+
 
 /*****************************************************************************
  *
@@ -69,12 +94,40 @@
 
 /* Internal buffer */
 typedef struct ibuffer {
-    struct ibuffer *next;               /* Next element in linked list      */
-    int             start;              /* Start of buffer in data (offset) */
-    int             end;                /* End of buffer in data (padding)  */
-    char            data[BUFFER_SIZE];  /* Data containing the buffer       */
+    struct ibuffer *next;      /* Next element in linked list            */
+    int             start;     /* Start of buffer in data (offset)       */
+    int             end;       /* End of buffer in data (padding)        */
+    int             size;      /* Capacity of data                       */
+    char           *data;      /* Data containing the buffer             */
+    segment_t      *segment;   /* Referenced segment (NULL if own data)  */
+    char            storage[]; /* Own data (absent for segments)         */
 } ibuffer_t;
 
+/* Pool of free internal buffers of one class */
+typedef struct ibuffer_pool {
+    ibuffer_t *first;    /* First free internal buffer        */
+    int        count;    /* Number of free internal buffers   */
+    int        reserved; /* Number of buffers always kept     */
+} ibuffer_pool_t;
+
+
+/*****************************************************************************
+ *
+ * Local variables
+ *
+ */
+
+/* Chunk size and backend of new dynamic buffers */
+static int               default_chunk = BUFFER_SIZE;
+static dbuffer_backend_t default_backend = DBUFFER_BACKEND_LIST;
+
+/* Free internal buffers: one pool per size, the last one for segments (each
+ * thread has its own pools, so that they need no locking) */
+static THREAD_LOCAL ibuffer_pool_t pools[BUFFER_CLASSES + 1];
+
+/* Pool statistics */
+static THREAD_LOCAL dbuffer_stats_t pool_stats = {0, 0, 0, 0, 0};
+
 
 /*****************************************************************************
  *
@@ -83,27 +136,250 @@ typedef struct ibuffer {
  */
 
 /* Prototypes */
-static ibuffer_t *ibuffer_new(void);
+static int        ibuffer_class(const int size);
+static ibuffer_t *ibuffer_alloc(const int class);
+static ibuffer_t *ibuffer_new(const int size);
+static ibuffer_t *ibuffer_new_segment(segment_t *const segment);
+static void       ibuffer_delete(ibuffer_t *const ibuffer);
+static void       dbuffer_adapt(dbuffer_t *const buffer, const int amount);
+static rbuffer_t *dbuffer_ring(dbuffer_t *const buffer);
+static int        dbuffer_ring_read(dbuffer_t *const buffer);
+static int        dbuffer_read_result(const int total, const int len);
+static int        dbuffer_writev(const int fd, struct iovec *const iov,
+				 const int count, const int more);
+
+/*
+ * Get the pool class of an internal buffer size (rounded up).
+ */
+static int ibuffer_class(const int size)
+{
+    int class;
+
+    assert(size <= BUFFER_MAX_SIZE);
+
+    for (class = 0; (BUFFER_MIN_SIZE << class) < size; class++)
+	;
+    return class;
+}
+
+/*
+ * Take an internal buffer from a pool, or allocate it if the pool is empty.
+ */
+static ibuffer_t *ibuffer_alloc(const int class)
+{
+    ibuffer_t      *ibuffer;
+    ibuffer_pool_t *pool;
+
+    assert(class >= 0 && class <= BUFFER_CLASSES);
+    pool = &pools[class];
+
+    if ((ibuffer = pool->first) != NULL) {
+	pool->first = ibuffer->next;
+	pool->count--;
+	pool_stats.hits++;
+	return ibuffer;
+    }
+
+    pool_stats.misses++;
+    if (class == BUFFER_CLASSES)
+	return malloc(sizeof(ibuffer_t));
+    return malloc(sizeof(ibuffer_t) + (BUFFER_MIN_SIZE << class));
+}
 
 /*
  * Create a new internal buffer.
  */
-static ibuffer_t *ibuffer_new(void)
+static ibuffer_t *ibuffer_new(const int size)
 {
+    int        class;
     ibuffer_t *ibuffer;
 
     /* Allocate buffer */
-    if ((ibuffer = malloc(sizeof(ibuffer_t))) == NULL)
+    class = ibuffer_class(size);
+    if ((ibuffer = ibuffer_alloc(class)) == NULL)
 	return NULL;
 
     /* Initialize buffer */
     ibuffer->next = NULL;
     ibuffer->start = 0;
     ibuffer->end = 0;
+    ibuffer->size = BUFFER_MIN_SIZE << class;
+    ibuffer->data = ibuffer->storage;
+    ibuffer->segment = NULL;
+
+    return ibuffer;
+}
+
+/*
+ * Create a new internal buffer referencing a segment (which is full).
+ */
+static ibuffer_t *ibuffer_new_segment(segment_t *const segment)
+{
+    ibuffer_t *ibuffer;
+
+    assert(segment != NULL);
+
+    /* Allocate buffer without own data */
+    if ((ibuffer = ibuffer_alloc(BUFFER_CLASSES)) == NULL)
+	return NULL;
+
+    /* Initialize buffer */
+    ibuffer->next = NULL;
+    ibuffer->start = 0;
+    ibuffer->end = segment->size;
+    ibuffer->size = segment->size;
+    ibuffer->data = segment->data;
+    ibuffer->segment = segment_ref(segment);
 
     return ibuffer;
 }
 
+/*
+ * Delete an internal buffer, giving it back to its pool if it is not full.
+ */
+static void ibuffer_delete(ibuffer_t *const ibuffer)
+{
+    int             limit; /* Maximum number of pooled buffers */
+    ibuffer_pool_t *pool;  /* Pool of the buffer class         */
+
+    assert(ibuffer != NULL);
+
+    /* Pools of large buffers hold fewer of them */
+    if (ibuffer->segment != NULL) {
+	segment_release(ibuffer->segment);
+	pool = &pools[BUFFER_CLASSES];
+	limit = BUFFER_POOL_SIZE;
+    } else {
+	pool = &pools[ibuffer_class(ibuffer->size)];
+	limit = BUFFER_POOL_SIZE * BUFFER_SIZE / ibuffer->size;
+    }
+    if (limit < pool->reserved)
+	limit = pool->reserved;
+
+    if (pool->count < limit) {
+	ibuffer->next = pool->first;
+	pool->first = ibuffer;
+	pool->count++;
+	pool_stats.releases++;
+    } else {
+	free(ibuffer);
+	pool_stats.frees++;
+    }
+}
+
+/*
+ * Adapt the chunk size to the amount of data just transferred: double it on
+ * sustained traffic, halve it back to the default when traffic is low.
+ */
+static void dbuffer_adapt(dbuffer_t *const buffer, const int amount)
+{
+    assert(buffer != NULL);
+
+    if (amount >= buffer->chunk) {
+	if (buffer->chunk < BUFFER_MAX_SIZE)
+	    buffer->chunk *= 2;
+    } else if (amount < buffer->chunk / 4 && buffer->chunk > default_chunk)
+	buffer->chunk /= 2;
+}
+
+/*
+ * Get the ring of a buffer using the ring backend, creating it if needed.
+ */
+static rbuffer_t *dbuffer_ring(dbuffer_t *const buffer)
+{
+    assert(buffer != NULL);
+    assert(buffer->backend == DBUFFER_BACKEND_RING);
+
+    if (buffer->ring == NULL)
+	buffer->ring = rbuffer_new(buffer->chunk);
+    return buffer->ring;
+}
+
+/*
+ * Get the value returned by a read given the result of the last readv().
+ */
+static int dbuffer_read_result(const int total, const int len)
+{
+    /* Data read before an end of file or an error is returned first */
+    if (total != 0)
+	return total;
+    if (len == -1)
+	return errno == EAGAIN || errno == EWOULDBLOCK ? -2 : -1;
+    return 0;
+}
+
+/*
+ * Read data into the ring of a buffer, growing it on sustained traffic.
+ */
+static int dbuffer_ring_read(dbuffer_t *const buffer)
+{
+    int          total;  /* Number of read bytes  */
+    int          len;    /* Read data length      */
+    int          size;   /* Free space            */
+    int          count;  /* Number of I/O vectors */
+    rbuffer_t   *ring;   /* Ring buffer           */
+    struct iovec iov[2]; /* Free space vectors    */
+
+    assert(buffer != NULL);
+
+    if ((ring = dbuffer_ring(buffer)) == NULL)
+	return -1;
+
+    total = 0;
+
+    do {
+	/* Make room for at least a chunk */
+	if (rbuffer_reserve(ring, buffer->chunk) != 0)
+	    return total != 0 ? total : -1;
+	count = rbuffer_get_space(ring, iov);
+	size = rbuffer_get_capacity(ring) - rbuffer_get_size(ring);
+
+	/* Read data in the free space (wrapping around) */
+	while ((len = readv(buffer->fd, iov, count)) == -1 && errno == EINTR)
+	    ;
+	if (len <= 0)
+	    break;
+	rbuffer_commit(ring, len);
+	total += len;
+    } while (len == size);
+
+    buffer->size += total;
+    if (total > 0)
+	dbuffer_adapt(buffer, total);
+    return dbuffer_read_result(total, len);
+}
+
+/*
+ * Write a batch of vectors, telling sockets if more data follows so that
+ * they do not send a partial packet.
+ */
+static int dbuffer_writev(const int fd, struct iovec *const iov,
+			  const int count, const int more)
+{
+    int           len; /* Written data length */
+#ifdef MSG_MORE
+    struct msghdr msg; /* Socket message      */
+
+    if (more) {
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = count;
+	while ((len = sendmsg(fd, &msg, MSG_MORE)) == -1 && errno == EINTR)
+	    ;
+
+	/* Not a socket: use writev() */
+	if (len != -1 || errno != ENOTSOCK)
+	    return len;
+    }
+#else
+    (void) more;
+#endif
+
+    while ((len = writev(fd, iov, count)) == -1 && errno == EINTR)
+	;
+    return len;
+}
+
 
 /*****************************************************************************
  *
@@ -114,12 +390,13 @@ static ibuffer_t *ibuffer_new(void)
 /*
  * Create a new buffer.
  */
-dbuffer_t *dbuffer_new(const int fd, fd_set *const fds, const char separator)
+dbuffer_t *dbuffer_new(const int fd, events_t *const events,
+		       const char separator)
 {
     dbuffer_t *buffer;
 
     if ((buffer = malloc(sizeof(dbuffer_t))) != NULL)
-	dbuffer_init(buffer, fd, fds, separator);
+	dbuffer_init(buffer, fd, events, separator);
     return buffer;
 }
 
@@ -137,8 +414,8 @@ void dbuffer_delete(dbuffer_t *const buffer)
 /*
  * Initialize a buffer.
  */
-void dbuffer_init(dbuffer_t *const buffer, const int fd, fd_set *const fds,
-		  const char separator)
+void dbuffer_init(dbuffer_t *const buffer, const int fd,
+		  events_t *const events, const char separator)
 {
     assert(buffer != NULL);
 
@@ -146,8 +423,17 @@ void dbuffer_init(dbuffer_t *const buffer, const int fd, fd_set *const fds,
     buffer->last = NULL;
     buffer->size = 0;
     buffer->fd = fd;
-    buffer->fds = fds;
+    buffer->events = events;
+    buffer->nonblock = -1;
+    buffer->blocked = 0;
     buffer->separator = separator;
+    buffer->chunk = default_chunk;
+    buffer->scanned = 0;
+    buffer->pending = 0;
+    buffer->scratch = NULL;
+    buffer->capacity = 0;
+    buffer->backend = default_backend;
+    buffer->ring = NULL;
 }
 
 /*
@@ -165,12 +451,26 @@ void dbuffer_free(dbuffer_t *const buffer)
     while (ibuffer != NULL) {
 	prev = ibuffer;
 	ibuffer = ibuffer->next;
-	free(prev);
+	ibuffer_delete(prev);
     }
 
     buffer->first = NULL;
     buffer->last = NULL;
     buffer->size = 0;
+    buffer->nonblock = -1;
+    buffer->blocked = 0;
+    buffer->chunk = default_chunk;
+    buffer->scanned = 0;
+    buffer->pending = 0;
+
+    /* Free the line scratch area and the ring */
+    free(buffer->scratch);
+    buffer->scratch = NULL;
+    buffer->capacity = 0;
+    if (buffer->ring != NULL) {
+	rbuffer_delete(buffer->ring);
+	buffer->ring = NULL;
+    }
 }
 
 /*
@@ -183,6 +483,26 @@ int dbuffer_get_size(const dbuffer_t *const buffer)
     return buffer->size;
 }
 
+/*
+ * Get the current size of new internal buffers.
+ */
+int dbuffer_get_chunk_size(const dbuffer_t *const buffer)
+{
+    assert(buffer != NULL);
+
+    return buffer->chunk;
+}
+
+/*
+ * Get the backend storing the data.
+ */
+dbuffer_backend_t dbuffer_get_backend(const dbuffer_t *const buffer)
+{
+    assert(buffer != NULL);
+
+    return buffer->backend;
+}
+
 /*
  * Get the file descriptor.
  */
@@ -194,13 +514,13 @@ int dbuffer_get_fd(const dbuffer_t *const buffer)
 }
 
 /*
- * Get the file descriptor set.
+ * Get the event manager.
  */
-fd_set *dbuffer_get_fds(const dbuffer_t *const buffer)
+events_t *dbuffer_get_events(const dbuffer_t *const buffer)
 {
     assert(buffer != NULL);
 
-    return buffer->fds;
+    return buffer->events;
 }
 
 /*
@@ -213,6 +533,24 @@ char dbuffer_get_separator(const dbuffer_t *const buffer)
     return buffer->separator;
 }
 
+/*
+ * Set the backend storing the data (the buffer must be empty).
+ */
+int dbuffer_set_backend(dbuffer_t *const buffer,
+			const dbuffer_backend_t backend)
+{
+    assert(buffer != NULL);
+    assert(backend == DBUFFER_BACKEND_LIST || backend == DBUFFER_BACKEND_RING);
+
+    if (buffer->size != 0)
+	return -1;
+
+    /* Release the storage of the previous backend */
+    dbuffer_free(buffer);
+    buffer->backend = backend;
+    return 0;
+}
+
 /*
  * Set the file descriptor.
  */
@@ -221,16 +559,18 @@ void dbuffer_set_fd(dbuffer_t *const buffer, const int fd)
     assert(buffer != NULL);
 
     buffer->fd = fd;
+    buffer->nonblock = -1;
+    buffer->blocked = 0;
 }
 
 /*
- * Set the file descriptor set.
+ * Set the event manager.
  */
-void dbuffer_set_fds(dbuffer_t *const buffer, fd_set *const fds)
+void dbuffer_set_events(dbuffer_t *const buffer, events_t *const events)
 {
     assert(buffer != NULL);
 
-    buffer->fds = fds;
+    buffer->events = events;
 }
 
 /*
@@ -241,149 +581,244 @@ void dbuffer_set_separator(dbuffer_t *const buffer, const char separator)
     assert(buffer != NULL);
 
     buffer->separator = separator;
+    buffer->scanned = 0;
 }
 
 /*
- * Read data and put it into the buffer.
+ * Read data and put it into the buffer (returns the number of read bytes,
+ * 0 at end of file, -1 on error or -2 if no data is available).
  */
 int dbuffer_read(dbuffer_t *const buffer)
 {
-    int        total;   /* Number of read bytes                   */
-    int        empty;   /* Size of empty buffer space             */
-    int        len;     /* Read data length                       */
-    ibuffer_t *ibuffer; /* Internal buffer                        */
-    ibuffer_t *prev;    /* Previous internal buffer (linked list) */
+    int          total;                       /* Number of read bytes    */
+    int          len;                         /* Read data length        */
+    int          rest;                        /* Data left to assign     */
+    int          fill;                        /* Data put in a buffer    */
+    int          size;                        /* Reserved space          */
+    int          count;                       /* Number of I/O vectors   */
+    int          reserve;                     /* Number of new buffers   */
+    int          i;                           /* Counter                 */
+    ibuffer_t   *ibuffer;                     /* Last buffer with space  */
+    ibuffer_t   *chunks[BUFFER_READ_CHUNKS];  /* Reserved new buffers    */
+    struct iovec iov[BUFFER_READ_CHUNKS + 1]; /* Vectors to fill         */
 
     assert(buffer != NULL);
 
-    if (buffer->fds != NULL && !FD_ISSET(buffer->fd, buffer->fds)) {
-	FD_SET(buffer->fd, buffer->fds);
+    /* Wait until the descriptor is reported readable */
+    if (buffer->events != NULL &&
+	!events_is_ready(buffer->events, buffer->fd, EVENTS_READ)) {
+	events_watch(buffer->events, buffer->fd, EVENTS_READ);
 	return -2;
     }
 
-    /* Allocate first internal buffer if necessary */
-    if (buffer->first == NULL) {
-	if ((ibuffer = ibuffer_new()) == NULL)
-	    return -1;
-	buffer->first = ibuffer;
-	buffer->last = ibuffer;
-    } else
-	ibuffer = buffer->last;
+    if (buffer->backend == DBUFFER_BACKEND_RING)
+	return dbuffer_ring_read(buffer);
 
     total = 0;
-    prev = NULL;
 
-    while (1) {
-	/* Read data */
-	empty = sizeof(ibuffer->data) - ibuffer->end;
-	len = read(buffer->fd, ibuffer->data + ibuffer->end, empty);
-
-	if (len == 0) {
-	    /* End of data */
-	    if (ibuffer->end == 0 && prev != NULL) {
-		prev->next = NULL;
-		buffer->last = prev;
-		if (buffer->first == ibuffer)
-		    buffer->first = NULL;
-		free(ibuffer);
-	    }
-	    break;
-	}
-	if (len == -1)
-	    break;
+    do {
+	size = 0;
+	count = 0;
 
-	empty -= len;
-	total += len;
-	ibuffer->end += len;
+	/* Fill the space left in the last internal buffer first */
+	ibuffer = buffer->last;
+	if (ibuffer != NULL && ibuffer->end < ibuffer->size) {
+	    iov[0].iov_base = ibuffer->data + ibuffer->end;
+	    iov[0].iov_len = ibuffer->size - ibuffer->end;
+	    size = ibuffer->size - ibuffer->end;
+	    count = 1;
+	} else
+	    ibuffer = NULL;
 
-	if (empty != 0)
-	    break;
+	/* Reserve new internal buffers, up to BUFFER_MAX_SIZE bytes */
+	for (reserve = 0; reserve < BUFFER_READ_CHUNKS &&
+		 (reserve == 0 || size < BUFFER_MAX_SIZE); reserve++) {
+	    if ((chunks[reserve] = ibuffer_new(buffer->chunk)) == NULL)
+		break;
+	    iov[count].iov_base = chunks[reserve]->data;
+	    iov[count].iov_len = chunks[reserve]->size;
+	    size += chunks[reserve]->size;
+	    count++;
+	}
+	if (count == 0)
+	    return total != 0 ? total : -1;
+
+	/* Read data in all of them at once (again if interrupted) */
+	while ((len = readv(buffer->fd, iov, count)) == -1 && errno == EINTR)
+	    ;
+	rest = len > 0 ? len : 0;
+
+	if (ibuffer != NULL) {
+	    fill = ibuffer->size - ibuffer->end;
+	    fill = rest < fill ? rest : fill;
+	    ibuffer->end += fill;
+	    rest -= fill;
+	}
 
-	/* Allocate a new internal buffer */
-	prev = ibuffer;
-	if ((ibuffer->next = ibuffer_new()) == NULL)
+	/* Link the filled buffers and give the others back */
+	for (i = 0; i < reserve; i++)
+	    if (rest > 0) {
+		fill = rest < chunks[i]->size ? rest : chunks[i]->size;
+		chunks[i]->end = fill;
+		rest -= fill;
+
+		if (buffer->last != NULL)
+		    buffer->last->next = chunks[i];
+		else
+		    buffer->first = chunks[i];
+		buffer->last = chunks[i];
+	    } else
+		ibuffer_delete(chunks[i]);
+
+	/* End of data or error */
+	if (len <= 0)
 	    break;
-	buffer->last = ibuffer->next;
-	ibuffer = ibuffer->next;
-    }
+	total += len;
+    } while (len == size);
 
     buffer->size += total;
-    return total;
+    if (total > 0)
+	dbuffer_adapt(buffer, total);
+    return dbuffer_read_result(total, len);
 }
 
 /*
- * Write data from the buffer.
+ * Write data from the buffer (returns the number of written bytes, -1 on
+ * error or -2 if the descriptor cannot accept data).  Data is written to
+ * non-blocking descriptors right away; only once one has been found full
+ * does the buffer wait for it to be reported writable.
  */
 int dbuffer_write(dbuffer_t *const buffer)
 {
-    int   len;  /* Written data length     */
-    int   size; /* Number of written bytes */
-    char *data; /* Pointer to buffer       */
+    int          len;                 /* Written data length         */
+    int          size;                /* Size of data to write       */
+    int          total;               /* Number of written bytes     */
+    int          count;               /* Number of I/O vectors       */
+    int          flags;               /* Descriptor status flags     */
+    ibuffer_t   *ibuffer;             /* Internal buffer             */
+    struct iovec iov[BUFFER_IOVECS];  /* Internal buffer vectors     */
 
     assert(buffer != NULL);
 
-    if (buffer->fds != NULL && !FD_ISSET(buffer->fd, buffer->fds)) {
+    /* Writing to a blocking descriptor might block: always wait for it */
+    if (buffer->events != NULL && buffer->nonblock == -1) {
+	flags = fcntl(buffer->fd, F_GETFL);
+	buffer->nonblock = flags != -1 && (flags & O_NONBLOCK) != 0;
+    }
+
+    /* Wait until a full (or blocking) descriptor is reported writable */
+    if (buffer->events != NULL && (buffer->blocked || !buffer->nonblock) &&
+	!events_is_ready(buffer->events, buffer->fd, EVENTS_WRITE)) {
 	if (buffer->size != 0)
-	    FD_SET(buffer->fd, buffer->fds);
+	    events_watch(buffer->events, buffer->fd, EVENTS_WRITE);
 	return -2;
     }
 
-    if ((size = buffer->size) == 0 || buffer->first == NULL) {
-	if (buffer->fds != NULL)
-	    FD_CLR(buffer->fd, buffer->fds);
+    if (buffer->size == 0) {
+	buffer->blocked = 0;
+	if (buffer->events != NULL)
+	    events_unwatch(buffer->events, buffer->fd, EVENTS_WRITE);
 	return 0;
     }
-    if ((data = malloc(size)) == NULL)
-	return -1;
 
-    /* TODO: improve this (do not use dbuffer_*) */
+    total = 0;
 
-    /* Write data and re-add the remaining data (not written yet) */
-    dbuffer_get_data(buffer, data, size);
-    len = write(buffer->fd, data, size);
-    if (len == size) {
-	if (buffer->fds != NULL)
-	    FD_CLR(buffer->fd, buffer->fds);
-    } else
-	dbuffer_put_data(buffer, data + len, size - len);
-    free(data);
+    do {
+	/* Gather internal buffers (or ring parts) directly (no copy) */
+	size = 0;
+	count = 0;
+	if (buffer->backend == DBUFFER_BACKEND_RING) {
+	    count = rbuffer_get_vectors(buffer->ring, iov);
+	    size = buffer->size;
+	}
+	for (ibuffer = buffer->first; ibuffer != NULL && count < BUFFER_IOVECS;
+	     ibuffer = ibuffer->next) {
+	    if (ibuffer->end == ibuffer->start)
+		continue;
+	    iov[count].iov_base = ibuffer->data + ibuffer->start;
+	    iov[count].iov_len = ibuffer->end - ibuffer->start;
+	    size += ibuffer->end - ibuffer->start;
+	    count++;
+	}
 
-    return len;
+	/* A full socket is not an error: wait until it is writable */
+	if ((len = dbuffer_writev(buffer->fd, iov, count,
+				  size != buffer->size)) == -1) {
+	    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+		buffer->blocked = 1;
+		if (buffer->events != NULL)
+		    events_watch(buffer->events, buffer->fd, EVENTS_WRITE);
+		return total != 0 ? total : -2;
+	    }
+	    return total != 0 ? total : -1;
+	}
+
+	/* Drop written data: advance start and free written buffers */
+	dbuffer_get_data(buffer, NULL, len);
+	total += len;
+    } while (len == size && buffer->size != 0);
+
+    if (buffer->size == 0) {
+	buffer->blocked = 0;
+	if (buffer->events != NULL)
+	    events_unwatch(buffer->events, buffer->fd, EVENTS_WRITE);
+    }
+
+    return total;
 }
 
 /*
  * Get the size of the first token in the buffer.
  */
-int dbuffer_token_size(const dbuffer_t *const buffer)
+int dbuffer_token_size(dbuffer_t *const buffer)
 {
-    int        i;         /* Counter             */
-    int        size;      /* Size of token       */
-    char       chr;       /* Character           */
-    char       separator; /* Separator character */
-    ibuffer_t *ibuffer;   /* Internal buffer     */
+    int         size;    /* Size of token (or of scanned data) */
+    int         skip;    /* Data to skip (already scanned)     */
+    int         len;     /* Size of data in internal buffer    */
+    const char *data;    /* Data in internal buffer            */
+    const char *found;   /* Separator character position       */
+    ibuffer_t  *ibuffer; /* Internal buffer                    */
 
     assert(buffer != NULL);
-    separator = buffer->separator;
+
+    /* Ring backend */
+    if (buffer->backend == DBUFFER_BACKEND_RING) {
+	if (buffer->ring == NULL ||
+	    (size = rbuffer_find(buffer->ring, buffer->scanned,
+				 buffer->separator)) == -1) {
+	    buffer->scanned = buffer->size;
+	    return 0;
+	}
+	buffer->scanned = size;
+	return size + 1;
+    }
 
     size = 0;
-    chr = '\0';
-    ibuffer = buffer->first;
+    skip = buffer->scanned;
+
+    /* Search for the separator character after the data already scanned */
+    for (ibuffer = buffer->first; ibuffer != NULL; ibuffer = ibuffer->next) {
+	len = ibuffer->end - ibuffer->start;
+	if (skip >= len) {
+	    skip -= len;
+	    size += len;
+	    continue;
+	}
 
-    /* Search for the separator character in the buffer */
-    while (ibuffer != NULL) {
-	for (i = ibuffer->start; i < ibuffer->end; i++) {
-	    size++;
-	    if ((chr = ibuffer->data[i]) == separator)
-		break;
+	data = ibuffer->data + ibuffer->start;
+	if ((found = memchr(data + skip, buffer->separator, len - skip))
+	    != NULL) {
+	    size += found - data + 1;
+	    buffer->scanned = size - 1;
+	    return size;
 	}
 
-	if (chr == separator)
-	    break;
-	ibuffer = ibuffer->next;
+	size += len;
+	skip = 0;
     }
 
-    if (ibuffer != NULL)
-	return size;
+    /* Remember where to resume when more data is read */
+    buffer->scanned = size;
     return 0;
 }
 
@@ -402,6 +837,21 @@ int dbuffer_get_data(dbuffer_t *const buffer, char *const data,
     assert(buffer != NULL);
     size = data_size;
 
+    /* Ring backend: free a ring which grew large once it is empty */
+    if (buffer->backend == DBUFFER_BACKEND_RING) {
+	if (size == 0 || buffer->ring == NULL)
+	    return 0;
+	done = rbuffer_get_data(buffer->ring, data, size);
+	buffer->size -= done;
+	buffer->scanned = buffer->scanned > done ? buffer->scanned - done : 0;
+	if (buffer->size == 0 && buffer->pending == 0 &&
+	    rbuffer_get_capacity(buffer->ring) > BUFFER_MAX_SIZE) {
+	    rbuffer_delete(buffer->ring);
+	    buffer->ring = NULL;
+	}
+	return done;
+    }
+
     if (size == 0 || (ibuffer = buffer->first) == NULL)
 	return 0;
 
@@ -422,7 +872,7 @@ int dbuffer_get_data(dbuffer_t *const buffer, char *const data,
 	}
 
 	buffer->first = ibuffer->next;
-	free(ibuffer);
+	ibuffer_delete(ibuffer);
 	ibuffer = buffer->first;
 
 	if (ibuffer == NULL) {
@@ -432,16 +882,17 @@ int dbuffer_get_data(dbuffer_t *const buffer, char *const data,
 	if (size == 0)
 	    break;
 
-	buffer_size = ibuffer->end;
+	buffer_size = ibuffer->end - ibuffer->start;
 	copy_size = size <= buffer_size ? size : buffer_size;
 
 	if (data != NULL)
-	    memcpy(data + done, ibuffer->data, copy_size);
+	    memcpy(data + done, ibuffer->data + ibuffer->start, copy_size);
 	done += copy_size;
 	size -= copy_size;
     }
 
     buffer->size -= done;
+    buffer->scanned = buffer->scanned > done ? buffer->scanned - done : 0;
     return done;
 }
 
@@ -458,20 +909,30 @@ int dbuffer_put_data(dbuffer_t *const buffer, const char *const data,
 
     assert(buffer != NULL);
 
+    /* Ring backend */
+    if (buffer->backend == DBUFFER_BACKEND_RING) {
+	if (dbuffer_ring(buffer) == NULL ||
+	    rbuffer_put_data(buffer->ring, data, data_size) == -1)
+	    return -1;
+	buffer->size += data_size;
+	return data_size;
+    }
+
     /* Allocate first buffer if necessary */
     if (buffer->first == NULL) {
-	if ((ibuffer = ibuffer_new()) == NULL)
+	if ((ibuffer = ibuffer_new(buffer->chunk)) == NULL)
 	    return -1;
 	buffer->first = ibuffer;
 	buffer->last = ibuffer;
     } else
 	ibuffer = buffer->last;
 
+    dbuffer_adapt(buffer, data_size);
     total = 0;
     len = data_size;
 
     while (1) {
-	empty = sizeof(ibuffer->data) - ibuffer->end;
+	empty = ibuffer->size - ibuffer->end;
 
 	/* Copy all remaining data */
 	if (len < empty) {
@@ -489,7 +950,7 @@ int dbuffer_put_data(dbuffer_t *const buffer, const char *const data,
 
 	/* Allocate a new buffer */
 	if (len != 0) {
-	    if ((ibuffer->next = ibuffer_new()) == NULL)
+	    if ((ibuffer->next = ibuffer_new(buffer->chunk)) == NULL)
 		break;
 	    buffer->last = ibuffer->next;
 	    ibuffer = ibuffer->next;
@@ -501,6 +962,175 @@ int dbuffer_put_data(dbuffer_t *const buffer, const char *const data,
     return total;
 }
 
+/*
+ * Append a reference to a shared segment to the buffer (without copying).
+ */
+int dbuffer_put_segment(dbuffer_t *const buffer, segment_t *const segment)
+{
+    ibuffer_t *ibuffer; /* Internal buffer */
+
+    assert(buffer != NULL);
+    assert(segment != NULL);
+
+    if (segment->size == 0)
+	return 0;
+
+    /* Rings cannot reference data: copy it */
+    if (buffer->backend == DBUFFER_BACKEND_RING)
+	return dbuffer_put_data(buffer, segment->data, segment->size);
+
+    if ((ibuffer = ibuffer_new_segment(segment)) == NULL)
+	return -1;
+
+    /* Link it at the end of the list */
+    if (buffer->last != NULL)
+	buffer->last->next = ibuffer;
+    else
+	buffer->first = ibuffer;
+    buffer->last = ibuffer;
+
+    buffer->size += segment->size;
+    return segment->size;
+}
+
+/*
+ * Drop the referenced segments which have not been written at all, oldest
+ * first, until at most size bytes are left (returns the number of dropped
+ * segments).
+ */
+int dbuffer_drop_segments(dbuffer_t *const buffer, const int size)
+{
+    int        count;   /* Number of dropped segments */
+    ibuffer_t *ibuffer; /* Current internal buffer    */
+    ibuffer_t *prev;    /* Previous internal buffer   */
+    ibuffer_t *next;    /* Next internal buffer       */
+
+    assert(buffer != NULL);
+    assert(size >= 0);
+
+    /* Rings only hold copies: segment boundaries are lost */
+    if (buffer->backend == DBUFFER_BACKEND_RING)
+	return 0;
+
+    count = 0;
+    prev = NULL;
+    for (ibuffer = buffer->first; ibuffer != NULL && buffer->size > size;
+	 ibuffer = next) {
+	next = ibuffer->next;
+
+	/* Keep own data and a segment which is being written */
+	if (ibuffer->segment == NULL || ibuffer->start != 0) {
+	    prev = ibuffer;
+	    continue;
+	}
+
+	/* Unlink the segment */
+	if (prev != NULL)
+	    prev->next = next;
+	else
+	    buffer->first = next;
+	if (buffer->last == ibuffer)
+	    buffer->last = prev;
+
+	buffer->size -= ibuffer->end;
+	ibuffer_delete(ibuffer);
+	count++;
+    }
+
+    if (count != 0)
+	buffer->scanned = 0;
+    return count;
+}
+
+/*
+ * Set the initial chunk size of new buffers (rounded up to a power of two).
+ */
+int dbuffer_set_default_chunk_size(const int size)
+{
+    if (size < BUFFER_MIN_SIZE || size > BUFFER_MAX_SIZE)
+	return -1;
+
+    default_chunk = BUFFER_MIN_SIZE << ibuffer_class(size);
+    return 0;
+}
+
+/*
+ * Get the initial chunk size of new buffers.
+ */
+int dbuffer_get_default_chunk_size(void)
+{
+    return default_chunk;
+}
+
+/*
+ * Set the backend of new buffers.
+ */
+void dbuffer_set_default_backend(const dbuffer_backend_t backend)
+{
+    assert(backend == DBUFFER_BACKEND_LIST || backend == DBUFFER_BACKEND_RING);
+
+    default_backend = backend;
+}
+
+/*
+ * Get the internal buffer pool statistics.
+ */
+void dbuffer_get_stats(dbuffer_stats_t *const stats)
+{
+    int i; /* Pool class */
+
+    assert(stats != NULL);
+
+    *stats = pool_stats;
+    stats->pooled = 0;
+    for (i = 0; i <= BUFFER_CLASSES; i++)
+	stats->pooled += pools[i].count;
+}
+
+/*
+ * Allocate internal buffers of default size in advance and always keep that
+ * many of them in the pool (returns the number of pooled buffers).
+ */
+int dbuffer_pool_reserve(const int count)
+{
+    int             i;       /* Buffer counter       */
+    ibuffer_t      *ibuffer; /* New internal buffer  */
+    ibuffer_pool_t *pool;    /* Pool of default size */
+
+    assert(count >= 0);
+
+    pool = &pools[ibuffer_class(default_chunk)];
+    pool->reserved = count;
+
+    for (i = pool->count; i < count; i++) {
+	if ((ibuffer = malloc(sizeof(ibuffer_t) + default_chunk)) == NULL)
+	    break;
+	ibuffer->next = pool->first;
+	pool->first = ibuffer;
+	pool->count++;
+    }
+
+    return i;
+}
+
+/*
+ * Free the internal buffers kept in the pools.
+ */
+void dbuffer_pool_free(void)
+{
+    int        i;       /* Pool class          */
+    ibuffer_t *ibuffer; /* Current free buffer */
+
+    for (i = 0; i <= BUFFER_CLASSES; i++) {
+	while ((ibuffer = pools[i].first) != NULL) {
+	    pools[i].first = ibuffer->next;
+	    free(ibuffer);
+	}
+	pools[i].count = 0;
+	pools[i].reserved = 0;
+    }
+}
+
 /*
  * Input a non-blank line from the buffer.
  */
@@ -535,4 +1165,81 @@ line_t *dbuffer_input_line(dbuffer_t *const buffer, const int space)
     return NULL;
 }
 
+/*
+ * View the next non-blank line of the buffer, with `space' bytes available
+ * before it.  The line stays valid until the next view or release, when it
+ * is consumed: it points into the internal buffer if it is contiguous, or
+ * is copied in the scratch area of the buffer otherwise.
+ */
+line_t *dbuffer_view_line(dbuffer_t *const buffer, const int space)
+{
+    int        len;     /* Line length     */
+    char      *data;    /* Line data       */
+    ibuffer_t *ibuffer; /* Internal buffer */
+
+    assert(buffer != NULL);
+    assert(space >= 0);
+
+    /* Consume the previous line */
+    dbuffer_release_line(buffer);
+
+    /* While there is a line in the buffer */
+    while ((len = dbuffer_token_size(buffer)) != 0) {
+	/* Drop it if it is a blank one */
+	if (len == 1) {
+	    dbuffer_get_data(buffer, NULL, 1);
+	    continue;
+	}
+
+	/* Point to the line in place (space is free or consumed data) */
+	data = NULL;
+	if (buffer->backend == DBUFFER_BACKEND_RING)
+	    data = rbuffer_peek(buffer->ring, len, space);
+	else if ((ibuffer = buffer->first)->segment == NULL &&
+		 ibuffer->start >= space &&
+		 ibuffer->end - ibuffer->start >= len)
+	    data = ibuffer->data + ibuffer->start;
+
+	if (data != NULL)
+	    buffer->pending = len;
+	else {
+	    /* Copy the line in the scratch area */
+	    if (space + len > buffer->capacity) {
+		if ((data = realloc(buffer->scratch, space + len)) == NULL)
+		    return NULL;
+		buffer->scratch = data;
+		buffer->capacity = space + len;
+	    }
+	    data = buffer->scratch + space;
+	    dbuffer_get_data(buffer, data, len);
+	}
+
+	/* Return if we found a non-blank line */
+	if (len != 2 || data[0] != '\r') {
+	    if (data[len - 2] == '\r')
+		data[len-- - 2] = '\n';
+	    buffer->line.length = len;
+	    buffer->line.start = data - space;
+	    buffer->line.data = data;
+	    return &buffer->line;
+	}
+	dbuffer_release_line(buffer);
+    }
+
+    return NULL;
+}
+
+/*
+ * Consume the line returned by the last view, if any.
+ */
+void dbuffer_release_line(dbuffer_t *const buffer)
+{
+    assert(buffer != NULL);
+
+    if (buffer->pending != 0) {
+	dbuffer_get_data(buffer, NULL, buffer->pending);
+	buffer->pending = 0;
+    }
+}
+
 /* End of file */
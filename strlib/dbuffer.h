@@ -33,9 +33,6 @@
 #ifndef DBUFFER_H
 #define DBUFFER_H
 
-/* System headers */
-#include <sys/select.h> /* fd_set */
-
 #ifdef __cplusplus
 extern "C" {
 #endif /* __cplusplus */
@@ -45,15 +42,16 @@ extern "C" {
  * Data types
  */
 
-/* Dynamic buffer */
-typedef struct dbuffer {
-    struct ibuffer *first;     /* First element in linked list             */
-    struct ibuffer *last;      /* Last element in linked list              */
-    int             size;      /* Total size of data in the buffer         */
-    int             fd;        /* File/socket descriptor to read data from */
-    fd_set         *fds;       /* Read/write descriptor set                */
-    char            separator; /* Character separating tokens              */
-} dbuffer_t;
+/* Event manager, shared segment and ring buffer (non-explicit) */
+struct events;
+struct segment;
+struct rbuffer;
+
+/* Storage backend */
+typedef enum dbuffer_backend {
+    DBUFFER_BACKEND_LIST, /* Linked list of internal buffers (chunks) */
+    DBUFFER_BACKEND_RING  /* Contiguous ring buffer                   */
+} dbuffer_backend_t;
 
 /* Input line */
 typedef struct line {
@@ -62,36 +60,87 @@ typedef struct line {
     char *data;   /* Line data                                       */
 } line_t;
 
+/* Dynamic buffer */
+typedef struct dbuffer {
+    struct ibuffer    *first;     /* First element in linked list            */
+    struct ibuffer    *last;      /* Last element in linked list             */
+    int                size;      /* Total size of data in the buffer        */
+    int                fd;        /* File/socket descriptor for data I/O     */
+    struct events     *events;    /* Event manager (readiness of fd)         */
+    int                nonblock;  /* Non-blocking descriptor (-1: unknown)   */
+    int                blocked;   /* Last write found the descriptor full    */
+    char               separator; /* Character separating tokens             */
+    int                chunk;     /* Size of new internal buffers (adaptive) */
+    int                scanned;   /* Data known not to contain the separator */
+    int                pending;   /* Length of the viewed line (in place)    */
+    line_t             line;      /* Viewed line                             */
+    char              *scratch;   /* Copy of lines spanning internal buffers */
+    int                capacity;  /* Size of the scratch area                */
+    dbuffer_backend_t  backend;   /* Storage backend                         */
+    struct rbuffer    *ring;      /* Ring buffer (ring backend)              */
+} dbuffer_t;
+
+
+
+/* Internal buffer pool statistics */
+typedef struct dbuffer_stats {
+    unsigned long hits;     /* Allocations served by the pool          */
+    unsigned long misses;   /* Allocations falling back to malloc()    */
+    unsigned long releases; /* Internal buffers given back to the pool */
+    unsigned long frees;    /* Internal buffers freed (pool was full)  */
+    int           pooled;   /* Internal buffers currently in the pool  */
+} dbuffer_stats_t;
+
 
 /*
  * Prototypes
  */
 
 /* Constructors and destructors */
-dbuffer_t *dbuffer_new(const int fd, fd_set *const fds, const char separator);
+dbuffer_t *dbuffer_new(const int fd, struct events *const events,
+		       const char separator);
 void       dbuffer_delete(dbuffer_t *const buffer);
 void       dbuffer_init(dbuffer_t *const buffer, const int fd,
-			fd_set *const fds, const char separator);
+			struct events *const events, const char separator);
 void       dbuffer_free(dbuffer_t *const buffer);
 
 /* Accessors */
-int     dbuffer_get_size(const dbuffer_t *const buffer);
-int     dbuffer_get_fd(const dbuffer_t *const buffer);
-fd_set *dbuffer_get_fds(const dbuffer_t *const buffer);
-char    dbuffer_get_separator(const dbuffer_t *const buffer);
-void    dbuffer_set_fd(dbuffer_t *const buffer, const int fd);
-void    dbuffer_set_fds(dbuffer_t *const buffer, fd_set *const fds);
-void    dbuffer_set_separator(dbuffer_t *const buffer, const char separator);
+int               dbuffer_get_size(const dbuffer_t *const buffer);
+int               dbuffer_get_chunk_size(const dbuffer_t *const buffer);
+dbuffer_backend_t dbuffer_get_backend(const dbuffer_t *const buffer);
+int               dbuffer_get_fd(const dbuffer_t *const buffer);
+struct events    *dbuffer_get_events(const dbuffer_t *const buffer);
+char              dbuffer_get_separator(const dbuffer_t *const buffer);
+int               dbuffer_set_backend(dbuffer_t *const buffer,
+				      const dbuffer_backend_t backend);
+void              dbuffer_set_fd(dbuffer_t *const buffer, const int fd);
+void              dbuffer_set_events(dbuffer_t *const buffer,
+				     struct events *const events);
+void              dbuffer_set_separator(dbuffer_t *const buffer,
+					const char separator);
 
 /* Methods */
 int     dbuffer_read(dbuffer_t *const buffer);
 int     dbuffer_write(dbuffer_t *const buffer);
-int     dbuffer_token_size(const dbuffer_t *const buffer);
+int     dbuffer_token_size(dbuffer_t *const buffer);
 int     dbuffer_get_data(dbuffer_t *const buffer, char *const data,
 			 const int data_size);
 int     dbuffer_put_data(dbuffer_t *const buffer, const char *const data,
 			 const int data_size);
+int     dbuffer_put_segment(dbuffer_t *const buffer,
+			    struct segment *const segment);
+int     dbuffer_drop_segments(dbuffer_t *const buffer, const int size);
 line_t *dbuffer_input_line(dbuffer_t *const buffer, const int space);
+line_t *dbuffer_view_line(dbuffer_t *const buffer, const int space);
+void    dbuffer_release_line(dbuffer_t *const buffer);
+
+/* Chunk size and internal buffer pool */
+int  dbuffer_set_default_chunk_size(const int size);
+int  dbuffer_get_default_chunk_size(void);
+void dbuffer_set_default_backend(const dbuffer_backend_t backend);
+void dbuffer_get_stats(dbuffer_stats_t *const stats);
+int  dbuffer_pool_reserve(const int count);
+void dbuffer_pool_free(void);
 
 
 #ifdef __cplusplus
@@ -0,0 +1,996 @@
+/*
+ * ---------------------------------------------------------------------------
+ *
+ * Minitalk: a basic talk-like server/client
+ * Copyright (C) 2004 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: strlib/events.c
+ *
+ * Description: Event Notification
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+/*****************************************************************************
+ *
+ * Headers
+ *
+ */
+
+/* Feature test macros (syscall(), MAP_POPULATE) */
+#define _GNU_SOURCE
+
+/* System headers */
+#include <stdlib.h> /* malloc(), realloc(), free(), NULL */
+#include <string.h> /* memset()                          */
+#include <unistd.h> /* close()                           */
+#include <errno.h>  /* errno, E*                         */
+#include <assert.h> /* assert()                          */
+
+/* Event notification headers */
+#include <sys/select.h> /* select(), fd_set, FD_*(), struct timeval */
+#if defined(__linux__) && !defined(NO_EPOLL)
+# define HAVE_EPOLL
+# include <sys/epoll.h>   /* epoll_*(), struct epoll_event */
+# include <sys/syscall.h> /* syscall(), __NR_*              */
+#endif
+#if defined(HAVE_EPOLL) && defined(__NR_io_uring_setup) && !defined(NO_URING)
+# include <poll.h>           /* POLL*               */
+# include <sys/mman.h>       /* mmap(), munmap()    */
+# include <linux/io_uring.h> /* io_uring structures */
+# ifdef IORING_ENTER_EXT_ARG
+#  define HAVE_URING
+# endif
+#endif
+
+/* Project headers */
+#include <common.h>
+#include "events.h"
+
+
+/*****************************************************************************
+ *
+ * Constants
+ *
+ */
+
+/* Minimum size of the descriptor table */
+#define EVENTS_MIN_SIZE 64
+
+#ifdef HAVE_URING
+/* Number of io_uring submission and completion queue entries */
+#define EVENTS_URING_SQ_SIZE 256
+#define EVENTS_URING_CQ_SIZE 4096
+
+/* User data of poll removal requests (their completion is ignored) */
+#define EVENTS_URING_CANCEL (~(__u64) 0)
+#endif
+
+
+/*****************************************************************************
+ *
+ * Data types
+ *
+ */
+
+#ifdef HAVE_URING
+/* io_uring state of a descriptor */
+typedef struct events_uring_fd {
+    unsigned seq;    /* Generation of the poll request     */
+    int      armed;  /* Events watched by the poll request */
+    int      queued; /* In the list of requests to submit  */
+} events_uring_fd_t;
+
+/* io_uring rings and descriptor states */
+typedef struct events_uring {
+    unsigned char       *sq_ring;       /* Submission queue ring       */
+    size_t               sq_size;       /* Submission queue ring size  */
+    unsigned char       *cq_ring;       /* Completion queue ring       */
+    size_t               cq_size;       /* Completion queue ring size  */
+    struct io_uring_sqe *sqes;          /* Submission queue entries    */
+    size_t               sqes_size;     /* Size of the entries         */
+    unsigned            *sq_head;       /* Consumed by the kernel      */
+    unsigned            *sq_tail;       /* Produced by us              */
+    unsigned            *sq_array;      /* Indexes of submitted items  */
+    unsigned             sq_mask;       /* Submission queue index mask */
+    unsigned             sq_entries;    /* Submission queue capacity   */
+    unsigned            *cq_head;       /* Consumed by us              */
+    unsigned            *cq_tail;       /* Produced by the kernel      */
+    struct io_uring_cqe *cqes;          /* Completion queue entries    */
+    unsigned             cq_mask;       /* Completion queue index mask */
+    events_uring_fd_t   *fds;           /* States (indexed by fd)      */
+    int                 *pending;       /* Descriptors to poll again   */
+    int                  pending_count; /* Number of them              */
+} events_uring_t;
+#endif
+
+
+/*****************************************************************************
+ *
+ * Local functions
+ *
+ */
+
+/* Prototypes */
+static int  events_grow(events_t *const events, const int fd);
+static int  events_update(events_t *const events, const int fd,
+			  const int old);
+static void events_add_ready(events_t *const events, const int fd,
+			     const int mask);
+static int  events_wait_select(events_t *const events, const int timeout);
+#ifdef HAVE_EPOLL
+static int  events_wait_epoll(events_t *const events, int timeout);
+#endif
+#ifdef HAVE_URING
+static __u64 events_uring_data(const int fd, const unsigned seq);
+static int  events_uring_init(events_t *const events);
+static void events_uring_free(events_t *const events);
+static int  events_uring_enter(events_t *const events, const int wait,
+			       const int timeout);
+static int  events_uring_queue(events_t *const events, const int opcode,
+			       const int fd, const int mask,
+			       const __u64 addr, const __u64 data);
+static int  events_uring_update(events_t *const events, const int fd);
+static int  events_wait_uring(events_t *const events, const int timeout);
+#endif
+
+/*
+ * Make the descriptor table large enough to hold a descriptor.
+ */
+static int events_grow(events_t *const events, const int fd)
+{
+    int          size;  /* New table size       */
+    events_fd_t *fds;   /* New descriptor table */
+    int         *ready; /* New ready list       */
+    void        *list;  /* New backend list     */
+
+    assert(events != NULL);
+    assert(fd >= 0);
+
+    if (fd < events->size)
+	return 0;
+
+    /* Double the size until the descriptor fits */
+    size = events->size != 0 ? events->size : EVENTS_MIN_SIZE;
+    while (size <= fd)
+	size *= 2;
+
+    if ((fds = realloc(events->fds, size * sizeof(*fds))) == NULL)
+	return -1;
+    memset(fds + events->size, 0, (size - events->size) * sizeof(*fds));
+    events->fds = fds;
+
+    if ((ready = realloc(events->ready, size * sizeof(*ready))) == NULL)
+	return -1;
+    events->ready = ready;
+
+#ifdef HAVE_EPOLL
+    if (events->backend == EVENTS_BACKEND_EPOLL) {
+	if ((list = realloc(events->list, size * sizeof(struct epoll_event)))
+	    == NULL)
+	    return -1;
+	events->list = list;
+    }
+#endif
+#ifdef HAVE_URING
+    if (events->backend == EVENTS_BACKEND_URING) {
+	events_uring_t *ring = events->list; /* io_uring state */
+
+	if ((list = realloc(ring->fds, size * sizeof(*ring->fds))) == NULL)
+	    return -1;
+	ring->fds = list;
+	memset(ring->fds + events->size, 0,
+	       (size - events->size) * sizeof(*ring->fds));
+	if ((list = realloc(ring->pending, size * sizeof(*ring->pending)))
+	    == NULL)
+	    return -1;
+	ring->pending = list;
+    }
+#endif
+#if !defined(HAVE_EPOLL) && !defined(HAVE_URING)
+    (void) list;
+#endif
+
+    events->size = size;
+    return 0;
+}
+
+/*
+ * Tell the backend about a change in the watched events of a descriptor.
+ */
+static int events_update(events_t *const events, const int fd,
+			 const int old)
+{
+    int                watch; /* Watched events    */
+#ifdef HAVE_EPOLL
+    int                op;    /* epoll operation   */
+    struct epoll_event event; /* epoll event       */
+#endif
+
+    assert(events != NULL);
+    assert(fd >= 0 && fd < events->size);
+
+    watch = events->fds[fd].watch;
+
+    if (watch != 0 && fd > events->max_fd)
+	events->max_fd = fd;
+
+    switch (events->backend) {
+#ifdef HAVE_EPOLL
+    case EVENTS_BACKEND_EPOLL:
+	if (events->fds[fd].always)
+	    return 0;
+
+	event.events = ((watch & EVENTS_READ) ? EPOLLIN : 0) |
+	    ((watch & EVENTS_WRITE) ? EPOLLOUT : 0);
+	event.data.fd = fd;
+	op = old == 0 ? EPOLL_CTL_ADD :
+	    (watch == 0 ? EPOLL_CTL_DEL : EPOLL_CTL_MOD);
+
+	if (epoll_ctl(events->poll_fd, op, fd, &event) == 0)
+	    return 0;
+
+	/* Descriptor unknown to epoll or registered behind our back */
+	if (errno == EEXIST && op == EPOLL_CTL_ADD)
+	    return epoll_ctl(events->poll_fd, EPOLL_CTL_MOD, fd, &event);
+	if (errno == ENOENT)
+	    return op == EPOLL_CTL_DEL ? 0 :
+		epoll_ctl(events->poll_fd, EPOLL_CTL_ADD, fd, &event);
+
+	/* Regular files and the like cannot be polled: always ready */
+	if (errno == EPERM && op == EPOLL_CTL_ADD) {
+	    events->fds[fd].always = 1;
+	    if (fd >= events->always)
+		events->always = fd + 1;
+	    return 0;
+	}
+	return -1;
+#endif
+
+#ifdef HAVE_URING
+    case EVENTS_BACKEND_URING:
+	return events_uring_update(events, fd);
+#endif
+
+    default:
+	/* select() reads the table itself */
+	return 0;
+    }
+}
+
+/*
+ * Add a descriptor to the ready list.
+ */
+static void events_add_ready(events_t *const events, const int fd,
+			     const int mask)
+{
+    assert(events != NULL);
+    assert(fd >= 0 && fd < events->size);
+
+    if (mask == 0 || events->fds[fd].ready != 0)
+	return;
+
+    events->fds[fd].ready = mask;
+    events->ready[events->ready_count++] = fd;
+}
+
+/*
+ * Wait for events with select().
+ */
+static int events_wait_select(events_t *const events, const int timeout)
+{
+    int            fd;    /* Current descriptor  */
+    int            nfds;  /* Number of ready fds */
+    int            watch; /* Watched events      */
+    fd_set         rfds;  /* Read descriptors    */
+    fd_set         wfds;  /* Write descriptors   */
+    struct timeval tv;    /* Timeout             */
+
+    assert(events != NULL);
+
+    /* Build descriptor sets */
+    FD_ZERO(&rfds);
+    FD_ZERO(&wfds);
+    for (fd = 0; fd <= events->max_fd; fd++) {
+	if ((watch = events->fds[fd].watch) & EVENTS_READ)
+	    FD_SET(fd, &rfds);
+	if (watch & EVENTS_WRITE)
+	    FD_SET(fd, &wfds);
+    }
+
+    tv.tv_sec = timeout / 1000;
+    tv.tv_usec = (timeout % 1000) * 1000;
+
+    if ((nfds = select(events->max_fd + 1, &rfds, &wfds, NULL,
+		       timeout < 0 ? NULL : &tv)) == -1)
+	return errno == EINTR ? 0 : -1;
+
+    /* Collect ready descriptors */
+    for (fd = 0; fd <= events->max_fd && nfds > 0; fd++)
+	events_add_ready(events, fd,
+			 (FD_ISSET(fd, &rfds) ? EVENTS_READ : 0) |
+			 (FD_ISSET(fd, &wfds) ? EVENTS_WRITE : 0));
+
+    return events->ready_count;
+}
+
+#ifdef HAVE_EPOLL
+/*
+ * Wait for events with epoll.
+ */
+static int events_wait_epoll(events_t *const events, int timeout)
+{
+    int                 i;     /* Counter            */
+    int                 fd;    /* Current descriptor */
+    int                 count; /* Number of events   */
+    int                 mask;  /* Ready events       */
+    struct epoll_event *list;  /* Event list         */
+
+    assert(events != NULL);
+
+    /* Non-pollable descriptors are always ready: do not block */
+    for (fd = 0; fd < events->always; fd++)
+	if (events->fds[fd].always && events->fds[fd].watch != 0) {
+	    timeout = 0;
+	    break;
+	}
+
+    list = events->list;
+    if (events->size == 0)
+	count = 0;
+    else if ((count = epoll_wait(events->poll_fd, list, events->size,
+				 timeout)) == -1) {
+	if (errno != EINTR)
+	    return -1;
+	count = 0;
+    }
+
+    /* Collect ready descriptors */
+    for (i = 0; i < count; i++) {
+	fd = list[i].data.fd;
+	mask = 0;
+	if (list[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+	    mask |= EVENTS_READ;
+	if (list[i].events & (EPOLLOUT | EPOLLHUP | EPOLLERR))
+	    mask |= EVENTS_WRITE;
+	events_add_ready(events, fd, mask & events->fds[fd].watch);
+    }
+
+    for (fd = 0; fd < events->always; fd++)
+	if (events->fds[fd].always)
+	    events_add_ready(events, fd, events->fds[fd].watch);
+
+    return events->ready_count;
+}
+#endif /* HAVE_EPOLL */
+
+#ifdef HAVE_URING
+/*
+ * Build the user data of a poll request.
+ */
+static __u64 events_uring_data(const int fd, const unsigned seq)
+{
+    assert(fd >= 0);
+
+    return ((__u64) seq << 32) | (unsigned) fd;
+}
+
+/*
+ * Set up io_uring rings (the kernel must not drop completions and must
+ * accept a timeout along with a wait).
+ */
+static int events_uring_init(events_t *const events)
+{
+    int                    fd;     /* io_uring descriptor       */
+    events_uring_t        *ring;   /* io_uring state            */
+    struct io_uring_params params; /* Setup parameters          */
+
+    assert(events != NULL);
+
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE;
+#ifdef IORING_SETUP_SUBMIT_ALL
+    params.flags |= IORING_SETUP_SUBMIT_ALL;
+#endif
+    params.cq_entries = EVENTS_URING_CQ_SIZE;
+    if ((fd = syscall(__NR_io_uring_setup, EVENTS_URING_SQ_SIZE, &params))
+	== -1)
+	return -1;
+    if ((params.features & (IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG)) !=
+	(IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG) ||
+	(ring = calloc(1, sizeof(*ring))) == NULL) {
+	close(fd);
+	errno = ENOSYS;
+	return -1;
+    }
+    events->poll_fd = fd;
+    events->list = ring;
+
+    /* Map the rings (both in one mapping on recent kernels) */
+    ring->sq_size = params.sq_off.array + params.sq_entries *
+	sizeof(unsigned);
+    ring->cq_size = params.cq_off.cqes + params.cq_entries *
+	sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+	if (ring->cq_size > ring->sq_size)
+	    ring->sq_size = ring->cq_size;
+	ring->cq_size = 0;
+    }
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    if ((ring->sq_ring = mmap(NULL, ring->sq_size, PROT_READ | PROT_WRITE,
+			      MAP_SHARED | MAP_POPULATE, fd,
+			      IORING_OFF_SQ_RING)) == MAP_FAILED) {
+	ring->sq_ring = NULL;
+	return -1;
+    }
+    if (ring->cq_size == 0)
+	ring->cq_ring = ring->sq_ring;
+    else if ((ring->cq_ring = mmap(NULL, ring->cq_size,
+				   PROT_READ | PROT_WRITE,
+				   MAP_SHARED | MAP_POPULATE, fd,
+				   IORING_OFF_CQ_RING)) == MAP_FAILED) {
+	ring->cq_ring = NULL;
+	return -1;
+    }
+    if ((ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+			   MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES))
+	== MAP_FAILED) {
+	ring->sqes = NULL;
+	return -1;
+    }
+
+    ring->sq_head = (unsigned *) (ring->sq_ring + params.sq_off.head);
+    ring->sq_tail = (unsigned *) (ring->sq_ring + params.sq_off.tail);
+    ring->sq_array = (unsigned *) (ring->sq_ring + params.sq_off.array);
+    ring->sq_mask = *(unsigned *) (ring->sq_ring + params.sq_off.ring_mask);
+    ring->sq_entries = params.sq_entries;
+    ring->cq_head = (unsigned *) (ring->cq_ring + params.cq_off.head);
+    ring->cq_tail = (unsigned *) (ring->cq_ring + params.cq_off.tail);
+    ring->cqes = (struct io_uring_cqe *) (ring->cq_ring +
+					  params.cq_off.cqes);
+    ring->cq_mask = *(unsigned *) (ring->cq_ring + params.cq_off.ring_mask);
+    return 0;
+}
+
+/*
+ * Unmap io_uring rings and free descriptor states.
+ */
+static void events_uring_free(events_t *const events)
+{
+    events_uring_t *ring; /* io_uring state */
+
+    assert(events != NULL);
+
+    if ((ring = events->list) == NULL)
+	return;
+
+    if (ring->sqes != NULL)
+	munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ring != NULL && ring->cq_ring != ring->sq_ring)
+	munmap(ring->cq_ring, ring->cq_size);
+    if (ring->sq_ring != NULL)
+	munmap(ring->sq_ring, ring->sq_size);
+    free(ring->fds);
+    free(ring->pending);
+    free(ring);
+    events->list = NULL;
+}
+
+/*
+ * Submit queued requests and optionally wait for a completion (timeout in
+ * ms, -1 for none).
+ */
+static int events_uring_enter(events_t *const events, const int wait,
+			      const int timeout)
+{
+    unsigned                      count; /* Requests to submit  */
+    events_uring_t               *ring;  /* io_uring state      */
+    struct io_uring_getevents_arg arg;   /* Wait arguments      */
+    struct __kernel_timespec      ts;    /* Timeout             */
+
+    assert(events != NULL);
+    assert(events->list != NULL);
+
+    ring = events->list;
+    count = *ring->sq_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+
+    if (!wait) {
+	if (count == 0 ||
+	    syscall(__NR_io_uring_enter, events->poll_fd, count, 0, 0, NULL,
+		    0) != -1)
+	    return 0;
+    } else {
+	memset(&arg, 0, sizeof(arg));
+	if (timeout >= 0) {
+	    ts.tv_sec = timeout / 1000;
+	    ts.tv_nsec = (timeout % 1000) * 1000000L;
+	    arg.ts = (__u64) (unsigned long) &ts;
+	}
+	if (syscall(__NR_io_uring_enter, events->poll_fd, count, 1,
+		    IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg,
+		    sizeof(arg)) != -1)
+	    return 0;
+    }
+
+    /* Timeout, signal or completions to reap first: not an error */
+    return errno == ETIME || errno == EINTR || errno == EBUSY ||
+	errno == EAGAIN ? 0 : -1;
+}
+
+/*
+ * Queue a request (submitted on the next enter).
+ */
+static int events_uring_queue(events_t *const events, const int opcode,
+			      const int fd, const int mask,
+			      const __u64 addr, const __u64 data)
+{
+    unsigned             tail;  /* Submission queue tail */
+    unsigned             index; /* Entry index           */
+    unsigned             poll;  /* Polled events         */
+    events_uring_t      *ring;  /* io_uring state        */
+    struct io_uring_sqe *sqe;   /* Submission entry      */
+
+    assert(events != NULL);
+    assert(events->list != NULL);
+
+    ring = events->list;
+    tail = *ring->sq_tail;
+
+    /* Hand the full queue to the kernel */
+    if (tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) ==
+	ring->sq_entries) {
+	if (events_uring_enter(events, 0, 0) != 0)
+	    return -1;
+	if (tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) ==
+	    ring->sq_entries) {
+	    errno = EBUSY;
+	    return -1;
+	}
+    }
+
+    poll = ((mask & EVENTS_READ) ? POLLIN : 0) |
+	((mask & EVENTS_WRITE) ? POLLOUT : 0);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    /* The kernel swaps the halves of the 32-bit mask on big-endian */
+    poll = (poll << 16) | (poll >> 16);
+#endif
+
+    index = tail & ring->sq_mask;
+    sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->poll32_events = poll;
+    sqe->addr = addr;
+    sqe->user_data = data;
+    ring->sq_array[index] = index;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/*
+ * Cancel or schedule the poll request of a descriptor after a change in
+ * its watched events.
+ */
+static int events_uring_update(events_t *const events, const int fd)
+{
+    int                watch; /* Watched events    */
+    events_uring_t    *ring;  /* io_uring state    */
+    events_uring_fd_t *state; /* Descriptor state  */
+
+    assert(events != NULL);
+    assert(events->list != NULL);
+    assert(fd >= 0 && fd < events->size);
+
+    ring = events->list;
+    state = &ring->fds[fd];
+    watch = events->fds[fd].watch;
+
+    /*
+     * A request watching more events than needed is kept (it only causes
+     * a spurious wakeup); it must be cancelled before the descriptor is
+     * closed, since it holds a reference on the file.
+     */
+    if (state->armed != 0 && (watch == 0 || (watch & ~state->armed) != 0)) {
+	if (events_uring_queue(events, IORING_OP_POLL_REMOVE, -1, 0,
+			       events_uring_data(fd, state->seq),
+			       EVENTS_URING_CANCEL) != 0)
+	    return -1;
+	state->seq++;
+	state->armed = 0;
+
+	/* The descriptor is about to be closed: release it now */
+	if (watch == 0 && events_uring_enter(events, 0, 0) != 0)
+	    return -1;
+    }
+
+    if (watch != 0 && state->armed == 0 && !state->queued) {
+	state->queued = 1;
+	ring->pending[ring->pending_count++] = fd;
+    }
+    return 0;
+}
+
+/*
+ * Wait for events with io_uring (one-shot poll requests, submitted again
+ * after each completion, behave like level-triggered notifications).
+ */
+static int events_wait_uring(events_t *const events, const int timeout)
+{
+    int                  i;     /* Counter             */
+    int                  fd;    /* Current descriptor  */
+    int                  watch; /* Watched events      */
+    int                  mask;  /* Ready events        */
+    unsigned             head;  /* Completion head     */
+    unsigned             tail;  /* Completion tail     */
+    events_uring_t      *ring;  /* io_uring state      */
+    events_uring_fd_t   *state; /* Descriptor state    */
+    struct io_uring_cqe *cqe;   /* Completion entry    */
+
+    assert(events != NULL);
+    assert(events->list != NULL);
+
+    ring = events->list;
+
+    /* Poll descriptors without a request */
+    for (i = 0; i < ring->pending_count; i++) {
+	fd = ring->pending[i];
+	state = &ring->fds[fd];
+	watch = events->fds[fd].watch;
+	if (watch == 0 || state->armed != 0) {
+	    state->queued = 0;
+	    continue;
+	}
+	if (events_uring_queue(events, IORING_OP_POLL_ADD, fd, watch, 0,
+			       events_uring_data(fd, state->seq)) != 0) {
+	    /* Keep the remaining descriptors for the next wait */
+	    memmove(ring->pending, ring->pending + i,
+		    (ring->pending_count - i) * sizeof(*ring->pending));
+	    ring->pending_count -= i;
+	    return -1;
+	}
+	state->queued = 0;
+	state->armed = watch;
+    }
+    ring->pending_count = 0;
+
+    if (events_uring_enter(events, 1, timeout) != 0)
+	return -1;
+
+    /* Collect completions */
+    head = *ring->cq_head;
+    tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; head++) {
+	cqe = &ring->cqes[head & ring->cq_mask];
+	if (cqe->user_data == EVENTS_URING_CANCEL)
+	    continue;
+
+	/* Ignore requests cancelled since */
+	fd = (int) (cqe->user_data & 0xffffffffu);
+	if (fd >= events->size ||
+	    ring->fds[fd].seq != (unsigned) (cqe->user_data >> 32))
+	    continue;
+
+	state = &ring->fds[fd];
+	state->armed = 0;
+	if (events->fds[fd].watch != 0 && !state->queued) {
+	    state->queued = 1;
+	    ring->pending[ring->pending_count++] = fd;
+	}
+
+	/* Let the caller find out errors by reading or writing */
+	if (cqe->res < 0)
+	    mask = cqe->res == -ECANCELED ? 0 : EVENTS_READ | EVENTS_WRITE;
+	else
+	    mask = ((cqe->res & (POLLIN | POLLHUP | POLLERR)) ?
+		    EVENTS_READ : 0) |
+		((cqe->res & (POLLOUT | POLLHUP | POLLERR)) ?
+		 EVENTS_WRITE : 0);
+	events_add_ready(events, fd, mask & events->fds[fd].watch);
+    }
+    __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+
+    return events->ready_count;
+}
+#endif /* HAVE_URING */
+
+
+/*****************************************************************************
+ *
+ * Public functions
+ *
+ */
+
+/*
+ * Initialize an event manager.
+ */
+int events_init(events_t *const events, const events_backend_t backend)
+{
+    assert(events != NULL);
+
+    events->poll_fd = -1;
+    events->size = 0;
+    events->max_fd = -1;
+    events->always = 0;
+    events->fds = NULL;
+    events->ready = NULL;
+    events->ready_count = 0;
+    events->list = NULL;
+
+    switch (backend) {
+    case EVENTS_BACKEND_URING:
+#ifdef HAVE_URING
+	events->backend = EVENTS_BACKEND_URING;
+	if (events_uring_init(events) == 0)
+	    return 0;
+	events_uring_free(events);
+	if (events->poll_fd != -1) {
+	    close(events->poll_fd);
+	    events->poll_fd = -1;
+	}
+#endif
+
+	/* Fall through - io_uring unavailable, use the best other backend */
+
+    case EVENTS_BACKEND_AUTO:
+    case EVENTS_BACKEND_EPOLL:
+#ifdef HAVE_EPOLL
+	if ((events->poll_fd = epoll_create(EVENTS_MIN_SIZE)) != -1) {
+	    events->backend = EVENTS_BACKEND_EPOLL;
+	    return 0;
+	}
+#endif
+	if (backend == EVENTS_BACKEND_EPOLL)
+	    return -1;
+
+	/* Fall through - use select() */
+
+    case EVENTS_BACKEND_SELECT:
+	events->backend = EVENTS_BACKEND_SELECT;
+	return 0;
+
+    default:
+	return -1;
+    }
+}
+
+/*
+ * Free an event manager.
+ */
+void events_free(events_t *const events)
+{
+    assert(events != NULL);
+
+#ifdef HAVE_URING
+    if (events->backend == EVENTS_BACKEND_URING)
+	events_uring_free(events);
+#endif
+    if (events->poll_fd != -1)
+	close(events->poll_fd);
+    free(events->fds);
+    free(events->ready);
+    free(events->list);
+
+    events->poll_fd = -1;
+    events->size = 0;
+    events->max_fd = -1;
+    events->fds = NULL;
+    events->ready = NULL;
+    events->ready_count = 0;
+    events->list = NULL;
+}
+
+/*
+ * Get the backend in use.
+ */
+events_backend_t events_get_backend(const events_t *const events)
+{
+    assert(events != NULL);
+
+    return events->backend;
+}
+
+/*
+ * Get the name of the backend in use.
+ */
+const char *events_get_backend_name(const events_t *const events)
+{
+    assert(events != NULL);
+
+    switch (events->backend) {
+    case EVENTS_BACKEND_URING:
+	return "io_uring";
+
+    case EVENTS_BACKEND_EPOLL:
+	return "epoll";
+
+    case EVENTS_BACKEND_SELECT:
+	return "select";
+
+    default:
+	return "unknown";
+    }
+}
+
+/*
+ * Get the object associated with a descriptor.
+ */
+void *events_get_data(const events_t *const events, const int fd)
+{
+    assert(events != NULL);
+
+    if (fd < 0 || fd >= events->size)
+	return NULL;
+    return events->fds[fd].data;
+}
+
+/*
+ * Associate an object with a descriptor.
+ */
+void events_set_data(events_t *const events, const int fd, void *const data)
+{
+    assert(events != NULL);
+    assert(fd >= 0);
+
+    if (events_grow(events, fd) == 0)
+	events->fds[fd].data = data;
+}
+
+/*
+ * Watch events on a descriptor.
+ */
+int events_watch(events_t *const events, const int fd, const int mask)
+{
+    int old; /* Previously watched events */
+
+    assert(events != NULL);
+    assert(fd >= 0);
+
+    /* select() cannot handle large descriptors */
+    if (events->backend == EVENTS_BACKEND_SELECT && fd >= FD_SETSIZE) {
+	errno = EINVAL;
+	return -1;
+    }
+
+    if (events_grow(events, fd) != 0)
+	return -1;
+
+    old = events->fds[fd].watch;
+    if ((old | mask) == old)
+	return 0;
+
+    events->fds[fd].watch = old | mask;
+    if (events_update(events, fd, old) != 0) {
+	events->fds[fd].watch = old;
+	return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Stop watching events on a descriptor.
+ */
+int events_unwatch(events_t *const events, const int fd, const int mask)
+{
+    int old; /* Previously watched events */
+
+    assert(events != NULL);
+
+    if (fd < 0 || fd >= events->size)
+	return 0;
+
+    events->fds[fd].ready &= ~mask;
+    old = events->fds[fd].watch;
+    if ((old & ~mask) == old)
+	return 0;
+
+    events->fds[fd].watch = old & ~mask;
+    return events_update(events, fd, old);
+}
+
+/*
+ * Forget everything about a descriptor (call it before closing it).
+ */
+void events_remove(events_t *const events, const int fd)
+{
+    assert(events != NULL);
+
+    if (fd < 0 || fd >= events->size)
+	return;
+
+    events_unwatch(events, fd, EVENTS_READ | EVENTS_WRITE);
+    events->fds[fd].always = 0;
+    events->fds[fd].data = NULL;
+
+    /* Shrink the highest watched descriptor */
+    while (events->max_fd >= 0 && events->fds[events->max_fd].watch == 0)
+	events->max_fd--;
+}
+
+/*
+ * Wait until at least one watched descriptor is ready (timeout in ms, -1
+ * for none).
+ */
+int events_wait(events_t *const events, const int timeout)
+{
+    int i; /* Counter */
+
+    assert(events != NULL);
+
+    /* Forget about the previous wait */
+    for (i = 0; i < events->ready_count; i++)
+	events->fds[events->ready[i]].ready = 0;
+    events->ready_count = 0;
+
+    switch (events->backend) {
+#ifdef HAVE_EPOLL
+    case EVENTS_BACKEND_EPOLL:
+	return events_wait_epoll(events, timeout);
+#endif
+
+#ifdef HAVE_URING
+    case EVENTS_BACKEND_URING:
+	return events_wait_uring(events, timeout);
+#endif
+
+    default:
+	return events_wait_select(events, timeout);
+    }
+}
+
+/*
+ * Let know if a descriptor has been reported ready by the last wait.
+ */
+int events_is_ready(const events_t *const events, const int fd,
+		    const int mask)
+{
+    assert(events != NULL);
+
+    if (fd < 0 || fd >= events->size)
+	return 0;
+    return (events->fds[fd].ready & mask) != 0;
+}
+
+/*
+ * Get the number of descriptors reported ready by the last wait.
+ */
+int events_get_ready_count(const events_t *const events)
+{
+    assert(events != NULL);
+
+    return events->ready_count;
+}
+
+/*
+ * Get a descriptor reported ready by the last wait.
+ */
+int events_get_ready_fd(const events_t *const events, const int index)
+{
+    assert(events != NULL);
+    assert(index >= 0 && index < events->ready_count);
+
+    return events->ready[index];
+}
+
+/* End of file */
@@ -0,0 +1,115 @@
+/*
+ * ---------------------------------------------------------------------------
+ *
+ * Minitalk: a basic talk-like server/client
+ * Copyright (C) 2004 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: strlib/events.h
+ *
+ * Description: Event Notification (Header)
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+#ifndef EVENTS_H
+#define EVENTS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+
+/*
+ * Constants
+ */
+
+#define EVENTS_READ  1 /* Descriptor is watched/ready for reading */
+#define EVENTS_WRITE 2 /* Descriptor is watched/ready for writing */
+
+
+/*
+ * Data types
+ */
+
+/* Event notification backend */
+typedef enum events_backend {
+    EVENTS_BACKEND_AUTO,   /* Best available backend */
+    EVENTS_BACKEND_SELECT, /* select() (portable)    */
+    EVENTS_BACKEND_EPOLL,  /* epoll (Linux only)     */
+    EVENTS_BACKEND_URING   /* io_uring (Linux only)  */
+} events_backend_t;
+
+/* Watched descriptor */
+typedef struct events_fd {
+    unsigned char watch;  /* Watched events (EVENTS_*)               */
+    unsigned char ready;  /* Events reported by the last wait        */
+    unsigned char always; /* Cannot be polled (regular file, etc.)   */
+    void         *data;   /* Object associated with the descriptor   */
+} events_fd_t;
+
+/* Event manager */
+typedef struct events {
+    events_backend_t backend;     /* Backend in use                         */
+    int              poll_fd;     /* Backend descriptor (-1 for select())   */
+    int              size;        /* Size of the descriptor table           */
+    int              max_fd;      /* Highest watched descriptor             */
+    int              always;      /* Number of non-pollable descriptors     */
+    events_fd_t     *fds;         /* Descriptor table (indexed by fd)       */
+    int             *ready;       /* Descriptors reported by the last wait  */
+    int              ready_count; /* Number of ready descriptors            */
+    void            *list;        /* Backend-specific event list or state   */
+} events_t;
+
+
+/*
+ * Prototypes
+ */
+
+/* Constructors and destructors */
+int  events_init(events_t *const events, const events_backend_t backend);
+void events_free(events_t *const events);
+
+/* Accessors */
+events_backend_t events_get_backend(const events_t *const events);
+const char      *events_get_backend_name(const events_t *const events);
+void            *events_get_data(const events_t *const events, const int fd);
+void             events_set_data(events_t *const events, const int fd,
+				 void *const data);
+
+/* Methods */
+int  events_watch(events_t *const events, const int fd, const int mask);
+int  events_unwatch(events_t *const events, const int fd, const int mask);
+void events_remove(events_t *const events, const int fd);
+int  events_wait(events_t *const events, const int timeout);
+int  events_is_ready(const events_t *const events, const int fd,
+		     const int mask);
+int  events_get_ready_count(const events_t *const events);
+int  events_get_ready_fd(const events_t *const events, const int index);
+
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !EVENTS_H */
+
+/* End of file */
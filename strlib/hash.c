@@ -37,60 +37,284 @@
  */
 
 /* System headers */
-#include <stdlib.h> /* malloc(), free(), NULL */
-#include <string.h> /* memcpy(), strcmp()     */
-#include <assert.h> /* assert()               */
+#include <stdlib.h> /* malloc(), calloc(), free(), NULL       */
+#include <string.h> /* memset(), memcpy(), strcmp(), strlen() */
+#include <unistd.h> /* read(), close(), getpid()               */
+#include <fcntl.h>  /* open(), O_RDONLY                        */
+#include <time.h>   /* time()                                  */
+#include <assert.h> /* assert()                                */
 
 /* Project headers */
 #include <common.h>
 #include "hash.h"
 
 
+/*****************************************************************************
+ *
+ * Constants
+ *
+ */
+
+/* Minimum number of slots of a table */
+#define HASH_MIN_SIZE 16
+
+/* Number of slots of the previous table moved by each operation */
+#define HASH_MIGRATE 8
+
+/* Slot tags: other values are fingerprints (8 most significant key bits) */
+#define TAG_EMPTY   0
+#define TAG_DELETED 1
+
+/* Multiplication constants of the hash function (odd, well-mixed bits) */
+#define HASH_K0 0xa0761d6478bd642fULL
+#define HASH_K1 0xe7037ed1a0b428dbULL
+#define HASH_K2 0x8ebc6af09c88c6e3ULL
+
+
+/*****************************************************************************
+ *
+ * Local variables
+ *
+ */
+
+/* Seed of the hash function (see hash_randomize()) */
+static unsigned long long hash_seed = HASH_K2;
+
+
 /*****************************************************************************
  *
  * Private functions
  *
  */
 
-/* Hash Algorithm Explanation
+/* Table Layout Explanation
+
+   Elements are stored in an open-addressing table with linear probing; the
+   number of slots is a power of two and at most 3/4 of them are used.
+
+   Each slot has a one-byte tag: empty, deleted (tombstone) or the
+   fingerprint of the element key.  Lookups compare tags first, so strcmp()
+   is called almost only for the searched string.
+
+   When the table is full, a new one is allocated and the elements of the
+   previous one are moved a few slots at a time by each addition, removal
+   or lookup, so that no operation costs more than HASH_MIGRATE slot moves
+   besides its own probing; lookups search both tables meanwhile.
+
+   Keys are computed eight bytes at a time: each word is multiplied by a
+   large odd constant, rotated and folded into a state initialized from a
+   process-wide seed and the string length, which is then avalanched.
+   Every input bit thus affects every key bit, so anagrams or strings
+   differing by their last character do not collide, and the seed, chosen
+   at random on startup, prevents remote users from crafting nicknames
+   which all land in the same slots. */
+
+/* Prototypes */
+static unsigned      hash_function(const char *const str);
+static unsigned char hash_tag(const unsigned key);
+static void          table_insert(hash_table_t *const table,
+				  hash_element_t *const element);
+static int           table_find(const hash_table_t *const table,
+				const char *const str, const unsigned key);
+static int           table_find_element(const hash_table_t *const table,
+					const hash_element_t *const element);
+static void          hash_migrate(hash_t *const hash, unsigned count);
+static int           hash_resize(hash_t *const hash);
 
-   The hash key is 10 bits long (so the table size is 4 KB on 32-bit
-   machines) and is composed as this:
+/*
+ * Hash function (seeded, word-at-a-time).
+ */
+static unsigned hash_function(const char *const str)
+{
+    size_t             len;  /* Remaining length */
+    const char        *chr;  /* Current position */
+    unsigned long long word; /* Current word     */
+    unsigned long long key;  /* Hash state       */
 
-	     +---+---+---+---+---+---+---+---+---+---+
-   Bits   -> | 9 | 8 | 7 | 6 | 5 | 4 | 3 | 2 | 1 | 0 |
-	     +---+---+---+---+---+---+---+---+---+---+
-   Fields -> |Length |   Sum of rotated characters   |
-	     +-------+-------------------------------+
+    assert(str != NULL);
 
-   Length: string length % 4 (the 2 least significant bits).
-   Sum: each character is left-rotated with a byte boundary (bits that get
-	out of the byte are reinserted to the right) then summed up; the
-	result is the least significant byte of the sum. */
+    len = strlen(str);
+    key = hash_seed ^ ((unsigned long long) len * HASH_K0);
 
-/* Left-rotate a number of given length by a specified offset */
-#define ROT_LEFT(x, offset, bits) \
-    (((offset) % (bits)) == 0 ? ((x) & ((1 << (bits)) - 1)) : (((x) << \
-    ((offset) % (bits))) & ((1 << (bits)) - 1)) | (((x) & ((1 << (bits)) - \
-    1)) >> ((bits) - ((offset) % (bits)))))
+    /* Whole words */
+    for (chr = str; len >= sizeof(word); chr += sizeof(word),
+	 len -= sizeof(word)) {
+	memcpy(&word, chr, sizeof(word));
+	key ^= word * HASH_K1;
+	key = ((key << 31) | (key >> 33)) * HASH_K2;
+    }
+
+    /* Last bytes */
+    if (len > 0) {
+	word = 0;
+	memcpy(&word, chr, len);
+	key ^= word * HASH_K1;
+	key = ((key << 31) | (key >> 33)) * HASH_K2;
+    }
+
+    /* Final avalanche */
+    key ^= key >> 32;
+    key *= HASH_K0;
+    key ^= key >> 29;
+    key *= HASH_K1;
+    key ^= key >> 32;
+
+    return (unsigned) key;
+}
 
 /*
- * Hash function.
+ * Get the tag of a key.
  */
-static int hash_function(const char *const str)
+static unsigned char hash_tag(const unsigned key)
 {
-    int i;
-    unsigned chr;
-    unsigned sum;
+    unsigned char tag;
 
+    tag = (unsigned char) (key >> 24);
+    return tag > TAG_DELETED ? tag : tag + 2;
+}
+
+/*
+ * Insert an element in a table (which must have a free slot).
+ */
+static void table_insert(hash_table_t *const table,
+			 hash_element_t *const element)
+{
+    unsigned i;
+
+    assert(table != NULL);
+    assert(table->tags != NULL);
+    assert(element != NULL);
+
+    /* Find a free slot (reusing tombstones) */
+    for (i = element->key & table->mask; table->tags[i] > TAG_DELETED;
+	 i = (i + 1) & table->mask)
+	;
+
+    if (table->tags[i] == TAG_EMPTY)
+	table->used++;
+    table->tags[i] = hash_tag(element->key);
+    table->slots[i] = element;
+    table->count++;
+}
+
+/*
+ * Find the slot of a string in a table, or -1.
+ */
+static int table_find(const hash_table_t *const table,
+		      const char *const str, const unsigned key)
+{
+    unsigned      i;
+    unsigned char tag;
+
+    assert(table != NULL);
     assert(str != NULL);
 
-    /* See the explanation above */
-    sum = 0;
-    for (i = 0; (chr = (unsigned char) str[i]) != '\0'; i++)
-	sum += ROT_LEFT(chr, i, 8);
+    if (table->tags == NULL)
+	return -1;
 
-    return ((i & 3) << 8) | (sum & 0xFF);
+    tag = hash_tag(key);
+    for (i = key & table->mask; table->tags[i] != TAG_EMPTY;
+	 i = (i + 1) & table->mask)
+	if (table->tags[i] == tag && table->slots[i]->key == key &&
+	    strcmp(str, table->slots[i]->str) == 0)
+	    return i;
+
+    return -1;
+}
+
+/*
+ * Find the slot of an element in a table, or -1.
+ */
+static int table_find_element(const hash_table_t *const table,
+			      const hash_element_t *const element)
+{
+    unsigned i;
+
+    assert(table != NULL);
+    assert(element != NULL);
+
+    if (table->tags == NULL)
+	return -1;
+
+    for (i = element->key & table->mask; table->tags[i] != TAG_EMPTY;
+	 i = (i + 1) & table->mask)
+	if (table->slots[i] == element && table->tags[i] != TAG_DELETED)
+	    return i;
+
+    return -1;
+}
+
+/*
+ * Move up to `count' slots of the previous table to the current one.
+ */
+static void hash_migrate(hash_t *const hash, unsigned count)
+{
+    hash_table_t *old;
+
+    assert(hash != NULL);
+
+    old = &hash->old;
+    if (old->tags == NULL)
+	return;
+
+    for (; count > 0 && hash->migrated <= old->mask; count--) {
+	if (old->tags[hash->migrated] > TAG_DELETED) {
+	    table_insert(&hash->table, old->slots[hash->migrated]);
+	    old->tags[hash->migrated] = TAG_DELETED;
+	    old->count--;
+	}
+	hash->migrated++;
+    }
+
+    /* Free the previous table once it is empty */
+    if (hash->migrated > old->mask) {
+	free(old->tags);
+	free(old->slots);
+	memset(old, 0, sizeof(hash_table_t));
+	hash->migrated = 0;
+    }
+}
+
+/*
+ * Allocate a new current table; the elements of the current one will be
+ * moved by hash_migrate().
+ */
+static int hash_resize(hash_t *const hash)
+{
+    unsigned     size;  /* Number of slots                        */
+    unsigned     need;  /* Elements until the end of the resizing */
+    hash_table_t table; /* New table                              */
+
+    assert(hash != NULL);
+
+    /* Finish the previous resizing (already done, given the sizes below) */
+    hash_migrate(hash, hash->old.mask + 1);
+
+    /* Twice as many slots as the elements present when all are moved */
+    need = hash->table.count + (hash->table.mask + 1) / HASH_MIGRATE + 1;
+    for (size = HASH_MIN_SIZE; size < need * 2; size *= 2)
+	;
+
+    table.tags = calloc(size, sizeof(unsigned char));
+    table.slots = malloc(size * sizeof(hash_element_t *));
+    if (table.tags == NULL || table.slots == NULL) {
+	free(table.tags);
+	free(table.slots);
+	return -1;
+    }
+    table.mask = size - 1;
+    table.count = 0;
+    table.used = 0;
+
+    hash->old = hash->table;
+    hash->table = table;
+    hash->migrated = 0;
+
+    /* Nothing to move from an unallocated table */
+    if (hash->old.tags == NULL)
+	memset(&hash->old, 0, sizeof(hash_table_t));
+
+    return 0;
 }
 
 
@@ -100,6 +324,39 @@ static int hash_function(const char *const str)
  *
  */
 
+/*
+ * Set the seed of the hash function (only while all tables are empty).
+ */
+void hash_set_seed(const unsigned long long seed)
+{
+    hash_seed = seed;
+}
+
+/*
+ * Choose a random seed for the hash function (only while all tables are
+ * empty).
+ */
+void hash_randomize(void)
+{
+    int                fd;   /* Random device */
+    unsigned long long seed; /* New seed      */
+
+    seed = 0;
+    if ((fd = open("/dev/urandom", O_RDONLY)) != -1) {
+	if (read(fd, &seed, sizeof(seed)) != sizeof(seed))
+	    seed = 0;
+	close(fd);
+    }
+
+    /* Poor man's fallback */
+    if (seed == 0)
+	seed = ((unsigned long long) time(NULL) * HASH_K0) ^
+	    ((unsigned long long) getpid() * HASH_K1) ^
+	    (unsigned long long) (size_t) &seed;
+
+    hash_set_seed(seed);
+}
+
 /*
  * Create a new hash table.
  */
@@ -107,7 +364,7 @@ hash_t *hash_new(void)
 {
     hash_t *hash;
 
-    if ((hash = malloc(sizeof(hash_t))) == NULL)
+    if ((hash = malloc(sizeof(hash_t))) != NULL)
 	hash_init(hash);
     return hash;
 }
@@ -124,50 +381,69 @@ void hash_delete(hash_t *const hash)
 }
 
 /*
- * Initialize a hash table.
+ * Initialize a hash table (tables are allocated with the first element).
  */
 void hash_init(hash_t *const hash)
 {
     assert(hash != NULL);
 
-    memset(hash->table, 0, sizeof(hash->table));
+    memset(hash, 0, sizeof(hash_t));
 }
 
 /*
  * Free a hash table.
  */
-void hash_free(const hash_t *const hash)
+void hash_free(hash_t *const hash)
 {
-    int             key;
-    hash_element_t *element;
+    unsigned      i;
+    int           t;
+    hash_table_t *table;
 
     assert(hash != NULL);
 
-    /* Free all malloc'ed elements */
-    for (key = 0; key < HASH_SIZE; key++)
-	if ((element = hash->table[key]) != NULL) {
-	    while (element->next != NULL) {
-		element = element->next;
-		if (element->prev->alloced == 1)
-		    free(element->prev);
-	    }
-
-	    if (element->alloced == 1)
-		free(element);
-	}
+    /* Free all malloc'ed elements, then the tables */
+    for (t = 0; t < 2; t++) {
+	table = t == 0 ? &hash->table : &hash->old;
+	if (table->tags == NULL)
+	    continue;
+
+	for (i = 0; i <= table->mask; i++)
+	    if (table->tags[i] > TAG_DELETED && table->slots[i]->alloced == 1)
+		free(table->slots[i]);
+
+	free(table->tags);
+	free(table->slots);
+    }
+
+    hash_init(hash);
 }
 
 /*
- * Add an element to the hash table.
+ * Get the number of elements.
+ */
+int hash_get_count(const hash_t *const hash)
+{
+    assert(hash != NULL);
+
+    return hash->table.count + hash->old.count;
+}
+
+/*
+ * Add an element to the hash table.  Returns the element, or NULL if memory
+ * could not be allocated, even for an element given by the caller (the
+ * table is left unchanged then).
  */
 hash_element_t *hash_add(hash_t *const hash, const char *const str,
 			 const void *const object, hash_element_t *element)
 {
-    int key;
-
     assert(hash != NULL);
     assert(str != NULL);
 
+    /* Grow the table if it is 3/4 full */
+    if ((hash->table.used + 1) * 4 > (int) (hash->table.mask + 1) * 3 &&
+	hash_resize(hash) != 0)
+	return NULL;
+
     /* Allocate memory if necessary */
     if (element != NULL)
 	element->alloced = 0;
@@ -177,22 +453,15 @@ hash_element_t *hash_add(hash_t *const hash, const char *const str,
 	element->alloced = 1;
     }
 
-    /* Get the key */
-    key = hash_function(str);
-    assert(key >= HASH_MIN && key <= HASH_MAX);
-    key -= HASH_MIN;
-
     /* Initialise element */
     element->object = object;
     element->str = str;
-    element->key = key;
-    element->next = hash->table[key];
-    element->prev = NULL;
+    element->key = hash_function(str);
+
+    table_insert(&hash->table, element);
 
-    /* Link the element to the list */
-    if (element->next != NULL)
-	hash->table[key]->prev = element;
-    hash->table[key] = element;
+    /* Move part of the previous table */
+    hash_migrate(hash, HASH_MIGRATE);
 
     return element;
 }
@@ -202,49 +471,60 @@ hash_element_t *hash_add(hash_t *const hash, const char *const str,
  */
 void *hash_remove(hash_t *const hash, hash_element_t *const element)
 {
-    const void *object;
+    int           i;
+    const void   *object;
+    hash_table_t *table;
 
     assert(hash != NULL);
     assert(element != NULL);
-    assert(element->key >= 0 && element->key < HASH_SIZE);
 
     object = element->object;
 
-    /* Unlink element from the list */
-    if (element->prev != NULL)
-	element->prev->next = element->next;
-    else
-	hash->table[element->key] = element->next;
-    if (element->next != NULL)
-	element->next->prev = element->prev;
+    /* Find the slot in the current or previous table */
+    table = &hash->table;
+    if ((i = table_find_element(table, element)) == -1) {
+	table = &hash->old;
+	i = table_find_element(table, element);
+    }
+    assert(i != -1);
+
+    /* Leave a tombstone so that probing goes on */
+    if (i != -1) {
+	table->tags[i] = TAG_DELETED;
+	table->count--;
+    }
 
     if (element->alloced == 1)
 	free(element);
 
+    /* Move part of the previous table */
+    hash_migrate(hash, HASH_MIGRATE);
+
     return (void *) object;
 }
 
 /*
  * Find an element in the hash table.
  */
-hash_element_t *hash_find(const hash_t *const hash, const char *const str)
+hash_element_t *hash_find(hash_t *const hash, const char *const str)
 {
-    int             key;
-    hash_element_t *element;
+    int      i;
+    unsigned key;
 
     assert(hash != NULL);
+    assert(str != NULL);
+
+    /* Move part of the previous table */
+    hash_migrate(hash, HASH_MIGRATE);
 
-    /* Get the key */
     key = hash_function(str);
-    assert(key >= HASH_MIN && key <= HASH_MAX);
-    key -= HASH_MIN;
 
-    /* Walk through the linked list */
-    for (element = hash->table[key]; element != NULL; element = element->next)
-	if (strcmp(str, element->str) == 0)
-	    break;
+    if ((i = table_find(&hash->table, str, key)) != -1)
+	return hash->table.slots[i];
+    if ((i = table_find(&hash->old, str, key)) != -1)
+	return hash->old.slots[i];
 
-    return element;
+    return NULL;
 }
 
 /* End of file */
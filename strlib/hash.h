@@ -38,33 +38,32 @@ extern "C" {
 #endif /* __cplusplus */
 
 
-/*
- * Constants
- */
-
-#define HASH_BITS 10                        /* Hash key length in bits  */
-#define HASH_MIN  0                         /* Minimum value of the key */
-#define HASH_MAX  ((1 << HASH_BITS) - 1)    /* Maximum value of the key */
-#define HASH_SIZE (HASH_MAX - HASH_MIN + 1) /* Number of key values     */
-
-
 /*
  * Data types
  */
 
-/* Fash table element */
+/* Hash table element */
 typedef struct hash_element {
-    int                  alloced; /* If element has been auto-malloc'ed  */
-    const void          *object;  /* Pointer to the corresponding object */
-    const char          *str;     /* Pointer to the corresponding string */
-    int                  key;     /* Hash key                            */
-    struct hash_element *next;    /* Next element with the same key      */
-    struct hash_element *prev;    /* Previous element with the same key  */
+    int          alloced; /* If element has been auto-malloc'ed  */
+    const void  *object;  /* Pointer to the corresponding object */
+    const char  *str;     /* Pointer to the corresponding string */
+    unsigned     key;     /* Hash key (full hash value)          */
 } hash_element_t;
 
+/* Open-addressing table */
+typedef struct hash_table {
+    unsigned char   *tags;  /* Slot tags (empty, deleted, fingerprint) */
+    hash_element_t **slots; /* Elements                                */
+    unsigned         mask;  /* Number of slots - 1 (power of two)      */
+    int              count; /* Number of elements                      */
+    int              used;  /* Number of non-empty slots               */
+} hash_table_t;
+
 /* Hash table */
 typedef struct hash {
-    hash_element_t *table[HASH_SIZE]; /* Pointer the elements for each key */
+    hash_table_t table;    /* Current table                         */
+    hash_table_t old;      /* Previous table (while being resized)  */
+    unsigned     migrated; /* Slots of previous table already moved */
 } hash_t;
 
 
@@ -72,18 +71,25 @@ typedef struct hash {
  * Prototypes
  */
 
+/* Hash function */
+void hash_set_seed(const unsigned long long seed);
+void hash_randomize(void);
+
 /* Constructors and destructors */
 hash_t *hash_new(void);
 void    hash_delete(hash_t *const hash);
 void    hash_init(hash_t *const hash);
-void    hash_free(const hash_t *const hash);
+void    hash_free(hash_t *const hash);
+
+/* Accessors */
+int hash_get_count(const hash_t *const hash);
 
 /* Methods */
 hash_element_t *hash_add(hash_t *const hash, const char *const str,
 			 const void *const object, hash_element_t *element);
 void           *hash_remove(hash_t *const hash,
 			    hash_element_t *const element);
-hash_element_t *hash_find(const hash_t *const hash, const char *const str);
+hash_element_t *hash_find(hash_t *const hash, const char *const str);
 
 
 #ifdef __cplusplus
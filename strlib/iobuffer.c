@@ -37,12 +37,13 @@
  */
 
 /* System headers */
-#include <stdlib.h>     /* malloc(), free(), NULL */
-#include <assert.h>     /* assert()               */
-#include <sys/select.h> /* fd_set                 */
+#include <stdlib.h> /* malloc(), free(), NULL */
+#include <assert.h> /* assert()               */
 
 /* Project headers */
 #include <common.h>
+#include "events.h"
+#include "segment.h"
 #include "dbuffer.h"
 #include "iobuffer.h"
 
@@ -57,14 +58,12 @@
  * Create a new I/O Buffer.
  */
 iobuffer_t *iobuffer_new(const int input_fd, const int output_fd,
-			 fd_set *const read_fds, fd_set *const write_fds,
-			 const char separator)
+			 events_t *const events, const char separator)
 {
     iobuffer_t *buffer;
 
     if ((buffer = malloc(sizeof(iobuffer_t))) != NULL)
-	iobuffer_init(buffer, input_fd, output_fd, read_fds, write_fds,
-		      separator);
+	iobuffer_init(buffer, input_fd, output_fd, events, separator);
     return buffer;
 }
 
@@ -83,13 +82,13 @@ void iobuffer_delete(iobuffer_t *const buffer)
  * Initialize an I/O Buffer.
  */
 void iobuffer_init(iobuffer_t *const buffer, const int input_fd,
-		   const int output_fd, fd_set *const read_fds,
-		   fd_set *const write_fds, const char separator)
+		   const int output_fd, events_t *const events,
+		   const char separator)
 {
     assert(buffer != NULL);
 
-    dbuffer_init(&buffer->input, input_fd, read_fds, separator);
-    dbuffer_init(&buffer->output, output_fd, write_fds, separator);
+    dbuffer_init(&buffer->input, input_fd, events, separator);
+    dbuffer_init(&buffer->output, output_fd, events, separator);
 }
 
 /*
@@ -144,23 +143,13 @@ int iobuffer_get_output_fd(const iobuffer_t *const buffer)
 }
 
 /*
- * Get read file descriptor set.
+ * Get the event manager.
  */
-fd_set *iobuffer_get_read_fds(const iobuffer_t *const buffer)
+events_t *iobuffer_get_events(const iobuffer_t *const buffer)
 {
     assert(buffer != NULL);
 
-    return dbuffer_get_fds(&buffer->input);
-}
-
-/*
- * Get write file descriptor set.
- */
-fd_set *iobuffer_get_write_fds(const iobuffer_t *const buffer)
-{
-    assert(buffer != NULL);
-
-    return dbuffer_get_fds(&buffer->output);
+    return dbuffer_get_events(&buffer->input);
 }
 
 /*
@@ -194,23 +183,14 @@ void iobuffer_set_output_fd(iobuffer_t *const buffer, const int fd)
 }
 
 /*
- * Set the read file descriptor set.
+ * Set the event manager.
  */
-void iobuffer_set_read_fds(iobuffer_t *const buffer, fd_set *const fds)
+void iobuffer_set_events(iobuffer_t *const buffer, events_t *const events)
 {
     assert(buffer != NULL);
 
-    dbuffer_set_fds(&buffer->input, fds);
-}
-
-/*
- * Set the write file descriptor set.
- */
-void iobuffer_set_write_fds(iobuffer_t *const buffer, fd_set *const fds)
-{
-    assert(buffer != NULL);
-
-    dbuffer_set_fds(&buffer->output, fds);
+    dbuffer_set_events(&buffer->input, events);
+    dbuffer_set_events(&buffer->output, events);
 }
 
 /*
@@ -227,7 +207,7 @@ void iobuffer_set_separator(iobuffer_t *const buffer, const char separator)
 /*
  * Get the size of the first input token.
  */
-int iobuffer_input_token_size(const iobuffer_t *const buffer)
+int iobuffer_input_token_size(iobuffer_t *const buffer)
 {
     assert(buffer != NULL);
 
@@ -237,7 +217,7 @@ int iobuffer_input_token_size(const iobuffer_t *const buffer)
 /*
  * Get the size of the first output token.
  */
-int iobuffer_output_token_size(const iobuffer_t *const buffer)
+int iobuffer_output_token_size(iobuffer_t *const buffer)
 {
     assert(buffer != NULL);
 
@@ -287,6 +267,39 @@ int iobuffer_put_data(iobuffer_t *const buffer, const char *const data,
     return dbuffer_put_data(&buffer->output, data, data_size);
 }
 
+/*
+ * Put a shared segment to the output buffer.
+ */
+int iobuffer_put_segment(iobuffer_t *const buffer, segment_t *const segment)
+{
+    assert(buffer != NULL);
+    assert(segment != NULL);
+
+    return dbuffer_put_segment(&buffer->output, segment);
+}
+
+/*
+ * Drop shared segments not written yet from the output buffer, oldest first,
+ * until at most size bytes are left (see dbuffer_drop_segments()).
+ */
+int iobuffer_drop_output(iobuffer_t *const buffer, const int size)
+{
+    assert(buffer != NULL);
+
+    return dbuffer_drop_segments(&buffer->output, size);
+}
+
+/*
+ * Discard all the data of the output buffer.
+ */
+int iobuffer_discard_output(iobuffer_t *const buffer)
+{
+    assert(buffer != NULL);
+
+    return dbuffer_get_data(&buffer->output, NULL,
+			    dbuffer_get_size(&buffer->output));
+}
+
 /*
  * Input a non-blank line from the input buffer.
  */
@@ -297,4 +310,24 @@ line_t *iobuffer_input_line(iobuffer_t *const buffer, const int space)
     return dbuffer_input_line(&buffer->input, space);
 }
 
+/*
+ * View a non-blank line from the input buffer (see dbuffer_view_line()).
+ */
+line_t *iobuffer_view_line(iobuffer_t *const buffer, const int space)
+{
+    assert(buffer != NULL);
+
+    return dbuffer_view_line(&buffer->input, space);
+}
+
+/*
+ * Consume the line viewed from the input buffer.
+ */
+void iobuffer_release_line(iobuffer_t *const buffer)
+{
+    assert(buffer != NULL);
+
+    dbuffer_release_line(&buffer->input);
+}
+
 /* End of file */
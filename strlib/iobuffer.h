@@ -38,9 +38,6 @@
  * Headers
  */
 
-/* System headers */
-#include <sys/select.h> /* fd_set */
-
 /* Project headers */
 #include <dbuffer.h> /* dbuffer_t, line_t */
 
@@ -54,6 +51,10 @@ extern "C" {
  * Data types
  */
 
+/* Event manager and shared segment (non-explicit) */
+struct events;
+struct segment;
+
 /* Dynamic input/output buffer */
 typedef struct iobuffer {
     dbuffer_t input;  /* Input dynamic buffer  */
@@ -67,38 +68,43 @@ typedef struct iobuffer {
 
 /* Constructors and destructors */
 iobuffer_t *iobuffer_new(const int input_fd, const int output_fd,
-			 fd_set *const read_fds, fd_set *const write_fds,
-			 const char separator);
+			 struct events *const events, const char separator);
 void        iobuffer_delete(iobuffer_t *const buffer);
 void        iobuffer_init(iobuffer_t *const buffer, const int input_fd,
-			  const int output_fd, fd_set *const read_fds,
-			  fd_set *const write_fds, const char separator);
+			  const int output_fd, struct events *const events,
+			  const char separator);
 void        iobuffer_free(iobuffer_t *const buffer);
 
 /* Accessors */
-int     iobuffer_get_input_size(const iobuffer_t *const buffer);
-int     iobuffer_get_output_size(const iobuffer_t *const buffer);
-int     iobuffer_get_input_fd(const iobuffer_t *const buffer);
-int     iobuffer_get_output_fd(const iobuffer_t *const buffer);
-fd_set *iobuffer_get_read_fds(const iobuffer_t *const buffer);
-fd_set *iobuffer_get_write_fds(const iobuffer_t *const buffer);
-char    iobuffer_get_separator(const iobuffer_t *const buffer);
-void    iobuffer_set_input_fd(iobuffer_t *const buffer, const int fd);
-void    iobuffer_set_output_fd(iobuffer_t *const buffer, const int fd);
-void    iobuffer_set_read_fds(iobuffer_t *const buffer, fd_set *const fds);
-void    iobuffer_set_write_fds(iobuffer_t *const buffer, fd_set *const fds);
-void    iobuffer_set_separator(iobuffer_t *const buffer,
-			       const char separator);
+int            iobuffer_get_input_size(const iobuffer_t *const buffer);
+int            iobuffer_get_output_size(const iobuffer_t *const buffer);
+int            iobuffer_get_input_fd(const iobuffer_t *const buffer);
+int            iobuffer_get_output_fd(const iobuffer_t *const buffer);
+struct events *iobuffer_get_events(const iobuffer_t *const buffer);
+char           iobuffer_get_separator(const iobuffer_t *const buffer);
+void           iobuffer_set_input_fd(iobuffer_t *const buffer, const int fd);
+void           iobuffer_set_output_fd(iobuffer_t *const buffer,
+				      const int fd);
+void           iobuffer_set_events(iobuffer_t *const buffer,
+				   struct events *const events);
+void           iobuffer_set_separator(iobuffer_t *const buffer,
+				      const char separator);
 /* Methods */
-int     iobuffer_input_token_size(const iobuffer_t *const buffer);
-int     iobuffer_output_token_size(const iobuffer_t *const buffer);
+int     iobuffer_input_token_size(iobuffer_t *const buffer);
+int     iobuffer_output_token_size(iobuffer_t *const buffer);
 int     iobuffer_read(iobuffer_t *const buffer);
 int     iobuffer_write(iobuffer_t *const buffer);
 int     iobuffer_get_data(iobuffer_t *const buffer, char *const data,
 			  const int data_size);
 int     iobuffer_put_data(iobuffer_t *const buffer, const char *const data,
 			  const int data_size);
+int     iobuffer_put_segment(iobuffer_t *const buffer,
+			     struct segment *const segment);
+int     iobuffer_drop_output(iobuffer_t *const buffer, const int size);
+int     iobuffer_discard_output(iobuffer_t *const buffer);
 line_t *iobuffer_input_line(iobuffer_t *const buffer, const int space);
+line_t *iobuffer_view_line(iobuffer_t *const buffer, const int space);
+void    iobuffer_release_line(iobuffer_t *const buffer);
 
 
 #ifdef __cplusplus
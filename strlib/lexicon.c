@@ -0,0 +1,260 @@
+/*
+ * ---------------------------------------------------------------------------
+ *
+ * Minitalk: a basic talk-like server/client
+ * Copyright (C) 2004 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: strlib/lexicon.c
+ *
+ * Description: Sorted String Index
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+/*****************************************************************************
+ *
+ * Headers
+ *
+ */
+
+/* System headers */
+#include <stdlib.h> /* realloc(), free(), NULL                 */
+#include <string.h> /* strcmp(), strncmp(), strlen(), memmove() */
+#include <assert.h> /* assert()                                 */
+
+/* Project headers */
+#include <common.h>
+#include "lexicon.h"
+
+
+/*****************************************************************************
+ *
+ * Constants
+ *
+ */
+
+/* Initial number of entries */
+#define LEXICON_MIN_SIZE 16
+
+
+/*****************************************************************************
+ *
+ * Private functions
+ *
+ */
+
+/* Index Layout Explanation
+
+   Entries are kept in an array sorted by string, so that an exact or prefix
+   search is a binary search, and all strings sharing a prefix are found
+   next to each other: a page of them is reached directly by its offset from
+   the first one.  Additions and removals move the following entries, which
+   is a single memmove() of pointers and stays cheap for thousands of
+   entries. */
+
+/* Prototypes */
+static int lexicon_lower_bound(const lexicon_t *const lexicon,
+			       const char *const str);
+
+/*
+ * Find the index of the first string not less than `str'.
+ */
+static int lexicon_lower_bound(const lexicon_t *const lexicon,
+			       const char *const str)
+{
+    int start; /* First candidate         */
+    int end;   /* Past the last candidate */
+    int pos;   /* Middle                  */
+
+    assert(lexicon != NULL);
+    assert(str != NULL);
+
+    start = 0;
+    end = lexicon->count;
+
+    /* Dichotomic search */
+    while (start < end) {
+	pos = (start + end) / 2;
+	if (strcmp(lexicon->entries[pos].str, str) < 0)
+	    start = pos + 1;
+	else
+	    end = pos;
+    }
+
+    return start;
+}
+
+
+/*****************************************************************************
+ *
+ * Public functions
+ *
+ */
+
+/*
+ * Initialize an index (entries are allocated with the first one).
+ */
+void lexicon_init(lexicon_t *const lexicon)
+{
+    assert(lexicon != NULL);
+
+    lexicon->entries = NULL;
+    lexicon->count = 0;
+    lexicon->capacity = 0;
+}
+
+/*
+ * Free an index.
+ */
+void lexicon_free(lexicon_t *const lexicon)
+{
+    assert(lexicon != NULL);
+
+    free(lexicon->entries);
+    lexicon_init(lexicon);
+}
+
+/*
+ * Get the number of entries.
+ */
+int lexicon_get_count(const lexicon_t *const lexicon)
+{
+    assert(lexicon != NULL);
+
+    return lexicon->count;
+}
+
+/*
+ * Get the string of an entry.
+ */
+const char *lexicon_get_string(const lexicon_t *const lexicon,
+			       const int index)
+{
+    assert(lexicon != NULL);
+    assert(index >= 0 && index < lexicon->count);
+
+    return lexicon->entries[index].str;
+}
+
+/*
+ * Get the object of an entry.
+ */
+void *lexicon_get_object(const lexicon_t *const lexicon, const int index)
+{
+    assert(lexicon != NULL);
+    assert(index >= 0 && index < lexicon->count);
+
+    return (void *) lexicon->entries[index].object;
+}
+
+/*
+ * Add an entry (the string must stay valid until it is removed).
+ */
+int lexicon_add(lexicon_t *const lexicon, const char *const str,
+		const void *const object)
+{
+    int              pos;      /* Insertion index */
+    int              capacity; /* New capacity    */
+    lexicon_entry_t *entries;  /* New entries     */
+
+    assert(lexicon != NULL);
+    assert(str != NULL);
+
+    /* Grow the array if it is full */
+    if (lexicon->count == lexicon->capacity) {
+	capacity = lexicon->capacity != 0 ? lexicon->capacity * 2
+	    : LEXICON_MIN_SIZE;
+	if ((entries = realloc(lexicon->entries,
+			       capacity * sizeof(lexicon_entry_t))) == NULL)
+	    return -1;
+	lexicon->entries = entries;
+	lexicon->capacity = capacity;
+    }
+
+    /* Insert at the right place */
+    pos = lexicon_lower_bound(lexicon, str);
+    memmove(lexicon->entries + pos + 1, lexicon->entries + pos,
+	    (lexicon->count - pos) * sizeof(lexicon_entry_t));
+    lexicon->entries[pos].str = str;
+    lexicon->entries[pos].object = object;
+    lexicon->count++;
+
+    return 0;
+}
+
+/*
+ * Remove an entry, returning its object (NULL if not found).
+ */
+void *lexicon_remove(lexicon_t *const lexicon, const char *const str)
+{
+    int         pos;    /* Entry index */
+    const void *object; /* Its object  */
+
+    assert(lexicon != NULL);
+    assert(str != NULL);
+
+    pos = lexicon_lower_bound(lexicon, str);
+    if (pos == lexicon->count || strcmp(lexicon->entries[pos].str, str) != 0)
+	return NULL;
+
+    object = lexicon->entries[pos].object;
+    lexicon->count--;
+    memmove(lexicon->entries + pos, lexicon->entries + pos + 1,
+	    (lexicon->count - pos) * sizeof(lexicon_entry_t));
+
+    return (void *) object;
+}
+
+/*
+ * Find the entries beginning with a prefix: return their number and store
+ * the index of the first one.
+ */
+int lexicon_find_prefix(const lexicon_t *const lexicon,
+			const char *const prefix, int *const first)
+{
+    int    start; /* First candidate         */
+    int    end;   /* Past the last candidate */
+    int    pos;   /* Middle                  */
+    size_t len;   /* Prefix length           */
+
+    assert(lexicon != NULL);
+    assert(prefix != NULL);
+    assert(first != NULL);
+
+    *first = lexicon_lower_bound(lexicon, prefix);
+    len = strlen(prefix);
+
+    /* Find the first entry not beginning with the prefix */
+    start = *first;
+    end = lexicon->count;
+    while (start < end) {
+	pos = (start + end) / 2;
+	if (strncmp(lexicon->entries[pos].str, prefix, len) == 0)
+	    start = pos + 1;
+	else
+	    end = pos;
+    }
+
+    return start - *first;
+}
+
+/* End of file */
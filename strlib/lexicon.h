@@ -0,0 +1,88 @@
+/*
+ * ---------------------------------------------------------------------------
+ *
+ * Minitalk: a basic talk-like server/client
+ * Copyright (C) 2004 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: strlib/lexicon.h
+ *
+ * Description: Sorted String Index (Header)
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+#ifndef LEXICON_H
+#define LEXICON_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+
+/*
+ * Data types
+ */
+
+/* Index entry */
+typedef struct lexicon_entry {
+    const char *str;    /* Pointer to the corresponding string */
+    const void *object; /* Pointer to the corresponding object */
+} lexicon_entry_t;
+
+/* Sorted string index */
+typedef struct lexicon {
+    lexicon_entry_t *entries;  /* Entries sorted by string    */
+    int              count;    /* Number of entries           */
+    int              capacity; /* Number of allocated entries */
+} lexicon_t;
+
+
+/*
+ * Prototypes
+ */
+
+/* Constructors and destructors */
+void lexicon_init(lexicon_t *const lexicon);
+void lexicon_free(lexicon_t *const lexicon);
+
+/* Accessors */
+int         lexicon_get_count(const lexicon_t *const lexicon);
+const char *lexicon_get_string(const lexicon_t *const lexicon,
+			       const int index);
+void       *lexicon_get_object(const lexicon_t *const lexicon,
+			       const int index);
+
+/* Methods */
+int   lexicon_add(lexicon_t *const lexicon, const char *const str,
+		  const void *const object);
+void *lexicon_remove(lexicon_t *const lexicon, const char *const str);
+int   lexicon_find_prefix(const lexicon_t *const lexicon,
+			  const char *const prefix, int *const first);
+
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !LEXICON_H */
+
+/* End of file */
@@ -0,0 +1,165 @@
+/*
+ * ---------------------------------------------------------------------------
+ *
+ * Minitalk: a basic talk-like server/client
+ * Copyright (C) 2004 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: strlib/queue.c
+ *
+ * Description: Single-Producer Single-Consumer Queue
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+/*****************************************************************************
+ *
+ * Headers
+ *
+ */
+
+/* System headers */
+#include <stdlib.h> /* malloc(), free(), NULL */
+#include <assert.h> /* assert()               */
+
+/* Project headers */
+#include <common.h>
+#include "queue.h"
+
+
+/*****************************************************************************
+ *
+ * Global functions
+ *
+ */
+
+/*
+ * Initialize a queue holding up to capacity items (rounded up to a power of
+ * two).
+ */
+int queue_init(queue_t *const queue, const int capacity)
+{
+    unsigned size; /* Capacity */
+
+    assert(queue != NULL);
+    assert(capacity > 0);
+
+    for (size = 1; size < (unsigned) capacity; size <<= 1);
+    if ((queue->items = malloc(size * sizeof(void *))) == NULL)
+	return -1;
+
+    queue->mask = size - 1;
+    queue->head = 0;
+    queue->tail_cache = 0;
+    queue->tail = 0;
+    queue->next = 0;
+    queue->head_cache = 0;
+    return 0;
+}
+
+/*
+ * Free the queue (items still queued are not freed).
+ */
+void queue_free(queue_t *const queue)
+{
+    assert(queue != NULL);
+
+    free(queue->items);
+    queue->items = NULL;
+}
+
+/*
+ * Append an item to the queue (producer side).  It is seen by the consumer
+ * once published.  Returns -1 if the queue is full.
+ */
+int queue_push(queue_t *const queue, void *const item)
+{
+    assert(queue != NULL);
+    assert(item != NULL);
+
+    /* The consumer's head is only read again when the queue looks full */
+    if (queue->next - queue->head_cache > queue->mask) {
+	queue->head_cache = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+	if (queue->next - queue->head_cache > queue->mask)
+	    return -1;
+    }
+
+    queue->items[queue->next++ & queue->mask] = item;
+    return 0;
+}
+
+/*
+ * Make the items pushed so far visible to the consumer (producer side): a
+ * batch of items costs a single store to the shared tail.
+ */
+void queue_publish(queue_t *const queue)
+{
+    assert(queue != NULL);
+
+    /* Items must be stored before the consumer can see the new tail */
+    if (queue->tail != queue->next)
+	__atomic_store_n(&queue->tail, queue->next, __ATOMIC_RELEASE);
+}
+
+/*
+ * Remove the oldest published item from the queue (consumer side).  Returns
+ * NULL if there is none.
+ */
+void *queue_pop(queue_t *const queue)
+{
+    void *item; /* Removed item */
+
+    return queue_pop_batch(queue, &item, 1) == 1 ? item : NULL;
+}
+
+/*
+ * Remove up to count published items from the queue (consumer side).
+ * Returns the number of removed items.
+ */
+int queue_pop_batch(queue_t *const queue, void **const items,
+		    const int count)
+{
+    int      i;    /* Item counter    */
+    unsigned size; /* Available items */
+
+    assert(queue != NULL);
+    assert(items != NULL);
+    assert(count > 0);
+
+    /* The producer's tail is only read again when the queue looks empty */
+    if (queue->head == queue->tail_cache) {
+	queue->tail_cache = __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+	if (queue->head == queue->tail_cache)
+	    return 0;
+    }
+
+    size = queue->tail_cache - queue->head;
+    if (size > (unsigned) count)
+	size = count;
+    for (i = 0; i < (int) size; i++)
+	items[i] = queue->items[(queue->head + i) & queue->mask];
+
+    /* Items must be read before the producer can reuse their places */
+    __atomic_store_n(&queue->head, queue->head + size, __ATOMIC_RELEASE);
+    return size;
+}
+
+/* End of file */
@@ -0,0 +1,100 @@
+/*
+ * ---------------------------------------------------------------------------
+ *
+ * Minitalk: a basic talk-like server/client
+ * Copyright (C) 2004 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: strlib/queue.h
+ *
+ * Description: Single-Producer Single-Consumer Queue (Header)
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+#ifndef QUEUE_H
+#define QUEUE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+
+/*
+ * Constants
+ */
+
+/* Size of a cache line: fields written by different threads are kept apart
+ * so that they do not share one */
+#ifndef QUEUE_CACHE_LINE
+# define QUEUE_CACHE_LINE 64
+#endif
+
+
+/*
+ * Data types
+ */
+
+/* Bounded queue of pointers between one producer and one consumer thread */
+typedef struct queue {
+    /* Set once */
+    void   **items;      /* Ring of items (capacity is a power of two) */
+    unsigned mask;       /* Capacity minus one                         */
+    char     pad_items[QUEUE_CACHE_LINE];
+
+    /* Consumer side */
+    unsigned head;       /* Index of the next item to pop              */
+    unsigned tail_cache; /* Published tail last read by the consumer   */
+    char     pad_head[QUEUE_CACHE_LINE];
+
+    /* Producer side */
+    unsigned tail;       /* Index past the last published item         */
+    unsigned next;       /* Index of the next item to push             */
+    unsigned head_cache; /* Head last read by the producer             */
+    char     pad_tail[QUEUE_CACHE_LINE];
+} queue_t;
+
+
+/*
+ * Prototypes
+ */
+
+/* Constructors and destructors */
+int  queue_init(queue_t *const queue, const int capacity);
+void queue_free(queue_t *const queue);
+
+/* Producer */
+int  queue_push(queue_t *const queue, void *const item);
+void queue_publish(queue_t *const queue);
+
+/* Consumer */
+void *queue_pop(queue_t *const queue);
+int   queue_pop_batch(queue_t *const queue, void **const items,
+		      const int count);
+
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !QUEUE_H */
+
+/* End of file */
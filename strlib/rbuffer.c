@@ -0,0 +1,328 @@
+/*
+ * ---------------------------------------------------------------------------
+ *
+ * Minitalk: a basic talk-like server/client
+ * Copyright (C) 2004 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: strlib/rbuffer.c
+ *
+ * Description: Ring Buffers
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+/*****************************************************************************
+ *
+ * Headers
+ *
+ */
+
+/* System headers */
+#include <stdlib.h> /* malloc(), free(), NULL */
+#include <string.h> /* memcpy(), memchr()     */
+#include <limits.h> /* INT_MAX                */
+#include <assert.h> /* assert()               */
+
+/* Unix headers */
+#include <sys/uio.h> /* struct iovec */
+
+/* Project headers */
+#include <common.h>
+#include "rbuffer.h"
+
+
+/*****************************************************************************
+ *
+ * Global functions
+ *
+ */
+
+/*
+ * Create a new ring buffer (capacity must be a power of two).
+ */
+rbuffer_t *rbuffer_new(const int capacity)
+{
+    rbuffer_t *ring;
+
+    assert(capacity > 0 && (capacity & (capacity - 1)) == 0);
+
+    if ((ring = malloc(sizeof(rbuffer_t))) == NULL)
+	return NULL;
+
+    if ((ring->data = malloc(capacity)) == NULL) {
+	free(ring);
+	return NULL;
+    }
+
+    ring->capacity = capacity;
+    ring->start = 0;
+    ring->size = 0;
+
+    return ring;
+}
+
+/*
+ * Delete a ring buffer.
+ */
+void rbuffer_delete(rbuffer_t *const ring)
+{
+    assert(ring != NULL);
+
+    free(ring->data);
+    free(ring);
+}
+
+/*
+ * Get the size of data in the buffer.
+ */
+int rbuffer_get_size(const rbuffer_t *const ring)
+{
+    assert(ring != NULL);
+
+    return ring->size;
+}
+
+/*
+ * Get the size of the storage.
+ */
+int rbuffer_get_capacity(const rbuffer_t *const ring)
+{
+    assert(ring != NULL);
+
+    return ring->capacity;
+}
+
+/*
+ * Make sure there is room for `size' more bytes, doubling the storage as
+ * needed (data is moved to the beginning of the new storage).
+ */
+int rbuffer_reserve(rbuffer_t *const ring, const int size)
+{
+    int   capacity; /* New capacity             */
+    int   first;    /* Size of the first part   */
+    char *data;     /* New storage              */
+
+    assert(ring != NULL);
+    assert(size >= 0);
+
+    if (ring->capacity - ring->size >= size)
+	return 0;
+
+    for (capacity = ring->capacity; capacity - ring->size < size;
+	 capacity *= 2)
+	if (capacity > INT_MAX / 2)
+	    return -1;
+
+    if ((data = malloc(capacity)) == NULL)
+	return -1;
+
+    /* Copy data in one piece */
+    first = ring->capacity - ring->start;
+    if (first >= ring->size)
+	memcpy(data, ring->data + ring->start, ring->size);
+    else {
+	memcpy(data, ring->data + ring->start, first);
+	memcpy(data + first, ring->data, ring->size - first);
+    }
+
+    free(ring->data);
+    ring->data = data;
+    ring->capacity = capacity;
+    ring->start = 0;
+
+    return 0;
+}
+
+/*
+ * Get the vectors (one or two) covering the data.
+ */
+int rbuffer_get_vectors(const rbuffer_t *const ring, struct iovec *const iov)
+{
+    int first; /* Size of the first part */
+
+    assert(ring != NULL);
+    assert(iov != NULL);
+
+    if (ring->size == 0)
+	return 0;
+
+    first = ring->capacity - ring->start;
+    iov[0].iov_base = ring->data + ring->start;
+    if (first >= ring->size) {
+	iov[0].iov_len = ring->size;
+	return 1;
+    }
+
+    iov[0].iov_len = first;
+    iov[1].iov_base = ring->data;
+    iov[1].iov_len = ring->size - first;
+    return 2;
+}
+
+/*
+ * Get the vectors (one or two) covering the free space.
+ */
+int rbuffer_get_space(const rbuffer_t *const ring, struct iovec *const iov)
+{
+    int end; /* Offset of the end of data */
+
+    assert(ring != NULL);
+    assert(iov != NULL);
+
+    if (ring->size == ring->capacity)
+	return 0;
+
+    end = (ring->start + ring->size) & (ring->capacity - 1);
+    iov[0].iov_base = ring->data + end;
+    if (end < ring->start) {
+	iov[0].iov_len = ring->start - end;
+	return 1;
+    }
+
+    iov[0].iov_len = ring->capacity - end;
+    if (ring->start == 0)
+	return 1;
+    iov[1].iov_base = ring->data;
+    iov[1].iov_len = ring->start;
+    return 2;
+}
+
+/*
+ * Add data written directly in the free space.
+ */
+void rbuffer_commit(rbuffer_t *const ring, const int size)
+{
+    assert(ring != NULL);
+    assert(size >= 0 && ring->size + size <= ring->capacity);
+
+    ring->size += size;
+}
+
+/*
+ * Find a character in the data, starting at an offset.  Return its offset,
+ * or -1 if it was not found.
+ */
+int rbuffer_find(const rbuffer_t *const ring, const int offset,
+		 const char chr)
+{
+    int          i;      /* Vector index        */
+    int          count;  /* Vector count        */
+    int          skip;   /* Data to skip        */
+    int          base;   /* Offset of vector    */
+    const char  *found;  /* Character position  */
+    struct iovec iov[2]; /* Data vectors        */
+
+    assert(ring != NULL);
+    assert(offset >= 0);
+
+    count = rbuffer_get_vectors(ring, iov);
+    skip = offset;
+    base = 0;
+
+    for (i = 0; i < count; i++) {
+	if (skip < (int) iov[i].iov_len &&
+	    (found = memchr((char *) iov[i].iov_base + skip, chr,
+			    iov[i].iov_len - skip)) != NULL)
+	    return base + (found - (char *) iov[i].iov_base);
+
+	skip = skip > (int) iov[i].iov_len ? skip - iov[i].iov_len : 0;
+	base += iov[i].iov_len;
+    }
+
+    return -1;
+}
+
+/*
+ * Get a pointer to the first `size' bytes of data if they are contiguous and
+ * preceded by `space' free bytes, or NULL.
+ */
+char *rbuffer_peek(rbuffer_t *const ring, const int size, const int space)
+{
+    assert(ring != NULL);
+    assert(size <= ring->size);
+
+    if (ring->start + size > ring->capacity || ring->start < space ||
+	ring->capacity - ring->size < space)
+	return NULL;
+
+    return ring->data + ring->start;
+}
+
+/*
+ * Get data from the buffer (or drop it if `data' is NULL).
+ */
+int rbuffer_get_data(rbuffer_t *const ring, char *const data,
+		     const int data_size)
+{
+    int size;  /* Size of data to get     */
+    int first; /* Size of the first part  */
+
+    assert(ring != NULL);
+
+    size = data_size < ring->size ? data_size : ring->size;
+
+    if (data != NULL) {
+	first = ring->capacity - ring->start;
+	if (first >= size)
+	    memcpy(data, ring->data + ring->start, size);
+	else {
+	    memcpy(data, ring->data + ring->start, first);
+	    memcpy(data + first, ring->data, size - first);
+	}
+    }
+
+    ring->size -= size;
+    ring->start = ring->size != 0 ?
+	(ring->start + size) & (ring->capacity - 1) : 0;
+
+    return size;
+}
+
+/*
+ * Append data to the buffer.
+ */
+int rbuffer_put_data(rbuffer_t *const ring, const char *const data,
+		     const int data_size)
+{
+    int end;   /* Offset of the end of data */
+    int first; /* Size of the first part    */
+
+    assert(ring != NULL);
+    assert(data != NULL || data_size == 0);
+
+    if (rbuffer_reserve(ring, data_size) != 0)
+	return -1;
+
+    end = (ring->start + ring->size) & (ring->capacity - 1);
+    first = ring->capacity - end;
+    if (first >= data_size)
+	memcpy(ring->data + end, data, data_size);
+    else {
+	memcpy(ring->data + end, data, first);
+	memcpy(ring->data, data + first, data_size - first);
+    }
+
+    ring->size += data_size;
+    return data_size;
+}
+
+/* End of file */
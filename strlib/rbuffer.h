@@ -0,0 +1,90 @@
+/*
+ * ---------------------------------------------------------------------------
+ *
+ * Minitalk: a basic talk-like server/client
+ * Copyright (C) 2004 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: strlib/rbuffer.h
+ *
+ * Description: Ring Buffers (Header)
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+#ifndef RBUFFER_H
+#define RBUFFER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+
+/*
+ * Data types
+ */
+
+/* I/O vector (non-explicit) */
+struct iovec;
+
+/* Ring buffer */
+typedef struct rbuffer {
+    char *data;     /* Storage                              */
+    int   capacity; /* Size of storage (power of two)       */
+    int   start;    /* Offset of the first byte of data     */
+    int   size;     /* Size of data in the buffer           */
+} rbuffer_t;
+
+
+/*
+ * Prototypes
+ */
+
+/* Constructors and destructors */
+rbuffer_t *rbuffer_new(const int capacity);
+void       rbuffer_delete(rbuffer_t *const ring);
+
+/* Accessors */
+int rbuffer_get_size(const rbuffer_t *const ring);
+int rbuffer_get_capacity(const rbuffer_t *const ring);
+
+/* Methods */
+int   rbuffer_reserve(rbuffer_t *const ring, const int size);
+int   rbuffer_get_vectors(const rbuffer_t *const ring,
+			  struct iovec *const iov);
+int   rbuffer_get_space(const rbuffer_t *const ring, struct iovec *const iov);
+void  rbuffer_commit(rbuffer_t *const ring, const int size);
+int   rbuffer_find(const rbuffer_t *const ring, const int offset,
+		   const char chr);
+char *rbuffer_peek(rbuffer_t *const ring, const int size, const int space);
+int   rbuffer_get_data(rbuffer_t *const ring, char *const data,
+		       const int data_size);
+int   rbuffer_put_data(rbuffer_t *const ring, const char *const data,
+		       const int data_size);
+
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !RBUFFER_H */
+
+/* End of file */
@@ -0,0 +1,119 @@
+/*
+ * ---------------------------------------------------------------------------
+ *
+ * Minitalk: a basic talk-like server/client
+ * Copyright (C) 2004 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: strlib/segment.c
+ *
+ * Description: Shared Data Segments
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+/*****************************************************************************
+ *
+ * Headers
+ *
+ */
+
+/* System headers */
+#include <stdlib.h> /* malloc(), free(), NULL */
+#include <string.h> /* memcpy()               */
+#include <assert.h> /* assert()               */
+
+/* Project headers */
+#include <common.h>
+#include "segment.h"
+
+
+/*****************************************************************************
+ *
+ * Global functions
+ *
+ */
+
+/*
+ * Create a new segment holding a copy of the data (one reference).
+ */
+segment_t *segment_new(const char *const data, const int size)
+{
+    segment_t *segment;
+
+    assert(data != NULL || size == 0);
+    assert(size >= 0);
+
+    if ((segment = malloc(sizeof(segment_t) + size)) == NULL)
+	return NULL;
+
+    segment->refs = 1;
+    segment->size = size;
+    memcpy(segment->data, data, size);
+
+    return segment;
+}
+
+/*
+ * Get the size of the data.
+ */
+int segment_get_size(const segment_t *const segment)
+{
+    assert(segment != NULL);
+
+    return segment->size;
+}
+
+/*
+ * Get the data.
+ */
+const char *segment_get_data(const segment_t *const segment)
+{
+    assert(segment != NULL);
+
+    return segment->data;
+}
+
+/*
+ * Add a reference to the segment.
+ */
+segment_t *segment_ref(segment_t *const segment)
+{
+    assert(segment != NULL);
+    assert(segment->refs > 0);
+
+    segment->refs++;
+    return segment;
+}
+
+/*
+ * Drop a reference to the segment, deleting it with the last one.
+ */
+void segment_release(segment_t *const segment)
+{
+    assert(segment != NULL);
+    assert(segment->refs > 0);
+
+    if (--segment->refs == 0)
+	free(segment);
+}
+
+/* End of file */
@@ -0,0 +1,75 @@
+/*
+ * ---------------------------------------------------------------------------
+ *
+ * Minitalk: a basic talk-like server/client
+ * Copyright (C) 2004 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: strlib/segment.h
+ *
+ * Description: Shared Data Segments (Header)
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+#ifndef SEGMENT_H
+#define SEGMENT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+
+/*
+ * Data types
+ */
+
+/* Shared immutable data segment */
+typedef struct segment {
+    int  refs;   /* Reference count         */
+    int  size;   /* Size of data            */
+    char data[]; /* Data (never modified)   */
+} segment_t;
+
+
+/*
+ * Prototypes
+ */
+
+/* Constructors and destructors */
+segment_t *segment_new(const char *const data, const int size);
+
+/* Accessors */
+int         segment_get_size(const segment_t *const segment);
+const char *segment_get_data(const segment_t *const segment);
+
+/* Methods */
+segment_t *segment_ref(segment_t *const segment);
+void       segment_release(segment_t *const segment);
+
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* !SEGMENT_H */
+
+/* End of file */